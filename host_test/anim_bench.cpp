@@ -0,0 +1,698 @@
+/*-------------------------------------------------------------------------
+Per-effect frame cost benchmark for main/animation.cpp on the host.
+
+Each effect is started on a freshly built strip and run for a fixed number
+of frames. The host clock is in manual mode and advanced by one frame
+interval per frame, so every run sees the same animation progress; only
+the render (render_frame + Show) is timed. "sent %" is the share of
+frames Show() actually transmitted; unchanged frames are skipped apart
+from the keep-alive.
+
+The second table crossfades each effect into the next, as a change of
+animation does, and times the frames of the crossfade, where both effects
+render into their own canvas and the blend stage mixes them into the
+strip. "budget %" is the slowest of those frames against the frame
+interval.
+
+The third table stacks up to three layers, one in each blend mode, over
+RainbowFade. Every layer is an effect on its own canvas; the compositor
+mixes them into the strip in one pass per frame.
+
+The fourth table splits each layout into 1, 2 and 4 zones, each running a
+different effect, and reports the render time of every zone as
+get_zone_timing() does on the device, with the whole frame under "all".
+
+The fifth table runs with the stand-in RMT transmitter sending at SK6812
+speed (40us per RGBW pixel) and compares waiting for each frame to leave
+the wire before rendering the next (serial) with rendering while it is
+sent (overlapped). Overlap hides up to min(render, wire) per frame.
+
+The sixth table splits each layout over 1, 2, 4 and 8 outputs and sends
+them in parallel. Every transmit is logged by the stand-in RMT method and
+checked: each frame starts every output, in channel order, on the right
+pin and with that output's pixels, all outputs of a frame are on the wire
+at the same time, and no channel starts a frame before its last one ended.
+
+The last table times HsbColor's float conversions against the fixed point
+ones in FastHsb over every hue, saturation and brightness step, and
+reports the largest difference on any channel. The easing table does the
+same for the NeoEase curves the effects use against their EaseTable
+lookups.
+
+usage: anim_bench [frames]
+-------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <chrono>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+#include "host_clock.h"
+
+#include "anim_host.h"
+#include "FastHsb.h"
+#include "EaseTable.h"
+
+
+// count every heap allocation made while a frame renders
+static std::atomic<uint64_t> s_allocations (0);
+
+void* operator new(size_t size)
+{
+    s_allocations++;
+    void* p = malloc(size ? size : 1);
+    if (p == NULL) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t size) noexcept
+{
+    free(p);
+}
+
+
+// animation_task() renders at the default frame rate unless configured otherwise
+static const int64_t FRAME_INTERVAL_US = 1000000 / DEFAULT_FRAME_RATE;
+
+static uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool bench_render(int frames)
+{
+    printf("%-20s %-14s %7s %12s %12s %12s %10s %7s\n",
+        "layout", "effect", "pixels", "ns/frame", "max ns", "allocs/frame", "ns/pixel", "sent %");
+
+    NeoEsp32RmtNSk6812Method::NsPerByte() = 0;
+
+    for (const host_layout_t &layout : s_host_layouts) {
+        host_configure_layout(&layout);
+
+        for (const host_effect_t &effect : s_host_effects) {
+            if (!host_start_effect(&layout, &effect)) {
+                return false;
+            }
+            uint16_t pixels = strip->PixelCount();
+
+            uint64_t total_ns = 0;
+            uint64_t max_ns = 0;
+            uint64_t allocations = 0;
+            uint32_t sent_before = strip->FramesSent();
+
+            for (int frame = 0; frame < frames; frame++) {
+                host_clock_advance_us(FRAME_INTERVAL_US);
+
+                uint64_t allocations_before = s_allocations;
+                uint64_t start = now_ns();
+
+                render_frame();
+                strip->Show();
+
+                uint64_t ns = now_ns() - start;
+                allocations += s_allocations - allocations_before;
+
+                total_ns += ns;
+                if (ns > max_ns) {
+                    max_ns = ns;
+                }
+            }
+
+            printf("%-20s %-14s %7u %12.0f %12llu %12.1f %10.1f %7.1f\n",
+                layout.name, effect.name, pixels,
+                (double)total_ns / frames, (unsigned long long)max_ns,
+                (double)allocations / frames,
+                (double)total_ns / frames / pixels,
+                100.0 * (strip->FramesSent() - sent_before) / frames);
+        }
+    }
+    return true;
+}
+
+// every frame of a crossfade renders two effects and the blend
+static bool bench_crossfade()
+{
+    const int frames = DEFAULT_CROSSFADE_MS * 1000 / FRAME_INTERVAL_US;
+    std::vector<const host_effect_t*> effects;
+    for (const host_effect_t &effect : s_host_effects) {
+        if (effect.animation_id != 0) {
+            effects.push_back(&effect);
+        }
+    }
+
+    printf("\n%-20s %-26s %7s %12s %12s %12s %10s\n",
+        "layout", "crossfade", "pixels", "ns/frame", "max ns", "allocs/frame", "budget %");
+
+    NeoEsp32RmtNSk6812Method::NsPerByte() = 0;
+
+    for (const host_layout_t &layout : s_host_layouts) {
+        host_configure_layout(&layout);
+
+        // every effect but the fades into the next one
+        for (size_t e = 0; e < effects.size(); e++) {
+            const host_effect_t &from = *effects[e];
+            const host_effect_t &to = *effects[(e + 1) % effects.size()];
+
+            if (!host_start_effect(&layout, &from)) {
+                return false;
+            }
+            // half a second in, so the outgoing effect has something to show
+            for (int frame = 0; frame < frames / 2; frame++) {
+                host_clock_advance_us(FRAME_INTERVAL_US);
+                render_frame();
+                strip->Show();
+            }
+
+            seed_effect_random();
+            begin_effect(to.animation_id, true);
+            to.start();
+
+            uint64_t total_ns = 0;
+            uint64_t max_ns = 0;
+            uint64_t allocations = 0;
+
+            for (int frame = 0; frame < frames; frame++) {
+                host_clock_advance_us(FRAME_INTERVAL_US);
+
+                uint64_t allocations_before = s_allocations;
+                uint64_t start = now_ns();
+
+                render_frame();
+                strip->Show();
+
+                uint64_t ns = now_ns() - start;
+                allocations += s_allocations - allocations_before;
+
+                total_ns += ns;
+                if (ns > max_ns) {
+                    max_ns = ns;
+                }
+            }
+
+            // the crossfade is over, so the strip shows the incoming effect alone
+            host_clock_advance_us(FRAME_INTERVAL_US);
+            render_frame();
+            for (uint16_t i = 0; i < strip->PixelCount(); i++) {
+                if (strip->GetPixelColor(i) != canvas->GetPixelColor(i)) {
+                    fprintf(stderr, "%s, %s > %s: pixel %d still blended after the crossfade\n",
+                        layout.name, from.name, to.name, i);
+                    return false;
+                }
+            }
+            strip->WaitShown();
+
+            char name[32];
+            snprintf(name, sizeof(name), "%s > %s", from.name, to.name);
+            printf("%-20s %-26s %7u %12.0f %12llu %12.1f %10.1f\n",
+                layout.name, name, strip->PixelCount(),
+                (double)total_ns / frames, (unsigned long long)max_ns,
+                (double)allocations / frames,
+                100.0 * max_ns / (FRAME_INTERVAL_US * 1000));
+        }
+    }
+    return true;
+}
+
+// layers over an effect, composed in one pass
+static bool bench_layers(int frames)
+{
+    static const led_layer_t s_layers[] = {
+        { 2, 255, 1 },      // Glitter, add
+        { 1, 192, 2 },      // Cylon, screen
+        { 7, 128, 3 },      // Snake, max
+    };
+    static const host_effect_t s_base = { "RainbowFade", 4, [] { RainbowFadeAnimationSet(); show_layers(256); } };
+
+    printf("\n%-20s %-14s %7s %7s %12s %12s %12s\n",
+        "layout", "effect", "layers", "pixels", "ns/frame", "max ns", "allocs/frame");
+
+    NeoEsp32RmtNSk6812Method::NsPerByte() = 0;
+
+    for (const host_layout_t &layout : s_host_layouts) {
+        host_configure_layout(&layout);
+
+        for (uint8_t count = 0; count <= MAX_LAYERS; count++) {
+            host_configure_layers(s_layers, count);
+            if (!host_start_effect(&layout, &s_base)) {
+                return false;
+            }
+
+            uint64_t total_ns = 0;
+            uint64_t max_ns = 0;
+            uint64_t allocations = 0;
+
+            for (int frame = 0; frame < frames; frame++) {
+                host_clock_advance_us(FRAME_INTERVAL_US);
+
+                uint64_t allocations_before = s_allocations;
+                uint64_t start = now_ns();
+
+                render_frame();
+                strip->Show();
+
+                uint64_t ns = now_ns() - start;
+                allocations += s_allocations - allocations_before;
+
+                total_ns += ns;
+                if (ns > max_ns) {
+                    max_ns = ns;
+                }
+            }
+            strip->WaitShown();
+
+            printf("%-20s %-14s %7u %7u %12.0f %12llu %12.1f\n",
+                layout.name, s_base.name, count, strip->PixelCount(),
+                (double)total_ns / frames, (unsigned long long)max_ns,
+                (double)allocations / frames);
+        }
+    }
+
+    host_configure_layers(NULL, 0);
+    return true;
+}
+
+// zones of one layout, each running its own effect, rendered in one pass
+static bool bench_zones(int frames)
+{
+    static const host_effect_t* s_zone_effects[MAX_ZONES] = {
+        &s_host_effects[4],     // RainbowFade
+        &s_host_effects[5],     // FireworksHsb
+        &s_host_effects[2],     // Glitter
+        &s_host_effects[1],     // Cylon
+    };
+    static const uint8_t s_zone_counts[] = { 1, 2, 4 };
+
+    printf("\n%-20s %5s %5s %-14s %7s %12s %12s\n",
+        "layout", "zones", "zone", "effect", "pixels", "us/frame", "max us");
+
+    NeoEsp32RmtNSk6812Method::NsPerByte() = 0;
+
+    for (const host_layout_t &layout : s_host_layouts) {
+        host_configure_layout(&layout);
+
+        for (uint8_t count : s_zone_counts) {
+            host_configure_zones(&layout, count);
+            if (!host_start_effect(&layout, s_zone_effects[0])) {
+                return false;
+            }
+            for (uint8_t z = 1; z < count; z++) {
+                bind_zone(z);
+                seed_effect_random();
+                set_brightness(z, 100);
+                s_zone_effects[z]->start();
+            }
+
+            uint64_t total_ns = 0;
+            uint64_t max_ns = 0;
+            for (int frame = 0; frame < frames; frame++) {
+                host_clock_advance_us(FRAME_INTERVAL_US);
+
+                uint64_t start = now_ns();
+                render_frame();
+                uint64_t ns = now_ns() - start;
+
+                total_ns += ns;
+                max_ns = std::max(max_ns, ns);
+                strip->Show();
+            }
+            strip->WaitShown();
+
+            for (uint8_t z = 0; z < count; z++) {
+                led_zone_timing_t timing;
+                get_zone_timing(z, &timing);
+                if (timing.frames != (uint32_t)frames) {
+                    fprintf(stderr, "zone %u of %u rendered %u frames of %d\n", z, count, timing.frames, frames);
+                    return false;
+                }
+                // the rings host_configure_zones() gave the zone
+                uint16_t pixels = 0;
+                for (uint8_t ring = layout.num_rings * z / count; ring < layout.num_rings * (z + 1) / count; ring++) {
+                    pixels += layout.pixel_layout[ring];
+                }
+                printf("%-20s %5u %5u %-14s %7u %12u %12u\n",
+                    layout.name, count, z, s_zone_effects[z]->name, pixels, timing.average_us, timing.max_us);
+            }
+            printf("%-20s %5u %5s %-14s %7u %12.1f %12.1f\n",
+                layout.name, count, "all", "", strip->PixelCount(), total_ns / 1000.0 / frames, max_ns / 1000.0);
+        }
+    }
+
+    host_configure_zones(NULL, 0);
+    return true;
+}
+
+static bool bench_overlap(int frames)
+{
+    printf("\n%-20s %-14s %7s %12s %12s %12s %12s %12s\n",
+        "layout", "effect", "pixels", "wire ns", "render ns", "serial ns", "overlap ns", "saved ns");
+
+    NeoEsp32RmtNSk6812Method::NsPerByte() = 10000;
+
+    for (const host_layout_t &layout : s_host_layouts) {
+        host_configure_layout(&layout);
+
+        for (const host_effect_t &effect : s_host_effects) {
+            uint64_t frame_ns[2];
+            uint64_t render_ns = 0;
+
+            for (int overlap = 0; overlap < 2; overlap++) {
+                if (!host_start_effect(&layout, &effect)) {
+                    return false;
+                }
+
+                uint64_t start = now_ns();
+                for (int frame = 0; frame < frames; frame++) {
+                    host_clock_advance_us(FRAME_INTERVAL_US);
+
+                    uint64_t render_start = now_ns();
+                    render_frame();
+                    if (!overlap) {
+                        render_ns += now_ns() - render_start;
+                    }
+
+                    strip->Show();
+                    if (!overlap) {
+                        strip->WaitShown();
+                    }
+                }
+                strip->WaitShown();
+                frame_ns[overlap] = (now_ns() - start) / frames;
+            }
+
+            printf("%-20s %-14s %7u %12u %12llu %12llu %12llu %12lld\n",
+                layout.name, effect.name, strip->PixelCount(), strip->WireTimeUs() * 1000,
+                (unsigned long long)render_ns / frames,
+                (unsigned long long)frame_ns[0], (unsigned long long)frame_ns[1],
+                (long long)frame_ns[0] - (long long)frame_ns[1]);
+        }
+    }
+
+    NeoEsp32RmtNSk6812Method::NsPerByte() = 0;
+    return true;
+}
+
+// GRBW wire bytes of one output's range of the back buffer after the output stage,
+// hashed as the transmitter does
+static uint32_t expected_hash(const NeoStripOutput &output)
+{
+    std::vector<uint8_t> data(output.count * NeoGrbwFeature::PixelSize);
+    for (uint16_t i = 0; i < output.count; i++) {
+        NeoGrbwFeature::applyPixelColor(data.data(), i, strip->OutputStage().Apply(strip->GetPixelColor(output.first + i)));
+    }
+    return NeoEsp32RmtNSk6812Method::Hash(data.data(), data.size());
+}
+
+// checks the transmits logged for one frame. returns NULL if they are fine
+static const char* check_frame(const std::vector<NeoHostTransmit> &transmits, size_t first,
+    std::vector<int64_t> &channel_end)
+{
+    uint8_t outputs = strip->OutputCount();
+    if (transmits.size() - first != outputs) {
+        return "wrong number of transmits";
+    }
+
+    int64_t last_start = 0;
+    int64_t first_end = INT64_MAX;
+    for (uint8_t o = 0; o < outputs; o++) {
+        const NeoHostTransmit &t = transmits[first + o];
+        if (t.channel != o || t.pin != strip->Output(o).pin) {
+            return "outputs out of order";
+        }
+        if (t.hash != expected_hash(strip->Output(o))) {
+            return "output sent the wrong pixels";
+        }
+        if (t.startUs < channel_end[o]) {
+            return "channel started before its last frame ended";
+        }
+        channel_end[o] = t.endUs;
+        last_start = std::max(last_start, t.startUs);
+        first_end = std::min(first_end, t.endUs);
+    }
+    if (outputs > 1 && last_start >= first_end) {
+        return "outputs not sent in parallel";
+    }
+    return NULL;
+}
+
+static bool bench_outputs(int frames)
+{
+    static const uint8_t s_output_counts[] = { 1, 2, 4, 8 };
+    const host_effect_t &effect = s_host_effects[4];    // RainbowFade
+
+    printf("\n%-20s %-14s %7s %12s %12s %12s\n",
+        "layout", "effect", "outputs", "wire ns", "ns/frame", "speedup");
+
+    NeoEsp32RmtNSk6812Method::NsPerByte() = 10000;
+    NeoEsp32RmtNSk6812Method::LogTransmits() = true;
+    std::vector<NeoHostTransmit> &transmits = NeoEsp32RmtNSk6812Method::Transmits();
+
+    for (const host_layout_t &layout : s_host_layouts) {
+        uint64_t single_ns = 0;
+
+        for (uint8_t count : s_output_counts) {
+            host_configure_layout(&layout);
+            host_configure_outputs(&layout, count);
+
+            if (!host_start_effect(&layout, &effect)) {
+                return false;
+            }
+            std::vector<int64_t> channel_end(strip->OutputCount(), 0);
+
+            uint64_t start = now_ns();
+            for (int frame = 0; frame < frames; frame++) {
+                host_clock_advance_us(FRAME_INTERVAL_US);
+                render_frame();
+
+                transmits.clear();
+                if (!strip->Show()) {
+                    continue;
+                }
+
+                const char *error = check_frame(transmits, 0, channel_end);
+                if (error != NULL) {
+                    fprintf(stderr, "%s, %d outputs, frame %d: %s\n", layout.name, count, frame, error);
+                    return false;
+                }
+            }
+            strip->WaitShown();
+            uint64_t frame_ns = (now_ns() - start) / frames;
+            if (count == 1) {
+                single_ns = frame_ns;
+            }
+
+            printf("%-20s %-14s %7u %12u %12llu %12.2f\n",
+                layout.name, effect.name, strip->OutputCount(), strip->WireTimeUs() * 1000,
+                (unsigned long long)frame_ns, (double)single_ns / frame_ns);
+        }
+    }
+
+    host_configure_layout(&s_host_layouts[0]);
+    NeoEsp32RmtNSk6812Method::LogTransmits() = false;
+    transmits.clear();
+    NeoEsp32RmtNSk6812Method::NsPerByte() = 0;
+    return true;
+}
+
+// keeps the conversions from being optimised away
+static volatile uint32_t s_sink;
+
+// fastest of several runs of convert() over every sample, in ns per conversion.
+// the fastest run is the one least disturbed by the rest of the machine
+template <typename T, typename F> static double conversion_ns(const std::vector<T> &samples, F convert)
+{
+    uint64_t best = UINT64_MAX;
+    for (int run = 0; run < 9; run++) {
+        uint64_t start = now_ns();
+        for (int r = 0; r < 20; r++) {
+            for (const T &c : samples) {
+                s_sink += convert(c);
+            }
+        }
+        best = std::min(best, now_ns() - start);
+    }
+    return (double)best / (samples.size() * 20);
+}
+
+static bool bench_hsb()
+{
+    // every 16th hue (of 256 steps), every saturation and brightness step of 15
+    std::vector<HsbColor> hsb;
+    std::vector<HsbColor16> hsb16;
+    std::vector<RgbwColor> rgb;
+    for (int h = 0; h < 256; h += 16) {
+        for (int s = 0; s <= 255; s += 15) {
+            for (int b = 0; b <= 255; b += 15) {
+                hsb.push_back(HsbColor(h / 256.0f, s / 255.0f, b / 255.0f));
+                hsb16.push_back({ (uint16_t)(h << 8), (uint8_t)s, (uint8_t)b });
+                rgb.push_back(RgbwColor(h, s, b, 0));
+            }
+        }
+    }
+
+    printf("\n%-14s %12s %12s %10s %10s\n", "conversion", "float ns", "fixed ns", "speedup", "max error");
+
+    // HSB to RGBW. the effects keep hue, saturation and brightness as integers
+    // on the fixed point path, so that is what is timed
+    double float_ns = conversion_ns(hsb, [](const HsbColor &c) {
+        RgbColor color = c;
+        return color.R + color.G + color.B;
+    });
+    double fixed_ns = conversion_ns(hsb16, [](const HsbColor16 &c) {
+        RgbwColor color = FastHsb::ToRgbw(c.H, c.S, c.B);
+        return color.R + color.G + color.B;
+    });
+
+    int rgbw_error = 0;
+    for (const HsbColor &c : hsb) {
+        RgbColor expected = c;
+        RgbwColor color = FastHsb::ToRgbw(c);
+        rgbw_error = std::max(rgbw_error, abs(color.R - expected.R));
+        rgbw_error = std::max(rgbw_error, abs(color.G - expected.G));
+        rgbw_error = std::max(rgbw_error, abs(color.B - expected.B));
+    }
+    printf("%-14s %12.1f %12.1f %10.2f %10d\n", "hsb -> rgbw",
+        float_ns, fixed_ns, float_ns / fixed_ns, rgbw_error);
+
+    // RGB to HSB. hue error is in 1/256ths of a turn
+    float_ns = conversion_ns(rgb, [](const RgbwColor &c) {
+        HsbColor color = HsbColor(RgbColor(c.R, c.G, c.B));
+        return (uint32_t)(color.H * 255.0f) + (uint32_t)(color.B * 255.0f);
+    });
+    fixed_ns = conversion_ns(rgb, [](const RgbwColor &c) {
+        HsbColor16 color = FastHsb::FromRgb(c);
+        return (uint32_t)(color.H >> 8) + color.B;
+    });
+
+    int hsb_error = 0;
+    for (const RgbwColor &c : rgb) {
+        HsbColor expected = HsbColor(RgbColor(c.R, c.G, c.B));
+        HsbColor16 color = FastHsb::FromRgb(c);
+        int hue_error = abs((color.H >> 8) - (int)(expected.H * 256.0f + 0.5f));
+        hsb_error = std::max(hsb_error, std::min(hue_error, 256 - hue_error));
+        hsb_error = std::max(hsb_error, abs(color.S - (int)(expected.S * 255.0f + 0.5f)));
+        hsb_error = std::max(hsb_error, abs(color.B - (int)(expected.B * 255.0f + 0.5f)));
+    }
+    printf("%-14s %12.1f %12.1f %10.2f %10d\n", "rgb -> hsb",
+        float_ns, fixed_ns, float_ns / fixed_ns, hsb_error);
+
+    // the effects rely on this to look the same as before
+    if (rgbw_error > 1 || hsb_error > 1) {
+        fprintf(stderr, "fixed point HSB differs from HsbColor by more than 1\n");
+        return false;
+    }
+    return true;
+}
+
+static bool bench_easing()
+{
+    static const struct {
+        const char *name;
+        AnimEaseFunction function;
+        EaseCurve curve;
+    } s_curves[] = {
+        { "Linear",             NeoEase::Linear,            EaseCurve_Linear },
+        { "QuadraticIn",        NeoEase::QuadraticIn,       EaseCurve_QuadraticIn },
+        { "QuadraticOut",       NeoEase::QuadraticOut,      EaseCurve_QuadraticOut },
+        { "QuadraticInOut",     NeoEase::QuadraticInOut,    EaseCurve_QuadraticInOut },
+        { "CubicIn",            NeoEase::CubicIn,           EaseCurve_CubicIn },
+        { "CubicOut",           NeoEase::CubicOut,          EaseCurve_CubicOut },
+        { "QuarticInOut",       NeoEase::QuarticInOut,      EaseCurve_QuarticInOut },
+        { "QuinticIn",          NeoEase::QuinticIn,         EaseCurve_QuinticIn },
+        { "QuinticOut",         NeoEase::QuinticOut,        EaseCurve_QuinticOut },
+        { "ExponentialInOut",   NeoEase::ExponentialInOut,  EaseCurve_ExponentialInOut },
+    };
+
+    std::vector<float> units;
+    for (int i = 0; i <= 4096; i++) {
+        units.push_back(i / 4096.0f);
+    }
+
+    printf("\n%-18s %12s %12s %10s %10s\n", "easing", "NeoEase ns", "table ns", "speedup", "max error");
+
+    bool ok = true;
+    for (const auto &c : s_curves) {
+        // through a pointer, as the effects called them
+        AnimEaseFunction function = c.function;
+        EaseCurve curve = c.curve;
+
+        double function_ns = conversion_ns(units, [function](float unit) {
+            return (uint32_t)(function(unit) * 65535.0f);
+        });
+        double table_ns = conversion_ns(units, [curve](float unit) {
+            return (uint32_t)(EaseTable::Ease(curve, unit) * 65535.0f);
+        });
+
+        // the table holds the curve clamped to 0.0 - 1.0
+        double max_error = 0.0;
+        for (float unit : units) {
+            float expected = std::min(1.0f, std::max(0.0f, c.function(unit)));
+            max_error = std::max(max_error, (double)fabsf(EaseTable::Ease(curve, unit) - expected));
+        }
+        printf("%-18s %12.1f %12.1f %10.2f %10.5f\n", c.name,
+            function_ns, table_ns, function_ns / table_ns, max_error);
+
+        // half a step of an 8-bit channel
+        if (max_error > 0.002) {
+            fprintf(stderr, "EaseTable %s differs from NeoEase by %f\n", c.name, max_error);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    int frames = argc > 1 ? atoi(argv[1]) : 300;
+    if (frames <= 0) {
+        fprintf(stderr, "usage: %s [frames]\n", argv[0]);
+        return 1;
+    }
+
+    host_clock_set_manual(true);
+
+    if (!bench_render(frames)) {
+        return 1;
+    }
+
+    if (!bench_crossfade()) {
+        return 1;
+    }
+
+    if (!bench_layers(frames)) {
+        return 1;
+    }
+
+    if (!bench_zones(frames)) {
+        return 1;
+    }
+
+    // every frame spends real wire time here (200ms at 5,000 pixels), so use fewer of them
+    if (!bench_overlap(frames / 50 > 5 ? frames / 50 : 5)) {
+        return 1;
+    }
+
+    if (!bench_outputs(frames / 50 > 5 ? frames / 50 : 5)) {
+        return 1;
+    }
+
+    if (!bench_hsb()) {
+        return 1;
+    }
+
+    if (!bench_easing()) {
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,449 @@
+/*-------------------------------------------------------------------------
+Golden-frame regression test for main/animation.cpp on the host.
+
+Every effect is started on each layout below and run for a fixed number of
+frames, with the host clock advanced by exactly one frame interval per
+frame and the effects' random numbers from a fixed seed, so every run
+renders the same frames. Each frame is taken as it goes on the wire (the
+back buffer through the output stage) and compared against the frames
+checked in under golden/, one file per layout.
+
+A frame whose hash matches passes. Otherwise it is compared pixel by
+pixel, and passes if no channel is further than the tolerance from the
+golden frame. The first frame and pixel outside the tolerance is reported,
+as is the first frame that differs at all.
+
+Besides the effects on their own, two runs go through the compositor:
+three layers, one in each blend mode, over an effect, and a crossfade
+from one effect to another.
+
+Render path changes that are meant to change the output (a new effect, a
+different gamma) regenerate the goldens with --update.
+
+usage: anim_golden [--update] [--tolerance n] [golden dir]
+-------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "host_clock.h"
+
+#include "anim_host.h"
+
+#ifndef GOLDEN_DIR
+#define GOLDEN_DIR "golden"
+#endif
+
+#define GOLDEN_FRAMES           120
+#define GOLDEN_FRAME_US         80000       // long enough a run for Cylon to cross the strip
+#define GOLDEN_TOLERANCE        2           // per channel. the fixed point kernels are within 1 each
+
+static const uint8_t s_golden_magic[8] = { 'A', 'N', 'I', 'M', 'G', 'L', 'D', '1' };
+
+// small layouts keep the goldens small. between them they cover one ring, a few
+// equal rings, and as many rings as the installed layout, of uneven sizes
+static const host_layout_t s_golden_layouts[] = {
+    { "1 x 40",     1, { 40 } },
+    { "3 x 16",     3, { 16, 16, 16 } },
+    { "7 uneven",   7, { 6, 6, 7, 8, 5, 6, 7 } },
+};
+
+// the effects stacked through the compositor: three layers in each blend mode over an
+// effect, and a crossfade from one effect to another
+static const led_layer_t s_golden_layers[] = {
+    { 2, 255, 1 },      // Glitter, add
+    { 1, 192, 2 },      // Cylon, screen
+    { 7, 128, 3 },      // Snake, max
+};
+
+static const host_effect_t s_golden_stacks[] = {
+    { "Layers",         4, [] { RainbowFadeAnimationSet(); show_layers(256); } },
+    { "Crossfade",      4, [] {
+        CylonAnimationSet();
+        for (int f = 0; f < 10; f++) {
+            host_clock_advance_us(GOLDEN_FRAME_US);
+            render_frame();
+        }
+        begin_effect(4, true);
+        RainbowFadeAnimationSet();
+    } },
+};
+
+typedef std::vector<RgbwColor> frame_t;
+
+// one effect on one layout: every frame as sent
+typedef struct {
+    std::string effect;
+    std::vector<frame_t> frames;
+} golden_run_t;
+
+static uint32_t frame_hash(const frame_t &frame)
+{
+    // FNV-1a over R, G, B, W
+    uint32_t hash = 2166136261u;
+    for (const RgbwColor &color : frame) {
+        const uint8_t bytes[4] = { color.R, color.G, color.B, color.W };
+        for (uint8_t byte : bytes) {
+            hash = (hash ^ byte) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+static bool render_run(const host_layout_t &layout, const host_effect_t &effect, golden_run_t &run)
+{
+    if (!host_start_effect(&layout, &effect)) {
+        return false;
+    }
+
+    run.effect = effect.name;
+    run.frames.clear();
+
+    for (int f = 0; f < GOLDEN_FRAMES; f++) {
+        host_clock_advance_us(GOLDEN_FRAME_US);
+        render_frame();
+        strip->Show();
+
+        frame_t frame(strip->PixelCount());
+        for (uint16_t i = 0; i < strip->PixelCount(); i++) {
+            frame[i] = strip->OutputStage().Apply(strip->GetPixelColor(i));
+        }
+        run.frames.push_back(frame);
+    }
+    strip->WaitShown();
+    return true;
+}
+
+
+// ***************************** golden files *******************************
+// "ANIMGLD1", then per effect: name length (u8), name, frame count (u16), pixel
+// count (u16), and per frame: hash (u32), run count (u16), runs of count (u8) and
+// R, G, B, W. little endian
+
+static std::string golden_path(const char *dir, const host_layout_t &layout)
+{
+    std::string name = layout.name;
+    for (char &c : name) {
+        if (c == ' ') {
+            c = '_';
+        }
+    }
+    return std::string(dir) + "/" + name + ".bin";
+}
+
+static void put_u16(std::vector<uint8_t> &out, uint16_t value)
+{
+    out.push_back(value & 0xff);
+    out.push_back(value >> 8);
+}
+
+static void put_u32(std::vector<uint8_t> &out, uint32_t value)
+{
+    put_u16(out, value & 0xffff);
+    put_u16(out, value >> 16);
+}
+
+static bool write_golden(const std::string &path, const std::vector<golden_run_t> &runs)
+{
+    std::vector<uint8_t> out(s_golden_magic, s_golden_magic + sizeof(s_golden_magic));
+
+    for (const golden_run_t &run : runs) {
+        out.push_back(run.effect.size());
+        out.insert(out.end(), run.effect.begin(), run.effect.end());
+        put_u16(out, run.frames.size());
+        put_u16(out, run.frames.empty() ? 0 : run.frames[0].size());
+
+        for (const frame_t &frame : run.frames) {
+            put_u32(out, frame_hash(frame));
+
+            size_t count_at = out.size();
+            uint16_t runs_count = 0;
+            put_u16(out, 0);
+
+            for (size_t i = 0; i < frame.size(); ) {
+                size_t length = 1;
+                while (i + length < frame.size() && length < 255 && frame[i + length] == frame[i]) {
+                    length++;
+                }
+                const RgbwColor &color = frame[i];
+                out.insert(out.end(), { (uint8_t)length, color.R, color.G, color.B, color.W });
+                runs_count++;
+                i += length;
+            }
+            out[count_at] = runs_count & 0xff;
+            out[count_at + 1] = runs_count >> 8;
+        }
+    }
+
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == NULL) {
+        fprintf(stderr, "unable to write %s\n", path.c_str());
+        return false;
+    }
+    size_t written = fwrite(out.data(), 1, out.size(), file);
+    fclose(file);
+    return written == out.size();
+}
+
+class golden_reader_t
+{
+public:
+    bool open(const std::string &path) {
+        FILE *file = fopen(path.c_str(), "rb");
+        if (file == NULL) {
+            return false;
+        }
+        uint8_t buffer[4096];
+        size_t size;
+        while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            _data.insert(_data.end(), buffer, buffer + size);
+        }
+        fclose(file);
+
+        if (_data.size() < sizeof(s_golden_magic) || memcmp(_data.data(), s_golden_magic, sizeof(s_golden_magic)) != 0) {
+            return false;
+        }
+        _at = sizeof(s_golden_magic);
+        return true;
+    }
+
+    bool done() const {
+        return _at >= _data.size();
+    }
+
+    // reads the next effect. false if the file is cut short
+    bool read(golden_run_t &run, std::vector<uint32_t> &hashes) {
+        uint8_t length;
+        if (!get(&length, 1) || _at + length > _data.size()) {
+            return false;
+        }
+        run.effect.assign((const char *)&_data[_at], length);
+        _at += length;
+
+        uint16_t frames, pixels;
+        if (!get_u16(frames) || !get_u16(pixels)) {
+            return false;
+        }
+
+        run.frames.assign(frames, frame_t());
+        hashes.assign(frames, 0);
+        for (uint16_t f = 0; f < frames; f++) {
+            uint16_t runs;
+            if (!get_u32(hashes[f]) || !get_u16(runs)) {
+                return false;
+            }
+            frame_t &frame = run.frames[f];
+            for (uint16_t r = 0; r < runs; r++) {
+                uint8_t bytes[5];
+                if (!get(bytes, sizeof(bytes))) {
+                    return false;
+                }
+                frame.insert(frame.end(), bytes[0], RgbwColor(bytes[1], bytes[2], bytes[3], bytes[4]));
+            }
+            if (frame.size() != pixels) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    bool get(uint8_t *out, size_t size) {
+        if (_at + size > _data.size()) {
+            return false;
+        }
+        memcpy(out, &_data[_at], size);
+        _at += size;
+        return true;
+    }
+
+    bool get_u16(uint16_t &value) {
+        uint8_t bytes[2];
+        if (!get(bytes, 2)) {
+            return false;
+        }
+        value = bytes[0] | (bytes[1] << 8);
+        return true;
+    }
+
+    bool get_u32(uint32_t &value) {
+        uint16_t low, high;
+        if (!get_u16(low) || !get_u16(high)) {
+            return false;
+        }
+        value = low | ((uint32_t)high << 16);
+        return true;
+    }
+
+    std::vector<uint8_t> _data;
+    size_t _at = 0;
+};
+
+
+// ******************************* comparing ********************************
+
+static int channel_diff(const RgbwColor &a, const RgbwColor &b)
+{
+    int diff = abs(a.R - b.R);
+    diff = std::max(diff, abs(a.G - b.G));
+    diff = std::max(diff, abs(a.B - b.B));
+    diff = std::max(diff, abs(a.W - b.W));
+    return diff;
+}
+
+static void print_pixel(const char *label, const RgbwColor &color)
+{
+    printf("%s %3u %3u %3u %3u", label, color.R, color.G, color.B, color.W);
+}
+
+// ring and position of a pixel, for the report
+static void print_position(const host_layout_t &layout, size_t pixel)
+{
+    size_t first = 0;
+    for (uint8_t ring = 0; ring < layout.num_rings; ring++) {
+        if (pixel < first + layout.pixel_layout[ring]) {
+            printf("pixel %zu (ring %u, #%zu)", pixel, ring, pixel - first);
+            return;
+        }
+        first += layout.pixel_layout[ring];
+    }
+    printf("pixel %zu", pixel);
+}
+
+static bool compare_run(const host_layout_t &layout, const golden_run_t &golden,
+    const std::vector<uint32_t> &hashes, const golden_run_t &run, int tolerance)
+{
+    printf("%-12s %-14s ", layout.name, run.effect.c_str());
+
+    if (golden.frames.size() != run.frames.size() || golden.frames[0].size() != run.frames[0].size()) {
+        printf("FAIL golden has %zu frames of %zu pixels, rendered %zu of %zu\n",
+            golden.frames.size(), golden.frames[0].size(), run.frames.size(), run.frames[0].size());
+        return false;
+    }
+
+    int first_diff_frame = -1;
+    int within = 0;
+    int max_diff = 0;
+
+    for (size_t f = 0; f < run.frames.size(); f++) {
+        if (frame_hash(run.frames[f]) == hashes[f]) {
+            continue;
+        }
+        if (first_diff_frame < 0) {
+            first_diff_frame = f;
+        }
+
+        const frame_t &expected = golden.frames[f];
+        const frame_t &actual = run.frames[f];
+        for (size_t p = 0; p < actual.size(); p++) {
+            int diff = channel_diff(expected[p], actual[p]);
+            if (diff > tolerance) {
+                printf("FAIL frame %zu (%.2fs) ", f, (f + 1) * GOLDEN_FRAME_US / 1000000.0);
+                print_position(layout, p);
+                print_pixel(": expected", expected[p]);
+                print_pixel(", got", actual[p]);
+                printf("\n");
+                return false;
+            }
+            max_diff = std::max(max_diff, diff);
+        }
+        within++;
+    }
+
+    if (first_diff_frame < 0) {
+        printf("ok\n");
+    }
+    else {
+        printf("ok, %d frames within tolerance from frame %d, max diff %d\n", within, first_diff_frame, max_diff);
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    bool update = false;
+    int tolerance = GOLDEN_TOLERANCE;
+    const char *dir = GOLDEN_DIR;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--update") == 0) {
+            update = true;
+        }
+        else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            tolerance = atoi(argv[++i]);
+        }
+        else if (argv[i][0] != '-') {
+            dir = argv[i];
+        }
+        else {
+            fprintf(stderr, "usage: %s [--update] [--tolerance n] [golden dir]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    host_clock_set_manual(true);
+
+    bool ok = true;
+    for (const host_layout_t &layout : s_golden_layouts) {
+        host_configure_layout(&layout);
+        std::string path = golden_path(dir, layout);
+
+        std::vector<golden_run_t> runs;
+        for (const host_effect_t &effect : s_host_effects) {
+            golden_run_t run;
+            if (!render_run(layout, effect, run)) {
+                return 1;
+            }
+            runs.push_back(run);
+        }
+
+        // the layers only exist for the first stack
+        for (const host_effect_t &stack : s_golden_stacks) {
+            host_configure_layers(s_golden_layers, &stack == s_golden_stacks ? 3 : 0);
+            golden_run_t run;
+            if (!render_run(layout, stack, run)) {
+                return 1;
+            }
+            runs.push_back(run);
+        }
+        host_configure_layers(NULL, 0);
+
+        if (update) {
+            if (!write_golden(path, runs)) {
+                return 1;
+            }
+            printf("wrote %s\n", path.c_str());
+            continue;
+        }
+
+        golden_reader_t reader;
+        if (!reader.open(path)) {
+            fprintf(stderr, "unable to read %s. run with --update to create it\n", path.c_str());
+            return 1;
+        }
+
+        for (const golden_run_t &run : runs) {
+            golden_run_t golden;
+            std::vector<uint32_t> hashes;
+            if (reader.done() || !reader.read(golden, hashes)) {
+                printf("%-12s %-14s FAIL no golden frames\n", layout.name, run.effect.c_str());
+                ok = false;
+                continue;
+            }
+            if (golden.effect != run.effect) {
+                printf("%-12s %-14s FAIL golden frames are for %s\n", layout.name, run.effect.c_str(), golden.effect.c_str());
+                ok = false;
+                continue;
+            }
+            ok &= compare_run(layout, golden, hashes, run, tolerance);
+        }
+    }
+
+    if (!update) {
+        printf("%s (tolerance %d)\n", ok ? "all effects match the golden frames" : "golden frame mismatch", tolerance);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+/*-------------------------------------------------------------------------
+Access to the animation engine internals for the host harnesses.
+-------------------------------------------------------------------------*/
+
+#include <stdio.h>
+
+#include "freertos/FreeRTOS.h"
+#include "nvs.h"
+
+#include <NeoPixelBus.h>
+#include <NeoPixelAnimator.h>
+#include "NeoBufferedStrip.h"
+#include "PixelCanvas.h"
+#include "TransitionMap.h"
+#include "EffectRandom.h"
+
+#include "animation.h"
+
+typedef NeoBufferedStrip<NeoPixelBus<NeoGrbwFeature, NeoEsp32RmtNSk6812Method>> host_strip_t;
+
+extern host_strip_t* strip;
+extern NeoPixelAnimator* animations;
+extern PixelCanvas* canvas;
+extern EffectRandom effect_random;
+
+// seeds effect_random with ANIMATION_RANDOM_SEED, as apply_command() does before
+// starting an effect
+void seed_effect_random();
+
+// runs the effects for one frame and composes them into the strip, as animation_task
+// does before Show()
+void render_frame();
+
+// runs the layers configured in NVS over the effect at 'level' (out of 256) of their
+// opacity, as apply_command() does. 0 stops them
+void show_layers(uint16_t level);
+
+// points the effect calls below at a zone, as apply_command() runs for the zone of a
+// command. start_animation_task() leaves zone 0 bound, render_frame() the last zone
+void bind_zone(uint8_t zone);
+
+// what apply_command() does before starting 'animation_id'. with 'crossfade' the running
+// effect fades out while the next one starts
+void begin_effect(uint32_t animation_id, bool crossfade);
+
+void FadeAnimationSet(HsbColor targetColor, TransitionStyle style);
+void CylonAnimationSet();
+void GlitterAnimationSet();
+void StepCylonAnimationSet();
+void RainbowFadeAnimationSet();
+void FireworksAnimationSetHsb();
+void FlickerAnimationSet(float hue, float saturation);
+void SnakeAnimationSet();
+void ColorCycleAnimationSet(float hue, float saturation);
+void RippleAnimationSet();
+
+typedef struct {
+    const char *name;
+    uint8_t num_rings;
+    uint16_t pixel_layout[32];
+} host_layout_t;
+
+typedef struct {
+    const char *name;
+    uint8_t animation_id;       // in the effect registry, 0 for the fade
+    void (*start)();
+} host_effect_t;
+
+static const host_layout_t s_host_layouts[] = {
+    { "7 rings (installed)",  7, { 60, 59, 61, 78, 44, 55, 63 } },
+    { "10 x 100",            10, { 100, 100, 100, 100, 100, 100, 100, 100, 100, 100 } },
+    { "10 x 250",            10, { 250, 250, 250, 250, 250, 250, 250, 250, 250, 250 } },
+    { "20 x 250",            20, { 250, 250, 250, 250, 250, 250, 250, 250, 250, 250,
+                                   250, 250, 250, 250, 250, 250, 250, 250, 250, 250 } },
+};
+
+static const host_effect_t s_host_effects[] = {
+    { "Fade",           0, [] { FadeAnimationSet(HsbColor(0.6f, 1.0f, 1.0f), TransitionStyle_Up); } },
+    { "Cylon",          1, [] { CylonAnimationSet(); } },
+    { "Glitter",        2, [] { GlitterAnimationSet(); } },
+    { "StepCylon",      3, [] { StepCylonAnimationSet(); } },
+    { "RainbowFade",    4, [] { RainbowFadeAnimationSet(); } },
+    { "FireworksHsb",   5, [] { FireworksAnimationSetHsb(); } },
+    { "Flicker",        6, [] { FlickerAnimationSet(0.6f, 1.0f); } },
+    { "Snake",          7, [] { SnakeAnimationSet(); } },
+    { "ColorCycle",     8, [] { ColorCycleAnimationSet(0.6f, 1.0f); } },
+    { "Ripple",         9, [] { RippleAnimationSet(); } },
+    { "FadeAround",     0, [] { FadeAnimationSet(HsbColor(0.6f, 1.0f, 1.0f), TransitionStyle_Around); } },
+    { "FadeDissolve",   0, [] { FadeAnimationSet(HsbColor(0.6f, 1.0f, 1.0f), TransitionStyle_Dissolve); } },
+};
+
+// stores the layout in the "lights" namespace, as /setconfig.json does
+static inline void host_configure_layout(const host_layout_t *layout)
+{
+    nvs_handle config_handle;
+    nvs_open("lights", NVS_READWRITE, &config_handle);
+    nvs_set_u8(config_handle, "data_gpio", 12);
+    nvs_set_u8(config_handle, "num_rings", layout->num_rings);
+    nvs_set_blob(config_handle, "pixel_layout", layout->pixel_layout, layout->num_rings * sizeof(uint16_t));
+    nvs_erase_key(config_handle, "outputs");
+    nvs_erase_key(config_handle, "layers");
+    nvs_erase_key(config_handle, "zones");
+    nvs_commit(config_handle);
+    nvs_close(config_handle);
+}
+
+// fresh strip and animator per run. NeoPixelAnimator keeps the callbacks of stopped
+// animations, which would otherwise be copied into the next effect's frames
+static inline bool host_start_effect(const host_layout_t *layout, const host_effect_t *effect)
+{
+    if (init_animation() != ESP_OK || start_animation_task() != ESP_OK) {
+        fprintf(stderr, "unable to start animation for layout %s\n", layout->name);
+        return false;
+    }
+    strip->Begin();
+    strip->Show();
+    strip->WaitShown();
+
+    seed_effect_random();
+    set_brightness(0, 100);
+
+    effect->start();
+    return true;
+}
+
+// splits the rings of the layout evenly over 'count' outputs on consecutive gpios
+static inline void host_configure_outputs(const host_layout_t *layout, uint8_t count)
+{
+    led_output_t outputs[MAX_OUTPUTS];
+    for (uint8_t i = 0; i < count; i++) {
+        outputs[i].gpio = 12 + i;
+        outputs[i].rings = (layout->num_rings * (i + 1)) / count - (layout->num_rings * i) / count;
+    }
+
+    nvs_handle config_handle;
+    nvs_open("lights", NVS_READWRITE, &config_handle);
+    nvs_set_blob(config_handle, "outputs", outputs, count * sizeof(led_output_t));
+    nvs_commit(config_handle);
+    nvs_close(config_handle);
+}
+
+// stores the layers drawn over the effect, as /setconfig.json does. none erases them
+static inline void host_configure_layers(const led_layer_t *layers, uint8_t count)
+{
+    nvs_handle config_handle;
+    nvs_open("lights", NVS_READWRITE, &config_handle);
+    if (count == 0) {
+        nvs_erase_key(config_handle, "layers");
+    }
+    else {
+        nvs_set_blob(config_handle, "layers", layers, count * sizeof(led_layer_t));
+    }
+    nvs_commit(config_handle);
+    nvs_close(config_handle);
+}
+
+// splits the rings of the layout evenly into 'count' zones, as /setconfig.json does. 0 erases them
+static inline void host_configure_zones(const host_layout_t *layout, uint8_t count)
+{
+    led_zone_t zones[MAX_ZONES];
+    for (uint8_t i = 0; i < count; i++) {
+        zones[i].first_ring = (layout->num_rings * i) / count;
+        zones[i].rings = (layout->num_rings * (i + 1)) / count - zones[i].first_ring;
+    }
+
+    nvs_handle config_handle;
+    nvs_open("lights", NVS_READWRITE, &config_handle);
+    if (count == 0) {
+        nvs_erase_key(config_handle, "zones");
+    }
+    else {
+        nvs_set_blob(config_handle, "zones", zones, count * sizeof(led_zone_t));
+    }
+    nvs_commit(config_handle);
+    nvs_close(config_handle);
+}
@@ -0,0 +1,380 @@
+/*-------------------------------------------------------------------------
+End-to-end latency benchmark, from a HomeKit characteristic write to the
+frame that shows it.
+
+main/homekit_lights.c and main/animation.cpp are built with
+ANIMATION_LATENCY_TRACE and run as on the target: animation_task and the
+HomeKit commit task on threads of their own, the frame timer and the host clock in real time, and the
+stand-in RMT transmitter sending at SK6812 speed. Writes come from this
+thread through a fake HomeKit accessory with the services, characteristics
+and callback roles init_accessory() creates, so they go through the real
+state_change_on_callback(). Each write is timed for as long as it keeps
+the HAP task.
+
+Each posted command is timed through the stages in main/latency_trace.h:
+the callback, the set_strip() post, animation_task taking it from the
+mailbox, the first render_frame() after it was applied and the return
+of that frame's Show(). For every scenario the table shows p50, p99 and
+max of each step and of the whole path, and how many commands were
+replaced by newer ones (in the mailbox, or before a frame rendered them).
+
+Writes within the HomeKit write window (--window, default
+DEFAULT_WRITE_WINDOW_MS) are committed as one command, so the callback >
+post step includes the window; with --window 0 each write is committed on
+its own.
+
+"effect colour" changes the colour of a running ColorCycle, which takes
+it from the live effect parameters without restarting. The last two
+scenarios write 50 times a second: a drag of the brightness slider, and
+a run through the animations.
+
+usage: anim_latency [--window ms] [repeat]
+-------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include <homekit/homekit.h>
+#include <homekit/characteristics.h>
+
+#include "anim_host.h"
+#include "homekit_lights.h"
+#include "latency_trace.h"
+
+#define CUSTOM_ID_TYPE      "02B77067-DA5D-493C-829D-F6C5DCFE5C28"
+
+// the services in the order init_accessory() creates them: ACCESSORY_INFORMATION,
+// TELEVISION, LIGHTBULB and an INPUT_SOURCE per effect in the registry. the characteristics
+// state_change_on_callback() does not use are stood in for by a NAME
+static homekit_characteristic_t s_on, s_brightness, s_hue, s_saturation, s_custom_id;
+static homekit_characteristic_t s_active, s_active_id;
+static homekit_characteristic_t s_info_name, s_tv_name, s_light_name;
+static homekit_characteristic_t s_input_name[MAX_ANIMATIONS], s_input_id[MAX_ANIMATIONS];
+
+static homekit_characteristic_t *s_info_characteristics[] = { &s_info_name, NULL };
+static homekit_characteristic_t *s_tv_characteristics[] = { &s_active, &s_active_id, &s_tv_name, NULL };
+static homekit_characteristic_t *s_light_characteristics[] = { &s_light_name, &s_on, &s_brightness, &s_hue, &s_saturation, &s_custom_id, NULL };
+static homekit_characteristic_t *s_input_characteristics[MAX_ANIMATIONS][3];
+
+static homekit_service_t s_info_service = { NULL, HOMEKIT_SERVICE_ACCESSORY_INFORMATION, s_info_characteristics };
+static homekit_service_t s_tv_service = { NULL, HOMEKIT_SERVICE_TELEVISION, s_tv_characteristics };
+static homekit_service_t s_light_service = { NULL, HOMEKIT_SERVICE_LIGHTBULB, s_light_characteristics };
+static homekit_service_t s_input_services[MAX_ANIMATIONS];
+
+static homekit_service_t *s_services[3 + MAX_ANIMATIONS + 1];
+static homekit_accessory_t s_accessory = { s_services };
+
+// how long each write in a scenario kept the HAP task, in ns
+static std::vector<int64_t> s_write_ns;
+
+typedef struct {
+    const char *name;
+    int writes;
+    int64_t interval_us;
+    int settle_ms;              // for the last write to be shown
+    void (*setup)();            // the state the writes start from
+    void (*write)(int i);
+} scenario_t;
+
+static homekit_value_t value_bool(bool value)
+{
+    homekit_value_t v = {};
+    v.format = homekit_format_bool;
+    v.bool_value = value;
+    return v;
+}
+
+static homekit_value_t value_int(homekit_format_t format, int value)
+{
+    homekit_value_t v = {};
+    v.format = format;
+    v.int_value = value;
+    return v;
+}
+
+static homekit_value_t value_string(const char *value)
+{
+    homekit_value_t v = {};
+    v.format = homekit_format_string;
+    v.string_value = (char *)value;
+    return v;
+}
+
+static homekit_value_t value_float(float value)
+{
+    homekit_value_t v = {};
+    v.format = homekit_format_float;
+    v.float_value = value;
+    return v;
+}
+
+// 'role' as init_accessory() passes it to state_change_on_callback(). LIGHTS_ROLE_NONE
+// for the characteristics without it
+static void init_characteristic(homekit_characteristic_t *ch, homekit_service_t *service, const char *type,
+    const char *description, homekit_value_t value, lights_role_t role)
+{
+    if (role == LIGHTS_ROLE_NONE) {
+        *ch = { service, type, description, value, NULL, NULL };
+    } else {
+        *ch = { service, type, description, value, state_change_on_callback, LIGHTS_ROLE_CONTEXT(0, role) };
+    }
+}
+
+static void init_fake_accessory()
+{
+    homekit_service_t **s = s_services;
+    *(s++) = &s_info_service;
+    *(s++) = &s_tv_service;
+    *(s++) = &s_light_service;
+    for (int i = 0; i < get_effect_count(); i++) {
+        init_characteristic(&s_input_name[i], &s_input_services[i], HOMEKIT_CHARACTERISTIC_CONFIGURED_NAME, "Configured Name", value_string(""), LIGHTS_ROLE_NONE);
+        init_characteristic(&s_input_id[i], &s_input_services[i], HOMEKIT_CHARACTERISTIC_IDENTIFIER, "Identifier", value_int(homekit_format_uint8, get_effect(i)->id), LIGHTS_ROLE_NONE);
+        s_input_characteristics[i][0] = &s_input_name[i];
+        s_input_characteristics[i][1] = &s_input_id[i];
+        s_input_characteristics[i][2] = NULL;
+        s_input_services[i] = { &s_accessory, HOMEKIT_SERVICE_INPUT_SOURCE, s_input_characteristics[i] };
+        *(s++) = &s_input_services[i];
+    }
+    *s = NULL;
+
+    s_info_service.accessory = &s_accessory;
+    s_tv_service.accessory = &s_accessory;
+    s_light_service.accessory = &s_accessory;
+
+    init_characteristic(&s_info_name, &s_info_service, HOMEKIT_CHARACTERISTIC_NAME, "Name", value_string(""), LIGHTS_ROLE_NONE);
+    init_characteristic(&s_tv_name, &s_tv_service, HOMEKIT_CHARACTERISTIC_CONFIGURED_NAME, "Configured Name", value_string(""), LIGHTS_ROLE_NONE);
+    init_characteristic(&s_light_name, &s_light_service, HOMEKIT_CHARACTERISTIC_NAME, "Name", value_string(""), LIGHTS_ROLE_NONE);
+
+    init_characteristic(&s_on, &s_light_service, HOMEKIT_CHARACTERISTIC_ON, "On", value_bool(false), LIGHTS_ROLE_ON);
+    init_characteristic(&s_brightness, &s_light_service, HOMEKIT_CHARACTERISTIC_BRIGHTNESS, "Brightness", value_int(homekit_format_int, 100), LIGHTS_ROLE_BRIGHTNESS);
+    init_characteristic(&s_hue, &s_light_service, HOMEKIT_CHARACTERISTIC_HUE, "Hue", value_float(0.0f), LIGHTS_ROLE_HUE);
+    init_characteristic(&s_saturation, &s_light_service, HOMEKIT_CHARACTERISTIC_SATURATION, "Saturation", value_float(0.0f), LIGHTS_ROLE_SATURATION);
+    init_characteristic(&s_custom_id, &s_light_service, CUSTOM_ID_TYPE, "Remote Switch ID", value_int(homekit_format_uint8, 0), LIGHTS_ROLE_CUSTOM_ID);
+    init_characteristic(&s_active, &s_tv_service, HOMEKIT_CHARACTERISTIC_ACTIVE, "Active", value_int(homekit_format_uint8, 0), LIGHTS_ROLE_ACTIVE);
+    init_characteristic(&s_active_id, &s_tv_service, HOMEKIT_CHARACTERISTIC_ACTIVE_IDENTIFIER, "Active Identifier", value_int(homekit_format_uint8, 1), LIGHTS_ROLE_ACTIVE_ID);
+
+    if (homekit_lights_init(&s_accessory) != ESP_OK) {
+        fprintf(stderr, "the fake accessory is missing a characteristic\n");
+        exit(1);
+    }
+}
+
+// a controller write, timed for as long as it keeps the HAP task
+static void hap_write(homekit_characteristic_t *ch, homekit_value_t value)
+{
+    auto start = std::chrono::steady_clock::now();
+    host_homekit_write(ch, value);
+    s_write_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+static void sleep_ms(int ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+
+// ******************************* scenarios ********************************
+
+static void light_on()
+{
+    hap_write(&s_active, value_int(homekit_format_uint8, 0));
+    hap_write(&s_on, value_bool(true));
+    hap_write(&s_brightness, value_int(homekit_format_int, 100));
+}
+
+static void animation_on()
+{
+    light_on();
+    hap_write(&s_active, value_int(homekit_format_uint8, 1));
+}
+
+// ColorCycle takes colours while it runs
+static void color_cycle_on()
+{
+    animation_on();
+    hap_write(&s_active_id, value_int(homekit_format_uint8, 8));
+}
+
+// the Home app sends saturation, then hue
+static void write_colour(int i)
+{
+    hap_write(&s_saturation, value_float(100.0f));
+    hap_write(&s_hue, value_float((i * 37) % 360));
+}
+
+static void write_brightness(int i)
+{
+    hap_write(&s_brightness, value_int(homekit_format_int, 20 + (i * 13) % 80));
+}
+
+static void write_animation(int i)
+{
+    hap_write(&s_active_id, value_int(homekit_format_uint8, get_effect(i % get_effect_count())->id));
+}
+
+// the Home app sends ON, then BRIGHTNESS. turning off pulls the brightness to 0%
+static void write_on_off(int i)
+{
+    bool on = (i % 2) == 0;
+    hap_write(&s_on, value_bool(on));
+    hap_write(&s_brightness, value_int(homekit_format_int, on ? 60 : 0));
+}
+
+// a drag from 100% down to 1% and back, one write per step
+static void write_slider(int i)
+{
+    int position = i % 200;
+    int brightness = (position < 100) ? 100 - position : position - 99;
+    hap_write(&s_brightness, value_int(homekit_format_int, brightness));
+}
+
+static const scenario_t s_scenarios[] = {
+    { "colour",         30,  300000, 1500, light_on,      write_colour },
+    { "on/off",         20,  500000, 1500, light_on,      write_on_off },
+    { "brightness",     30,  300000, 1500, light_on,      write_brightness },
+    { "animation",      10, 1000000, 1500, animation_on,  write_animation },
+    { "effect colour",  30,  300000, 1500, color_cycle_on, write_colour },
+    { "slider drag",   200,   20000, 1500, light_on,      write_slider },
+    // scrolling through the inputs
+    { "animation burst", 30,  20000, 6000, animation_on,  write_animation },
+};
+
+
+// ******************************** results *********************************
+
+static int64_t percentile(std::vector<int64_t> &values, double fraction)
+{
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)ceil(fraction * values.size());
+    return values[std::min(values.size() - 1, index > 0 ? index - 1 : 0)];
+}
+
+static void run_scenario(const scenario_t &scenario)
+{
+    scenario.setup();
+    sleep_ms(1500);
+
+    latency_counts_t before, after;
+    latency_trace_counts(&before);
+
+    // writes at whole multiples of the frame interval would all land at the same point
+    // of a frame. spread them over one, as writes over the network are
+    EffectRandom jitter(1);
+    int64_t jitter_us = std::min<int64_t>(scenario.interval_us, 1000000 / DEFAULT_FRAME_RATE);
+
+    s_write_ns.clear();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < scenario.writes; i++) {
+        int64_t at_us = i * scenario.interval_us + jitter.Below(jitter_us);
+        std::this_thread::sleep_until(start + std::chrono::microseconds(at_us));
+        scenario.write(i);
+    }
+    sleep_ms(scenario.settle_ms);
+    latency_trace_counts(&after);
+
+    static const char *s_steps[] = { "callback > post", "post > take", "take > render", "render > shown" };
+    std::vector<int64_t> steps[LATENCY_STAGES];     // the last one is the whole path
+    uint32_t superseded = 0;
+    uint32_t lost = 0;
+
+    for (uint32_t seq = before.posted + 1; seq <= after.posted; seq++) {
+        latency_record_t record;
+        if (!latency_trace_get(seq, &record)) {
+            lost++;
+            continue;
+        }
+        if (record.superseded) {
+            superseded++;
+            continue;
+        }
+        if (record.us[LATENCY_CALLBACK] == 0 || record.us[LATENCY_SHOWN] == 0) {
+            lost++;
+            continue;
+        }
+        for (int s = 0; s < LATENCY_STAGES - 1; s++) {
+            steps[s].push_back(record.us[s + 1] - record.us[s]);
+        }
+        steps[LATENCY_STAGES - 1].push_back(record.us[LATENCY_SHOWN] - record.us[LATENCY_CALLBACK]);
+    }
+
+    printf("\n%s: %d writes in %.1fs, %u callbacks, %u posted, %u replaced before shown (%u in the mailbox), %zu shown",
+        scenario.name, scenario.writes, scenario.writes * scenario.interval_us / 1000000.0,
+        after.callbacks - before.callbacks, after.posted - before.posted, superseded,
+        after.coalesced - before.coalesced, steps[LATENCY_STAGES - 1].size());
+    if (lost != 0) {
+        printf(", %u not traced", lost);
+    }
+    printf("\n");
+
+    std::vector<int64_t> write_ns = s_write_ns;
+    int64_t write_max = write_ns.empty() ? 0 : *std::max_element(write_ns.begin(), write_ns.end());
+    printf("HAP task per write     p50 %lldns, p99 %lldns, max %lldns\n", (long long)percentile(write_ns, 0.5),
+        (long long)percentile(write_ns, 0.99), (long long)write_max);
+
+    printf("%-22s %10s %10s %10s\n", "", "p50 us", "p99 us", "max us");
+    for (int s = 0; s < LATENCY_STAGES; s++) {
+        std::vector<int64_t> &values = steps[s];
+        int64_t max = values.empty() ? 0 : *std::max_element(values.begin(), values.end());
+        printf("%-22s %10lld %10lld %10lld\n", s < LATENCY_STAGES - 1 ? s_steps[s] : "write > shown",
+            (long long)percentile(values, 0.5), (long long)percentile(values, 0.99), (long long)max);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int repeat = 1;
+    int window_ms = DEFAULT_WRITE_WINDOW_MS;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+            window_ms = atoi(argv[++i]);
+        } else {
+            repeat = atoi(argv[i]);
+        }
+    }
+    if (repeat <= 0 || window_ms < 0 || window_ms > MAX_WRITE_WINDOW_MS) {
+        fprintf(stderr, "usage: %s [--window ms] [repeat]\n", argv[0]);
+        return 1;
+    }
+
+    host_configure_layout(&s_host_layouts[0]);
+
+    // homekit_lights_init() reads the write window
+    nvs_handle config_handle;
+    nvs_open("lights", NVS_READWRITE, &config_handle);
+    nvs_set_u16(config_handle, "write_window_ms", window_ms);
+    nvs_commit(config_handle);
+    nvs_close(config_handle);
+    NeoEsp32RmtNSk6812Method::NsPerByte() = 10000;
+
+    if (init_animation() != ESP_OK || start_animation_task() != ESP_OK) {
+        fprintf(stderr, "unable to start animation\n");
+        return 1;
+    }
+    host_task_run("anim");
+    sleep_ms(100);
+
+    init_fake_accessory();
+    host_task_run("lights_commit");
+
+    printf("layout %s, %u pixels, %d fps, frame on the wire %uus, HomeKit write window %dms\n", s_host_layouts[0].name,
+        strip->PixelCount(), DEFAULT_FRAME_RATE, strip->WireTimeUs(), window_ms);
+
+    for (int r = 0; r < repeat; r++) {
+        for (const scenario_t &scenario : s_scenarios) {
+            run_scenario(scenario);
+        }
+    }
+
+    // the tasks never return; leave without running the static destructors under them
+    fflush(stdout);
+    std::quick_exit(0);
+}
@@ -0,0 +1,469 @@
+/*-------------------------------------------------------------------------
+Offline visual simulator for main/animation.cpp.
+
+Runs one effect (or all of them) on a ring layout, at the configured frame
+rate on the manual host clock, and draws every frame as the LEDs would
+show it: each pixel where it sits on its ring, laid out as stacked steps
+(the installed staircase) or as concentric rings. The pixel positions come
+from NeoDynamicRingTopology over the same layout the animation engine
+reads from NVS.
+
+Frames are written as binary PPM, one file per frame, or all of them into
+one stream that ffmpeg plays at the real frame timing:
+
+    ffmpeg -framerate 50 -f image2pipe -c:v ppm -i cylon.ppm cylon.mp4
+
+Each frame carries an overlay with its number and how long it took to
+render (render_frame + Show), and a bar of that time against the
+frame interval. --dry renders without drawing or writing anything, for
+running under perf:
+
+    perf record ./host_test/build/anim_sim --dry --seconds 60 FireworksHsb
+
+usage: anim_sim [options] [effect | all]
+  --layout n,n,..   pixels per ring. default the installed 7 rings
+  --rings           concentric rings. default stacked steps
+  --seconds s       animation time per effect. default 10
+  --fps n           frame rate. default DEFAULT_FRAME_RATE
+  --brightness n    0..100. default 100
+  --scale n         image pixels per LED. default 10
+  --stream          one stream file per effect instead of a file per frame
+  --out dir         where frames go. default the current directory
+  --dry             render only
+-------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "host_clock.h"
+
+#include "anim_host.h"
+#include "NeoStripTopology.h"
+
+// the rings of the simulated layout, in the form MyRingsLayout builds from NVS
+class SimRingsLayout
+{
+public:
+    void Begin(const host_layout_t &layout) {
+        RingCount = layout.num_rings + 1;
+        _rings.assign(RingCount, 0);
+        for (uint16_t i = 1; i < RingCount; i++) {
+            _rings[i] = _rings[i - 1] + layout.pixel_layout[i - 1];
+        }
+        Rings = _rings.data();
+    }
+
+protected:
+    uint16_t* Rings = NULL;
+    uint8_t RingCount = 0;
+
+    uint8_t _ringCount() const
+    {
+        return RingCount;
+    }
+
+private:
+    std::vector<uint16_t> _rings;
+};
+
+typedef struct {
+    float x;
+    float y;
+} sim_point_t;
+
+typedef struct {
+    bool rings;
+    uint16_t scale;
+    uint8_t brightness;
+    std::string out;
+    bool stream;
+    bool dry;
+} sim_options_t;
+
+static uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+// ******************************** image ***********************************
+
+class SimImage
+{
+public:
+    SimImage(uint16_t width, uint16_t height) :
+        _width(width),
+        _height(height),
+        _pixels(width * height * 3, 0)
+    {
+    }
+
+    void Clear() {
+        std::fill(_pixels.begin(), _pixels.end(), 0);
+    }
+
+    void Set(int x, int y, const uint8_t rgb[3]) {
+        if (x < 0 || y < 0 || x >= _width || y >= _height) {
+            return;
+        }
+        memcpy(&_pixels[(y * _width + x) * 3], rgb, 3);
+    }
+
+    void Disc(float cx, float cy, float radius, const uint8_t rgb[3]) {
+        for (int y = (int)(cy - radius); y <= (int)(cy + radius) + 1; y++) {
+            for (int x = (int)(cx - radius); x <= (int)(cx + radius) + 1; x++) {
+                float dx = x + 0.5f - cx;
+                float dy = y + 0.5f - cy;
+                if (dx * dx + dy * dy <= radius * radius) {
+                    Set(x, y, rgb);
+                }
+            }
+        }
+    }
+
+    void Fill(int x, int y, int width, int height, const uint8_t rgb[3]) {
+        for (int j = y; j < y + height; j++) {
+            for (int i = x; i < x + width; i++) {
+                Set(i, j, rgb);
+            }
+        }
+    }
+
+    // 3x5 glyphs for digits, space, 'f', 'u', 's' and '/', drawn 'size' image pixels per dot
+    void Text(int x, int y, const char *text, uint8_t size, const uint8_t rgb[3]) {
+        static const char s_glyphs[] = "0123456789 fus/";
+        static const uint16_t s_dots[] = {
+            0x7b6f, 0x2492, 0x73e7, 0x73cf, 0x5bc9, 0x79cf, 0x79ef, 0x7249, 0x7bef, 0x7bcf,
+            0x0000, 0x39a4, 0x016f, 0x078e, 0x12a4,
+        };
+        for (; *text != '\0'; text++, x += 4 * size) {
+            const char *glyph = strchr(s_glyphs, *text);
+            if (glyph == NULL) {
+                continue;
+            }
+            uint16_t dots = s_dots[glyph - s_glyphs];
+            for (int row = 0; row < 5; row++) {
+                for (int column = 0; column < 3; column++) {
+                    if (dots & (1 << (14 - row * 3 - column))) {
+                        Fill(x + column * size, y + row * size, size, size, rgb);
+                    }
+                }
+            }
+        }
+    }
+
+    bool Write(FILE *file) const {
+        fprintf(file, "P6\n%u %u\n255\n", _width, _height);
+        return fwrite(_pixels.data(), 1, _pixels.size(), file) == _pixels.size();
+    }
+
+private:
+    uint16_t _width;
+    uint16_t _height;
+    std::vector<uint8_t> _pixels;
+};
+
+
+// ******************************* geometry *********************************
+
+#define SIM_OVERLAY_HEIGHT      24
+
+// centre of every pixel in image coordinates, by strip index. also sets the image size
+static std::vector<sim_point_t> layout_pixels(const NeoDynamicRingTopology<SimRingsLayout> &topology,
+    const sim_options_t &options, uint16_t &width, uint16_t &height)
+{
+    std::vector<sim_point_t> points(topology.getPixelCount());
+    const float pitch = options.scale;
+    uint8_t ring_count = topology.getCountOfRings();
+
+    if (options.rings) {
+        // ring 0 in the middle. each ring is at least a pitch outside the last and
+        // large enough that its pixels are a pitch apart
+        std::vector<float> radius(ring_count);
+        float last = 0.0f;
+        for (uint8_t ring = 0; ring < ring_count; ring++) {
+            float fit = topology.getPixelCountAtRing(ring) * pitch / (2.0f * (float)M_PI);
+            radius[ring] = std::max(ring == 0 ? pitch : last + pitch * 1.5f, fit);
+            last = radius[ring];
+        }
+
+        float centre = last + pitch;
+        width = height = (uint16_t)(2.0f * centre);
+        for (uint8_t ring = 0; ring < ring_count; ring++) {
+            uint16_t count = topology.getPixelCountAtRing(ring);
+            for (uint16_t i = 0; i < count; i++) {
+                // clockwise from the top
+                float angle = 2.0f * (float)M_PI * i / count;
+                points[topology.Map(ring, i)] = { centre + radius[ring] * sinf(angle), centre - radius[ring] * cosf(angle) };
+            }
+        }
+    }
+    else {
+        // ring 0 is the bottom step. each step is centred
+        uint16_t widest = 0;
+        for (uint8_t ring = 0; ring < ring_count; ring++) {
+            widest = std::max(widest, topology.getPixelCountAtRing(ring));
+        }
+        width = (uint16_t)((widest + 1) * pitch);
+        height = (uint16_t)((ring_count + 1) * pitch * 2.0f);
+
+        for (uint8_t ring = 0; ring < ring_count; ring++) {
+            uint16_t count = topology.getPixelCountAtRing(ring);
+            float left = (width - count * pitch) / 2.0f + pitch / 2.0f;
+            float y = height - (ring + 1) * pitch * 2.0f;
+            for (uint16_t i = 0; i < count; i++) {
+                points[topology.Map(ring, i)] = { left + i * pitch, y };
+            }
+        }
+    }
+
+    height += SIM_OVERLAY_HEIGHT;
+    width = std::max(width, (uint16_t)160);
+    return points;
+}
+
+// the wire values drive the LEDs linearly; a monitor expects sRGB. the white LED
+// adds to all three colours
+static void led_to_rgb(const RgbwColor &wire, uint8_t rgb[3])
+{
+    static uint8_t s_srgb[256];
+    static bool s_built = false;
+    if (!s_built) {
+        for (uint16_t v = 0; v < 256; v++) {
+            float linear = v / 255.0f;
+            float encoded = (linear <= 0.0031308f) ? linear * 12.92f : 1.055f * powf(linear, 1.0f / 2.4f) - 0.055f;
+            s_srgb[v] = (uint8_t)(encoded * 255.0f + 0.5f);
+        }
+        s_built = true;
+    }
+
+    rgb[0] = s_srgb[std::min(wire.R + wire.W, 255)];
+    rgb[1] = s_srgb[std::min(wire.G + wire.W, 255)];
+    rgb[2] = s_srgb[std::min(wire.B + wire.W, 255)];
+}
+
+
+// ******************************* simulating *******************************
+
+static bool simulate(const host_layout_t &layout, const host_effect_t &effect, const sim_options_t &options,
+    uint8_t fps, float seconds)
+{
+    if (!host_start_effect(&layout, &effect)) {
+        return false;
+    }
+    set_brightness(0, options.brightness);
+
+    NeoDynamicRingTopology<SimRingsLayout> topology;
+    topology.Begin(layout);
+
+    uint16_t width, height;
+    std::vector<sim_point_t> points = layout_pixels(topology, options, width, height);
+    SimImage image(width, height);
+
+    std::string name = effect.name;
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+    FILE *stream = NULL;
+    if (options.stream && !options.dry) {
+        std::string path = options.out + "/" + name + ".ppm";
+        stream = fopen(path.c_str(), "wb");
+        if (stream == NULL) {
+            fprintf(stderr, "unable to write %s\n", path.c_str());
+            return false;
+        }
+    }
+
+    const int64_t interval_us = 1000000 / fps;
+    const int frames = (int)(seconds * fps);
+    uint64_t total_ns = 0;
+    uint64_t max_ns = 0;
+
+    static const uint8_t s_white[3] = { 255, 255, 255 };
+    static const uint8_t s_grey[3] = { 64, 64, 64 };
+    static const uint8_t s_green[3] = { 0, 192, 0 };
+    static const uint8_t s_red[3] = { 224, 0, 0 };
+
+    bool ok = true;
+    for (int frame = 0; frame < frames && ok; frame++) {
+        host_clock_advance_us(interval_us);
+
+        uint64_t start = now_ns();
+        render_frame();
+        strip->Show();
+        uint64_t ns = now_ns() - start;
+
+        total_ns += ns;
+        max_ns = std::max(max_ns, ns);
+
+        if (options.dry) {
+            continue;
+        }
+
+        image.Clear();
+        float radius = options.scale * 0.4f;
+        for (uint16_t i = 0; i < strip->PixelCount(); i++) {
+            uint8_t rgb[3];
+            led_to_rgb(strip->OutputStage().Apply(strip->GetPixelColor(i)), rgb);
+            // unlit pixels as an outline, so the layout shows
+            if (rgb[0] == 0 && rgb[1] == 0 && rgb[2] == 0) {
+                image.Disc(points[i].x, points[i].y, 1.0f, s_grey);
+            }
+            else {
+                image.Disc(points[i].x, points[i].y, radius, rgb);
+            }
+        }
+
+        // frame number, render time and a bar of the render time against the frame interval
+        char text[32];
+        snprintf(text, sizeof(text), "f%d %uus", frame, (unsigned)(ns / 1000));
+        image.Text(4, height - SIM_OVERLAY_HEIGHT + 4, text, 2, s_white);
+
+        int bar_width = width - 8;
+        int bar = (int)std::min<uint64_t>(bar_width, ns / 1000 * bar_width / interval_us);
+        image.Fill(4, height - 6, bar_width, 3, s_grey);
+        image.Fill(4, height - 6, std::max(bar, 1), 3, ns / 1000 > (uint64_t)interval_us ? s_red : s_green);
+
+        if (stream != NULL) {
+            ok = image.Write(stream);
+        }
+        else {
+            char path[512];
+            snprintf(path, sizeof(path), "%s/%s_%05d.ppm", options.out.c_str(), name.c_str(), frame);
+            FILE *file = fopen(path, "wb");
+            if (file == NULL) {
+                fprintf(stderr, "unable to write %s\n", path);
+                return false;
+            }
+            ok = image.Write(file);
+            fclose(file);
+        }
+    }
+    strip->WaitShown();
+
+    if (stream != NULL) {
+        fclose(stream);
+    }
+    if (!ok) {
+        fprintf(stderr, "unable to write frames of %s\n", effect.name);
+        return false;
+    }
+
+    std::string written = options.dry ? "" : options.out + "/" + name + (options.stream ? ".ppm" : "_*.ppm");
+    printf("%-14s %7u %7d %10.1f %10.1f %10lld %s\n", effect.name, strip->PixelCount(), frames,
+        total_ns / 1000.0 / frames, max_ns / 1000.0, (long long)interval_us, written.c_str());
+    return true;
+}
+
+static bool parse_layout(const char *text, host_layout_t &layout)
+{
+    layout.num_rings = 0;
+    while (*text != '\0') {
+        char *end;
+        long count = strtol(text, &end, 10);
+        if (end == text || count <= 0 || count > 1000 || layout.num_rings == 32) {
+            return false;
+        }
+        layout.pixel_layout[layout.num_rings++] = count;
+        text = (*end == ',') ? end + 1 : end;
+        if (*end != ',' && *end != '\0') {
+            return false;
+        }
+    }
+    return layout.num_rings > 0;
+}
+
+int main(int argc, char **argv)
+{
+    host_layout_t layout = s_host_layouts[0];
+    sim_options_t options = { false, 10, 100, ".", false, false };
+    uint8_t fps = DEFAULT_FRAME_RATE;
+    float seconds = 10.0f;
+    const char *effect_name = "all";
+
+    bool ok = true;
+    for (int i = 1; i < argc && ok; i++) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--layout") == 0 && has_value) {
+            layout.name = "custom";
+            ok = parse_layout(argv[++i], layout);
+        }
+        else if (strcmp(argv[i], "--rings") == 0) {
+            options.rings = true;
+        }
+        else if (strcmp(argv[i], "--seconds") == 0 && has_value) {
+            seconds = atof(argv[++i]);
+            ok = seconds > 0.0f;
+        }
+        else if (strcmp(argv[i], "--fps") == 0 && has_value) {
+            int value = atoi(argv[++i]);
+            ok = value > 0 && value <= MAX_FRAME_RATE;
+            fps = value;
+        }
+        else if (strcmp(argv[i], "--brightness") == 0 && has_value) {
+            int value = atoi(argv[++i]);
+            ok = value >= 0 && value <= 100;
+            options.brightness = value;
+        }
+        else if (strcmp(argv[i], "--scale") == 0 && has_value) {
+            int value = atoi(argv[++i]);
+            ok = value >= 4 && value <= 64;
+            options.scale = value;
+        }
+        else if (strcmp(argv[i], "--stream") == 0) {
+            options.stream = true;
+        }
+        else if (strcmp(argv[i], "--out") == 0 && has_value) {
+            options.out = argv[++i];
+        }
+        else if (strcmp(argv[i], "--dry") == 0) {
+            options.dry = true;
+        }
+        else if (argv[i][0] != '-') {
+            effect_name = argv[i];
+        }
+        else {
+            ok = false;
+        }
+    }
+    if (!ok) {
+        fprintf(stderr, "usage: %s [--layout n,n,..] [--rings] [--seconds s] [--fps n] [--brightness n] "
+            "[--scale n] [--stream] [--out dir] [--dry] [effect | all]\n", argv[0]);
+        return 2;
+    }
+
+    host_clock_set_manual(true);
+    host_configure_layout(&layout);
+
+    bool found = false;
+    for (const host_effect_t &effect : s_host_effects) {
+        found |= strcasecmp(effect_name, "all") == 0 || strcasecmp(effect_name, effect.name) == 0;
+    }
+    if (!found) {
+        fprintf(stderr, "no effect %s. effects:", effect_name);
+        for (const host_effect_t &effect : s_host_effects) {
+            fprintf(stderr, " %s", effect.name);
+        }
+        fprintf(stderr, "\n");
+        return 2;
+    }
+
+    printf("%-14s %7s %7s %10s %10s %10s\n", "effect", "pixels", "frames", "us/frame", "max us", "budget us");
+
+    for (const host_effect_t &effect : s_host_effects) {
+        if (strcasecmp(effect_name, "all") != 0 && strcasecmp(effect_name, effect.name) != 0) {
+            continue;
+        }
+        if (!simulate(layout, effect, options, fps, seconds)) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,313 @@
+#pragma once
+
+/*-------------------------------------------------------------------------
+Host stand-in for Makuna/NeoPixelBus NeoPixelAnimator.
+
+Timing, state transitions and the per-update copy of the callback match
+the library, so allocation counts seen on the host are the ones the target
+pays. Time comes from the host clock (host_clock.h).
+-------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <functional>
+
+#include "NeoPixelBus.h"
+#include "esp_timer.h"
+
+#define NEO_MILLISECONDS        1    // ~65 seconds max duration, ms updates
+#define NEO_CENTISECONDS       10    // ~10.9 minutes max duration, centisecond updates
+#define NEO_DECISECONDS       100    // ~1.8 hours max duration, decisecond updates
+#define NEO_SECONDS          1000    // ~18.2 hours max duration, second updates
+#define NEO_DECASECONDS     10000    // ~7.5 days, 10 second updates
+
+enum AnimationState
+{
+    AnimationState_Started,
+    AnimationState_Progress,
+    AnimationState_Completed
+};
+
+struct AnimationParam
+{
+    float progress;
+    uint16_t index;
+    AnimationState state;
+};
+
+#if defined(NEOPIXEBUS_NO_STL)
+typedef void(*AnimUpdateCallback)(const AnimationParam& param);
+#else
+typedef std::function<void(const AnimationParam& param)> AnimUpdateCallback;
+#endif
+
+inline uint32_t millis()
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+class NeoPixelAnimator
+{
+public:
+    NeoPixelAnimator(uint16_t countAnimations, uint16_t timeScale = NEO_MILLISECONDS) :
+        _countAnimations(countAnimations),
+        _animationLastTick(0),
+        _activeAnimations(0),
+        _isRunning(true)
+    {
+        setTimeScale(timeScale);
+        _animations = new AnimationContext[_countAnimations];
+    }
+
+    ~NeoPixelAnimator()
+    {
+        delete[] _animations;
+    }
+
+    bool IsAnimating() const
+    {
+        return _activeAnimations > 0;
+    }
+
+    bool NextAvailableAnimation(uint16_t* indexAvailable, uint16_t indexStart = 0)
+    {
+        if (indexStart >= _countAnimations)
+        {
+            // last one
+            indexStart = _countAnimations - 1;
+        }
+
+        uint16_t next = indexStart;
+
+        do
+        {
+            if (!IsAnimationActive(next))
+            {
+                if (indexAvailable)
+                {
+                    *indexAvailable = next;
+                }
+                return true;
+            }
+            next = (next + 1) % _countAnimations;
+        } while (next != indexStart);
+        return false;
+    }
+
+    void StartAnimation(uint16_t indexAnimation, uint16_t duration, AnimUpdateCallback animUpdate)
+    {
+        if (indexAnimation >= _countAnimations || animUpdate == NULL)
+        {
+            return;
+        }
+
+        if (_activeAnimations == 0)
+        {
+            _animationLastTick = millis();
+        }
+
+        StopAnimation(indexAnimation);
+
+        // all animations must have at least non zero duration, otherwise
+        // they are considered stopped
+        if (duration == 0)
+        {
+            duration = 1;
+        }
+
+        _activeAnimations++;
+        _animations[indexAnimation].StartAnimation(duration);
+        _animations[indexAnimation]._fnCallback = animUpdate;
+    }
+
+    void StopAnimation(uint16_t indexAnimation)
+    {
+        if (indexAnimation >= _countAnimations)
+        {
+            return;
+        }
+
+        if (IsAnimationActive(indexAnimation))
+        {
+            _activeAnimations--;
+            _animations[indexAnimation].StopAnimation();
+        }
+    }
+
+    void StopAll()
+    {
+        for (uint16_t indexAnimation = 0; indexAnimation < _countAnimations; ++indexAnimation)
+        {
+            _animations[indexAnimation].StopAnimation();
+        }
+        _activeAnimations = 0;
+    }
+
+    void RestartAnimation(uint16_t indexAnimation)
+    {
+        if (indexAnimation >= _countAnimations || _animations[indexAnimation]._duration == 0)
+        {
+            return;
+        }
+
+        StartAnimation(indexAnimation, _animations[indexAnimation]._duration, (_animations[indexAnimation]._fnCallback));
+    }
+
+    bool IsAnimationActive(uint16_t indexAnimation) const
+    {
+        if (indexAnimation >= _countAnimations)
+        {
+            return false;
+        }
+        return (IsAnimating() && _animations[indexAnimation]._remaining != 0);
+    }
+
+    uint16_t AnimationDuration(uint16_t indexAnimation)
+    {
+        if (indexAnimation >= _countAnimations)
+        {
+            return 0;
+        }
+        return _animations[indexAnimation]._duration;
+    }
+
+    void ChangeAnimationDuration(uint16_t indexAnimation, uint16_t newDuration)
+    {
+        if (indexAnimation >= _countAnimations)
+        {
+            return;
+        }
+
+        AnimationContext* pAnim = &_animations[indexAnimation];
+
+        // calc the current animation progress
+        float progress = pAnim->CurrentProgress();
+
+        // keep progress in range just in case
+        if (progress < 0.0f)
+        {
+            progress = 0.0f;
+        }
+        else if (progress > 1.0f)
+        {
+            progress = 1.0f;
+        }
+
+        // change the duration
+        pAnim->_duration = newDuration;
+
+        // _remaining time must also be reset after a duration change;
+        // use the progress to recalculate it
+        pAnim->_remaining = uint16_t(pAnim->_duration * (1.0f - progress));
+    }
+
+    void UpdateAnimations()
+    {
+        if (_isRunning)
+        {
+            uint32_t currentTick = millis();
+            uint32_t delta = currentTick - _animationLastTick;
+
+            if (delta >= _timeScale)
+            {
+                AnimationContext* pAnim;
+
+                delta /= _timeScale; // scale delta into animation time
+
+                for (uint16_t iAnimation = 0; iAnimation < _countAnimations; iAnimation++)
+                {
+                    pAnim = &_animations[iAnimation];
+                    AnimUpdateCallback fnUpdate = pAnim->_fnCallback;
+                    AnimationParam param;
+
+                    param.index = iAnimation;
+
+                    if (pAnim->_remaining > delta)
+                    {
+                        param.state = (pAnim->_remaining == pAnim->_duration) ? AnimationState_Started : AnimationState_Progress;
+                        param.progress = pAnim->CurrentProgress();
+
+                        fnUpdate(param);
+
+                        pAnim->_remaining -= delta;
+                    }
+                    else if (pAnim->_remaining > 0)
+                    {
+                        param.state = AnimationState_Completed;
+                        param.progress = 1.0f;
+
+                        _activeAnimations--;
+                        pAnim->StopAnimation();
+
+                        fnUpdate(param);
+                    }
+                }
+
+                _animationLastTick = currentTick;
+            }
+        }
+    }
+
+    bool IsPaused()
+    {
+        return (!_isRunning);
+    }
+
+    void Pause()
+    {
+        _isRunning = false;
+    }
+
+    void Resume()
+    {
+        _isRunning = true;
+        _animationLastTick = millis();
+    }
+
+    uint16_t getTimeScale()
+    {
+        return _timeScale;
+    }
+
+    void setTimeScale(uint16_t timeScale)
+    {
+        _timeScale = (timeScale < 1) ? (1) : (timeScale > 32768) ? 32768 : timeScale;
+    }
+
+private:
+    struct AnimationContext
+    {
+        AnimationContext() :
+            _duration(0),
+            _remaining(0),
+            _fnCallback(NULL)
+        {}
+
+        void StartAnimation(uint16_t duration)
+        {
+            _duration = duration;
+            _remaining = duration;
+        }
+
+        void StopAnimation()
+        {
+            _remaining = 0;
+        }
+
+        float CurrentProgress()
+        {
+            return (float)(_duration - _remaining) / (float)_duration;
+        }
+
+        uint16_t _duration;
+        uint16_t _remaining;
+
+        AnimUpdateCallback _fnCallback;
+    };
+
+    uint16_t _countAnimations;
+    AnimationContext* _animations;
+    uint32_t _animationLastTick;
+    uint16_t _activeAnimations;
+    uint16_t _timeScale;
+    bool _isRunning;
+};
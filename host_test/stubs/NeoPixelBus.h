@@ -0,0 +1,717 @@
+#pragma once
+
+/*-------------------------------------------------------------------------
+Host stand-in for the subset of Makuna/NeoPixelBus used by this project.
+
+Colour objects, conversions, LinearBlend, Darken and the gamma table follow
+the library implementation so the effects produce the same pixel values as
+on the target. The bus keeps the same wire buffer layout as NeoGrbwFeature
+(4 bytes per pixel, G R B W order). The RMT method does not drive any
+hardware; it models the wire time in real time (NsPerByte) so benchmarks
+can see it, independent of the manual host clock, and can log every frame
+it sends (channel, start, end, data hash) so a harness can check that
+parallel outputs really overlap and carry the right pixels.
+-------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <functional>
+#include <vector>
+
+#include "host_clock.h"
+
+struct HsbColor;
+
+struct RgbColor
+{
+    RgbColor(uint8_t r, uint8_t g, uint8_t b) : R(r), G(g), B(b) {}
+    RgbColor(uint8_t brightness = 0) : R(brightness), G(brightness), B(brightness) {}
+    RgbColor(const HsbColor& color);
+
+    uint8_t CalculateBrightness() const
+    {
+        return (uint8_t)(((uint16_t)R + (uint16_t)G + (uint16_t)B) / 3);
+    }
+
+    uint8_t R;
+    uint8_t G;
+    uint8_t B;
+
+    static const uint8_t Max = 255;
+};
+
+struct RgbwColor
+{
+    RgbwColor(uint8_t r, uint8_t g, uint8_t b, uint8_t w = 0) : R(r), G(g), B(b), W(w) {}
+    RgbwColor(uint8_t brightness = 0) : R(0), G(0), B(0), W(brightness) {}
+    RgbwColor(const RgbColor& color) : R(color.R), G(color.G), B(color.B), W(0) {}
+    RgbwColor(const HsbColor& color);
+
+    bool operator==(const RgbwColor& other) const
+    {
+        return (R == other.R && G == other.G && B == other.B && W == other.W);
+    }
+
+    bool operator!=(const RgbwColor& other) const
+    {
+        return !(*this == other);
+    }
+
+    uint8_t CalculateBrightness() const
+    {
+        uint8_t colorB = (uint8_t)(((uint16_t)R + (uint16_t)G + (uint16_t)B) / 3);
+        if (W > colorB)
+        {
+            return W;
+        }
+        return colorB;
+    }
+
+    void Darken(uint8_t delta)
+    {
+        R = (R > delta) ? R - delta : 0;
+        G = (G > delta) ? G - delta : 0;
+        B = (B > delta) ? B - delta : 0;
+        W = (W > delta) ? W - delta : 0;
+    }
+
+    // scales every element by (ratio + 1) / 256
+    RgbwColor Dim(uint8_t ratio) const
+    {
+        return RgbwColor(_elementDim(R, ratio), _elementDim(G, ratio), _elementDim(B, ratio), _elementDim(W, ratio));
+    }
+
+    void Lighten(uint8_t delta)
+    {
+        if (IsColorLess())
+        {
+            W = (W < 255 - delta) ? W + delta : 255;
+        }
+        else
+        {
+            R = (R < 255 - delta) ? R + delta : 255;
+            G = (G < 255 - delta) ? G + delta : 255;
+            B = (B < 255 - delta) ? B + delta : 255;
+        }
+    }
+
+    bool IsMonotone() const
+    {
+        return (R == G && R == B);
+    }
+
+    bool IsColorLess() const
+    {
+        return (R == 0 && G == 0 && B == 0);
+    }
+
+    static uint8_t _elementDim(uint8_t value, uint8_t ratio)
+    {
+        return (static_cast<uint16_t>(value) * (static_cast<uint16_t>(ratio) + 1)) >> 8;
+    }
+
+    static RgbwColor LinearBlend(const RgbwColor& left, const RgbwColor& right, float progress)
+    {
+        return RgbwColor(left.R + ((right.R - left.R) * progress),
+            left.G + ((right.G - left.G) * progress),
+            left.B + ((right.B - left.B) * progress),
+            left.W + ((right.W - left.W) * progress));
+    }
+
+    uint8_t R;
+    uint8_t G;
+    uint8_t B;
+    uint8_t W;
+
+    static const uint8_t Max = 255;
+};
+
+struct HsbColor
+{
+    HsbColor(float h, float s, float b) : H(h), S(s), B(b) {}
+    HsbColor() {}
+
+    HsbColor(const RgbColor& color)
+    {
+        float r = color.R / 255.0f;
+        float g = color.G / 255.0f;
+        float b = color.B / 255.0f;
+
+        float max = (r > g && r > b) ? r : (g > b) ? g : b;
+        float min = (r < g && r < b) ? r : (g < b) ? g : b;
+
+        float d = max - min;
+
+        float h = 0.0;
+        float v = max;
+        float s = (v == 0.0f) ? 0 : (d / v);
+
+        if (d != 0.0f)
+        {
+            if (r == max)
+            {
+                h = (g - b) / d + (g < b ? 6.0f : 0.0f);
+            }
+            else if (g == max)
+            {
+                h = (b - r) / d + 2.0f;
+            }
+            else
+            {
+                h = (r - g) / d + 4.0f;
+            }
+            h /= 6.0f;
+        }
+
+        H = h;
+        S = s;
+        B = v;
+    }
+
+    float H;
+    float S;
+    float B;
+};
+
+inline RgbColor::RgbColor(const HsbColor& color)
+{
+    float r;
+    float g;
+    float b;
+
+    float h = color.H;
+    float s = color.S;
+    float v = color.B;
+
+    if (color.S == 0.0f)
+    {
+        r = g = b = v; // achromatic or black
+    }
+    else
+    {
+        if (h < 0.0f)
+        {
+            h += 1.0f;
+        }
+        else if (h >= 1.0f)
+        {
+            h -= 1.0f;
+        }
+        h *= 6.0f;
+        int i = (int)h;
+        float f = h - i;
+        float q = v * (1.0f - s * f);
+        float p = v * (1.0f - s);
+        float t = v * (1.0f - s * (1.0f - f));
+        switch (i)
+        {
+        case 0:
+            r = v; g = t; b = p;
+            break;
+        case 1:
+            r = q; g = v; b = p;
+            break;
+        case 2:
+            r = p; g = v; b = t;
+            break;
+        case 3:
+            r = p; g = q; b = v;
+            break;
+        case 4:
+            r = t; g = p; b = v;
+            break;
+        default:
+            r = v; g = p; b = q;
+            break;
+        }
+    }
+
+    R = (uint8_t)(r * Max);
+    G = (uint8_t)(g * Max);
+    B = (uint8_t)(b * Max);
+}
+
+inline RgbwColor::RgbwColor(const HsbColor& color) : W(0)
+{
+    RgbColor rgbColor(color);
+    R = rgbColor.R;
+    G = rgbColor.G;
+    B = rgbColor.B;
+}
+
+
+#if defined(NEOPIXEBUS_NO_STL)
+typedef float(*AnimEaseFunction)(float unit);
+#else
+typedef std::function<float(float unit)> AnimEaseFunction;
+#endif
+
+class NeoEase
+{
+public:
+    static float Linear(float unit)
+    {
+        return unit;
+    }
+
+    static float QuadraticIn(float unit)
+    {
+        return unit * unit;
+    }
+
+    static float QuadraticOut(float unit)
+    {
+        return (-unit * (unit - 2.0f));
+    }
+
+    static float QuadraticInOut(float unit)
+    {
+        unit *= 2.0f;
+        if (unit < 1.0f)
+        {
+            return (0.5f * unit * unit);
+        }
+        unit -= 1.0f;
+        return (-0.5f * (unit * (unit - 2.0f) - 1.0f));
+    }
+
+    static float CubicIn(float unit)
+    {
+        return (unit * unit * unit);
+    }
+
+    static float CubicOut(float unit)
+    {
+        unit -= 1.0f;
+        return (unit * unit * unit + 1);
+    }
+
+    static float CubicInOut(float unit)
+    {
+        unit *= 2.0f;
+        if (unit < 1.0f)
+        {
+            return (0.5f * unit * unit * unit);
+        }
+        unit -= 2.0f;
+        return (0.5f * (unit * unit * unit + 2.0f));
+    }
+
+    static float QuarticIn(float unit)
+    {
+        return (unit * unit * unit * unit);
+    }
+
+    static float QuarticOut(float unit)
+    {
+        unit -= 1.0f;
+        return -(unit * unit * unit * unit - 1);
+    }
+
+    static float QuarticInOut(float unit)
+    {
+        unit *= 2.0f;
+        if (unit < 1.0f)
+        {
+            return (0.5f * unit * unit * unit * unit);
+        }
+        unit -= 2.0f;
+        return (-0.5f * (unit * unit * unit * unit - 2.0f));
+    }
+
+    static float QuinticIn(float unit)
+    {
+        return (unit * unit * unit * unit * unit);
+    }
+
+    static float QuinticOut(float unit)
+    {
+        unit -= 1.0f;
+        return (unit * unit * unit * unit * unit + 1.0f);
+    }
+
+    static float QuinticInOut(float unit)
+    {
+        unit *= 2.0f;
+        if (unit < 1.0f)
+        {
+            return (0.5f * unit * unit * unit * unit * unit);
+        }
+        unit -= 2.0f;
+        return (0.5f * (unit * unit * unit * unit * unit + 2.0f));
+    }
+
+    static float ExponentialIn(float unit)
+    {
+        return (powf(2, 10.0f * (unit - 1.0f)) - 0.001f);
+    }
+
+    static float ExponentialOut(float unit)
+    {
+        return (-1.001f * powf(2, -10.0f * unit) + 1.0f);
+    }
+
+    static float ExponentialInOut(float unit)
+    {
+        unit *= 2.0f;
+        if (unit < 1.0f)
+        {
+            return (0.5f * powf(2, 10.0f * (unit - 1.0f)) - 0.0005f);
+        }
+        unit -= 1.0f;
+        return (0.5f * 1.0005f * (-powf(2, -10.0f * unit) + 2.0f));
+    }
+
+    static float Gamma(float unit)
+    {
+        return powf(unit, 1.0f / 0.45f);
+    }
+};
+
+
+class NeoGammaTableMethod
+{
+public:
+    static uint8_t Correct(uint8_t value)
+    {
+        return table()[value];
+    }
+
+private:
+    static const uint8_t* table()
+    {
+        static uint8_t s_table[256];
+        static bool s_init = false;
+        if (!s_init)
+        {
+            for (int i = 0; i < 256; i++)
+            {
+                s_table[i] = (uint8_t)(NeoEase::Gamma(i / 255.0f) * 255.0f + 0.5f);
+            }
+            s_init = true;
+        }
+        return s_table;
+    }
+};
+
+template<typename T_METHOD> class NeoGamma
+{
+public:
+    RgbColor Correct(const RgbColor& original)
+    {
+        return RgbColor(T_METHOD::Correct(original.R),
+            T_METHOD::Correct(original.G),
+            T_METHOD::Correct(original.B));
+    }
+
+    RgbwColor Correct(const RgbwColor& original)
+    {
+        return RgbwColor(T_METHOD::Correct(original.R),
+            T_METHOD::Correct(original.G),
+            T_METHOD::Correct(original.B),
+            T_METHOD::Correct(original.W));
+    }
+};
+
+
+class NeoGrbwFeature
+{
+public:
+    typedef RgbwColor ColorObject;
+
+    static const size_t PixelSize = 4;
+
+    static void applyPixelColor(uint8_t* pPixels, uint16_t indexPixel, ColorObject color)
+    {
+        uint8_t* p = pPixels + indexPixel * PixelSize;
+
+        *p++ = color.G;
+        *p++ = color.R;
+        *p++ = color.B;
+        *p = color.W;
+    }
+
+    static ColorObject retrievePixelColor(const uint8_t* pPixels, uint16_t indexPixel)
+    {
+        ColorObject color;
+        const uint8_t* p = pPixels + indexPixel * PixelSize;
+
+        color.G = *p++;
+        color.R = *p++;
+        color.B = *p++;
+        color.W = *p;
+
+        return color;
+    }
+};
+
+
+enum NeoBusChannel
+{
+    NeoBusChannel_0,
+    NeoBusChannel_1,
+    NeoBusChannel_2,
+    NeoBusChannel_3,
+    NeoBusChannel_4,
+    NeoBusChannel_5,
+    NeoBusChannel_6,
+    NeoBusChannel_7
+};
+
+// one frame sent on one channel, in host monotonic time
+struct NeoHostTransmit
+{
+    uint8_t channel;
+    uint8_t pin;
+    int64_t startUs;
+    int64_t endUs;
+    uint32_t hash;      // FNV-1a of the bytes sent
+};
+
+// SK6812 is 800Kbps (10000ns per byte), 32 bits per RGBW pixel plus an 80us latch.
+// a channel can only be owned by one bus at a time, as on the target where a second
+// bus on the same RMT channel silently breaks the first; that aborts here
+class NeoEsp32RmtNSk6812Method
+{
+public:
+    // set by a harness to model the wire; 0 makes Update() free
+    static uint32_t& NsPerByte()
+    {
+        static uint32_t s_nsPerByte = 0;
+        return s_nsPerByte;
+    }
+
+    // when set, every Update() is appended to Transmits()
+    static bool& LogTransmits()
+    {
+        static bool s_logTransmits = false;
+        return s_logTransmits;
+    }
+
+    static std::vector<NeoHostTransmit>& Transmits()
+    {
+        static std::vector<NeoHostTransmit> s_transmits;
+        return s_transmits;
+    }
+
+    static uint32_t Hash(const uint8_t* data, size_t size)
+    {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < size; i++)
+        {
+            hash = (hash ^ data[i]) * 16777619u;
+        }
+        return hash;
+    }
+
+    NeoEsp32RmtNSk6812Method(uint8_t pin, uint16_t pixelCount, size_t elementSize, NeoBusChannel channel) :
+        _sizeData(pixelCount * elementSize),
+        _pin(pin),
+        _channel(channel),
+        _sendingUntil(0)
+    {
+        if (channel > NeoBusChannel_7 || claimed()[channel])
+        {
+            fprintf(stderr, "NeoEsp32RmtNSk6812Method: RMT channel %d is invalid or already in use\n", channel);
+            abort();
+        }
+        claimed()[channel] = true;
+
+        _dataEditing = new uint8_t[_sizeData];
+        _dataSending = new uint8_t[_sizeData];
+        memset(_dataEditing, 0, _sizeData);
+        memset(_dataSending, 0, _sizeData);
+    }
+
+    ~NeoEsp32RmtNSk6812Method()
+    {
+        claimed()[_channel] = false;
+        delete[] _dataEditing;
+        delete[] _dataSending;
+    }
+
+    void Initialize()
+    {
+    }
+
+    bool IsReadyToUpdate() const
+    {
+        return host_clock_monotonic_us() >= _sendingUntil;
+    }
+
+    // same contract as the RMT method: wait for the previous frame, start this one
+    // without waiting, then swap buffers
+    void Update(bool maintainBufferConsistency)
+    {
+        while (!IsReadyToUpdate())
+        {
+        }
+
+        int64_t start = host_clock_monotonic_us();
+        if (NsPerByte() != 0)
+        {
+            _sendingUntil = start + ((int64_t)_sizeData * NsPerByte() + 80000) / 1000;
+        }
+
+        if (maintainBufferConsistency)
+        {
+            memcpy(_dataSending, _dataEditing, _sizeData);
+        }
+
+        uint8_t* temp = _dataSending;
+        _dataSending = _dataEditing;
+        _dataEditing = temp;
+
+        if (LogTransmits())
+        {
+            Transmits().push_back({ (uint8_t)_channel, _pin, start, _sendingUntil > start ? _sendingUntil : start,
+                Hash(_dataSending, _sizeData) });
+        }
+    }
+
+    uint8_t* getData() const
+    {
+        return _dataEditing;
+    }
+
+    size_t getDataSize() const
+    {
+        return _sizeData;
+    }
+
+private:
+    static bool* claimed()
+    {
+        static bool s_claimed[NeoBusChannel_7 + 1] = {};
+        return s_claimed;
+    }
+
+    const size_t _sizeData;
+    const uint8_t _pin;
+    const NeoBusChannel _channel;
+    int64_t _sendingUntil;
+
+    uint8_t* _dataEditing;
+    uint8_t* _dataSending;
+};
+
+
+template<typename T_COLOR_FEATURE, typename T_METHOD> class NeoPixelBus
+{
+public:
+    NeoPixelBus(uint16_t countPixels, uint8_t pin, NeoBusChannel channel) :
+        _countPixels(countPixels),
+        _state(0),
+        _method(pin, countPixels, T_COLOR_FEATURE::PixelSize, channel)
+    {
+    }
+
+    void Begin()
+    {
+        _method.Initialize();
+        Dirty();
+    }
+
+    void Show(bool maintainBufferConsistency = true)
+    {
+        if (!IsDirty())
+        {
+            return;
+        }
+
+        _method.Update(maintainBufferConsistency);
+
+        ResetDirty();
+    }
+
+    bool CanShow() const
+    {
+        return _method.IsReadyToUpdate();
+    }
+
+    bool IsDirty() const
+    {
+        return (_state & NEO_DIRTY);
+    }
+
+    void Dirty()
+    {
+        _state |= NEO_DIRTY;
+    }
+
+    void ResetDirty()
+    {
+        _state &= ~NEO_DIRTY;
+    }
+
+    uint8_t* Pixels()
+    {
+        return _method.getData();
+    }
+
+    size_t PixelsSize() const
+    {
+        return _method.getDataSize();
+    }
+
+    size_t PixelSize() const
+    {
+        return T_COLOR_FEATURE::PixelSize;
+    }
+
+    uint16_t PixelCount() const
+    {
+        return _countPixels;
+    }
+
+    void SetPixelColor(uint16_t indexPixel, typename T_COLOR_FEATURE::ColorObject color)
+    {
+        if (indexPixel < _countPixels)
+        {
+            T_COLOR_FEATURE::applyPixelColor(_method.getData(), indexPixel, color);
+            Dirty();
+        }
+    }
+
+    typename T_COLOR_FEATURE::ColorObject GetPixelColor(uint16_t indexPixel) const
+    {
+        if (indexPixel < _countPixels)
+        {
+            return T_COLOR_FEATURE::retrievePixelColor(_method.getData(), indexPixel);
+        }
+        // Pixel # is out of bounds, this will get converted to a
+        // color object type initialized to 0 (black)
+        return 0;
+    }
+
+    void ClearTo(typename T_COLOR_FEATURE::ColorObject color)
+    {
+        for (uint16_t n = 0; n < _countPixels; n++)
+        {
+            T_COLOR_FEATURE::applyPixelColor(_method.getData(), n, color);
+        }
+        Dirty();
+    }
+
+    void ClearTo(typename T_COLOR_FEATURE::ColorObject color, uint16_t first, uint16_t last)
+    {
+        if (first < _countPixels && last < _countPixels && first <= last)
+        {
+            for (uint16_t n = first; n <= last; n++)
+            {
+                T_COLOR_FEATURE::applyPixelColor(_method.getData(), n, color);
+            }
+            Dirty();
+        }
+    }
+
+protected:
+    static const uint8_t NEO_DIRTY = 0x80;
+
+    const uint16_t _countPixels;
+    uint8_t _state;
+    T_METHOD _method;
+};
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the host counts a cycle per nanosecond of the monotonic clock, whatever the mode of
+// host_clock.h, so render times are real. see esp_rom_get_cpu_ticks_per_us()
+uint32_t esp_cpu_get_cycle_count(void);
+
+#ifdef __cplusplus
+}
+#endif
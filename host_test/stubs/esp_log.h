@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdio.h>
+#include "esp_err.h"
+
+// logging is compiled out unless HOST_LOG is defined, so it does not skew benchmarks.
+// the arguments are still compiled, so what is only logged is not unused
+#ifdef HOST_LOG
+#define HOST_LOG_PRINT(level, tag, format, ...) fprintf(stderr, level " (%s) " format "\n", tag, ##__VA_ARGS__)
+#else
+#define HOST_LOG_PRINT(level, tag, format, ...) \
+    do { if (0) fprintf(stderr, level " (%s) " format "\n", tag, ##__VA_ARGS__); } while (0)
+#endif
+
+#define ESP_LOGE(tag, format, ...) HOST_LOG_PRINT("E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) HOST_LOG_PRINT("W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) HOST_LOG_PRINT("I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) HOST_LOG_PRINT("D", tag, format, ##__VA_ARGS__)
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// deterministic on the host. host_random_seed() restarts the sequence
+uint32_t esp_random(void);
+void host_random_seed(uint32_t seed);
+
+#ifdef __cplusplus
+}
+#endif
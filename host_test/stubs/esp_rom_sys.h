@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// a 1GHz CPU, the rate of the host's esp_cpu_get_cycle_count()
+uint32_t esp_rom_get_cpu_ticks_per_us(void);
+
+// busy-waits on the monotonic clock, as the ROM spins the CPU
+void esp_rom_delay_us(uint32_t us);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,41 @@
+#pragma once
+
+/*-------------------------------------------------------------------------
+Host stand-in for the parts of FreeRTOS used by main/animation.cpp.
+
+Tasks are not scheduled on the host. xTaskCreate() only records the task
+so a harness can run it (see host_task_run()); benchmarks drive the loop
+functions directly. Queues and notifications are thread safe so a harness
+that does start tasks on threads behaves like the target.
+-------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint32_t TickType_t;
+typedef int32_t BaseType_t;
+typedef uint32_t UBaseType_t;
+
+#define pdFALSE                 ((BaseType_t) 0)
+#define pdTRUE                  ((BaseType_t) 1)
+#define pdPASS                  pdTRUE
+#define pdFAIL                  pdFALSE
+
+#define portMAX_DELAY           ((TickType_t) 0xffffffffUL)
+#define configTICK_RATE_HZ      100
+#define portTICK_PERIOD_MS      ((TickType_t) 1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)       ((TickType_t) (((TickType_t) (ms) * (TickType_t) configTICK_RATE_HZ) / (TickType_t) 1000U))
+
+#define tskIDLE_PRIORITY        ((UBaseType_t) 0U)
+
+#ifdef __cplusplus
+}
+#endif
+
+#include "freertos/task.h"
+#include "freertos/queue.h"
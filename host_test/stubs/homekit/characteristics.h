@@ -0,0 +1,19 @@
+#pragma once
+
+// the short forms of the Apple UUIDs, as esp-homekit uses
+
+#define HOMEKIT_SERVICE_ACCESSORY_INFORMATION       "3E"
+#define HOMEKIT_SERVICE_LIGHTBULB                   "43"
+#define HOMEKIT_SERVICE_TELEVISION                  "D8"
+#define HOMEKIT_SERVICE_INPUT_SOURCE                "D9"
+
+#define HOMEKIT_CHARACTERISTIC_ON                   "25"
+#define HOMEKIT_CHARACTERISTIC_BRIGHTNESS           "8"
+#define HOMEKIT_CHARACTERISTIC_HUE                  "13"
+#define HOMEKIT_CHARACTERISTIC_SATURATION           "2F"
+#define HOMEKIT_CHARACTERISTIC_ACTIVE               "B0"
+#define HOMEKIT_CHARACTERISTIC_ACTIVE_IDENTIFIER    "E7"
+
+#define HOMEKIT_CHARACTERISTIC_NAME                 "23"
+#define HOMEKIT_CHARACTERISTIC_IDENTIFIER           "E6"
+#define HOMEKIT_CHARACTERISTIC_CONFIGURED_NAME      "E3"
@@ -0,0 +1,76 @@
+#pragma once
+
+/*-------------------------------------------------------------------------
+Host stand-in for the parts of esp-homekit used by main/homekit_lights.c.
+
+Accessories, services and characteristics are plain structs a harness
+fills in. As in esp-homekit, homekit_characteristic_notify() calls the
+characteristic's change callback, and a controller write is setting the
+value and notifying (see host_homekit_write()). Nothing is sent anywhere.
+-------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    homekit_format_bool,
+    homekit_format_uint8,
+    homekit_format_int,
+    homekit_format_float,
+    homekit_format_string,
+} homekit_format_t;
+
+typedef struct {
+    homekit_format_t format;
+    union {
+        bool bool_value;
+        int int_value;
+        float float_value;
+        char *string_value;
+    };
+} homekit_value_t;
+
+typedef struct _homekit_accessory homekit_accessory_t;
+typedef struct _homekit_service homekit_service_t;
+typedef struct _homekit_characteristic homekit_characteristic_t;
+
+typedef void (*homekit_characteristic_change_callback_fn)(homekit_characteristic_t *ch, homekit_value_t value, void *context);
+
+struct _homekit_characteristic {
+    homekit_service_t *service;
+    const char *type;
+    const char *description;
+    homekit_value_t value;
+    homekit_characteristic_change_callback_fn callback;     // esp-homekit keeps a list
+    void *context;
+};
+
+struct _homekit_service {
+    homekit_accessory_t *accessory;
+    const char *type;
+    homekit_characteristic_t **characteristics;             // NULL terminated
+};
+
+struct _homekit_accessory {
+    homekit_service_t **services;                           // NULL terminated
+};
+
+#define HOMEKIT_BOOL(value)     ((homekit_value_t) { .format = homekit_format_bool, .bool_value = (value) })
+#define HOMEKIT_UINT8(value)    ((homekit_value_t) { .format = homekit_format_uint8, .int_value = (value) })
+#define HOMEKIT_INT(value)      ((homekit_value_t) { .format = homekit_format_int, .int_value = (value) })
+#define HOMEKIT_FLOAT(value)    ((homekit_value_t) { .format = homekit_format_float, .float_value = (value) })
+
+homekit_service_t *homekit_service_by_type(homekit_accessory_t *accessory, const char *type);
+homekit_characteristic_t *homekit_service_characteristic_by_type(homekit_service_t *service, const char *type);
+void homekit_characteristic_notify(homekit_characteristic_t *ch, homekit_value_t value);
+
+// host only: what the HomeKit server does when a controller writes 'value'
+void host_homekit_write(homekit_characteristic_t *ch, homekit_value_t value);
+
+#ifdef __cplusplus
+}
+#endif
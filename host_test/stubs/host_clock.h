@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The host clock runs from the monotonic clock by default. A harness can switch
+// it to manual mode, where time only moves with host_clock_advance_us(), so that
+// NeoPixelAnimator progress is identical between runs.
+void host_clock_set_manual(bool manual);
+void host_clock_advance_us(int64_t us);
+int64_t host_clock_now_us(void);
+
+// always the monotonic clock, whatever the mode. the stand-in transmitters use it
+// so wire time is real even when animation time is manual
+int64_t host_clock_monotonic_us(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,656 @@
+#include <map>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <atomic>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_err.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#include "host_clock.h"
+#include "nvs.h"
+#include "homekit/homekit.h"
+
+
+// ********************************* clock ********************************
+static std::mutex s_clock_mutex;
+static bool s_clock_manual = false;
+static int64_t s_clock_manual_us = 0;
+
+static int64_t monotonic_us()
+{
+    using namespace std::chrono;
+    static const steady_clock::time_point s_start = steady_clock::now();
+    return duration_cast<microseconds>(steady_clock::now() - s_start).count();
+}
+
+void host_clock_set_manual(bool manual)
+{
+    std::lock_guard<std::mutex> lock(s_clock_mutex);
+    if (manual && !s_clock_manual) {
+        s_clock_manual_us = monotonic_us();
+    }
+    s_clock_manual = manual;
+}
+
+void host_clock_advance_us(int64_t us)
+{
+    std::lock_guard<std::mutex> lock(s_clock_mutex);
+    s_clock_manual_us += us;
+}
+
+int64_t host_clock_monotonic_us(void)
+{
+    return monotonic_us();
+}
+
+int64_t host_clock_now_us(void)
+{
+    std::lock_guard<std::mutex> lock(s_clock_mutex);
+    return s_clock_manual ? s_clock_manual_us : monotonic_us();
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return host_clock_now_us();
+}
+
+uint32_t esp_cpu_get_cycle_count(void)
+{
+    using namespace std::chrono;
+    return (uint32_t)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+uint32_t esp_rom_get_cpu_ticks_per_us(void)
+{
+    return 1000;
+}
+
+void esp_rom_delay_us(uint32_t us)
+{
+    int64_t until = host_clock_monotonic_us() + us;
+    while (host_clock_monotonic_us() < until) {
+    }
+}
+
+
+// ********************************* random *******************************
+static uint32_t s_random_state = 0x2545F491;
+
+void host_random_seed(uint32_t seed)
+{
+    s_random_state = seed != 0 ? seed : 0x2545F491;
+}
+
+uint32_t esp_random(void)
+{
+    // xorshift32
+    uint32_t x = s_random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    s_random_state = x;
+    return x;
+}
+
+
+// ********************************* esp_err ******************************
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+        case ESP_OK:                return "ESP_OK";
+        case ESP_FAIL:              return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:        return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:   return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE:  return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND:     return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NVS_NOT_FOUND: return "ESP_ERR_NVS_NOT_FOUND";
+        default:                    return "UNKNOWN ERROR";
+    }
+}
+
+
+// ********************************* nvs **********************************
+static std::mutex s_nvs_mutex;
+static std::vector<std::string> s_nvs_namespaces;
+static std::map<std::string, std::vector<uint8_t>> s_nvs_store;
+
+static std::string nvs_key(nvs_handle handle, const char *key)
+{
+    return s_nvs_namespaces[handle - 1] + "/" + key;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode open_mode, nvs_handle *out_handle)
+{
+    std::lock_guard<std::mutex> lock(s_nvs_mutex);
+    for (size_t i = 0; i < s_nvs_namespaces.size(); i++) {
+        if (s_nvs_namespaces[i] == name) {
+            *out_handle = i + 1;
+            return ESP_OK;
+        }
+    }
+    s_nvs_namespaces.push_back(name);
+    *out_handle = s_nvs_namespaces.size();
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle handle)
+{
+}
+
+esp_err_t nvs_commit(nvs_handle handle)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_all(nvs_handle handle)
+{
+    std::lock_guard<std::mutex> lock(s_nvs_mutex);
+    std::string prefix = s_nvs_namespaces[handle - 1] + "/";
+    for (auto it = s_nvs_store.begin(); it != s_nvs_store.end(); ) {
+        if (it->first.compare(0, prefix.size(), prefix) == 0) {
+            it = s_nvs_store.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle handle, const char *key)
+{
+    std::lock_guard<std::mutex> lock(s_nvs_mutex);
+    return s_nvs_store.erase(nvs_key(handle, key)) ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+static esp_err_t nvs_get(nvs_handle handle, const char *key, void *out_value, size_t *length, bool exact)
+{
+    std::lock_guard<std::mutex> lock(s_nvs_mutex);
+    auto it = s_nvs_store.find(nvs_key(handle, key));
+    if (it == s_nvs_store.end()) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (out_value == NULL) {
+        *length = it->second.size();
+        return ESP_OK;
+    }
+    if ((exact && *length != it->second.size()) || *length < it->second.size()) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(out_value, it->second.data(), it->second.size());
+    *length = it->second.size();
+    return ESP_OK;
+}
+
+static esp_err_t nvs_set(nvs_handle handle, const char *key, const void *value, size_t length)
+{
+    std::lock_guard<std::mutex> lock(s_nvs_mutex);
+    const uint8_t *p = (const uint8_t *)value;
+    s_nvs_store[nvs_key(handle, key)] = std::vector<uint8_t>(p, p + length);
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_u8(nvs_handle handle, const char *key, uint8_t *out_value)
+{
+    size_t length = sizeof(*out_value);
+    return nvs_get(handle, key, out_value, &length, true);
+}
+
+esp_err_t nvs_set_u8(nvs_handle handle, const char *key, uint8_t value)
+{
+    return nvs_set(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u16(nvs_handle handle, const char *key, uint16_t *out_value)
+{
+    size_t length = sizeof(*out_value);
+    return nvs_get(handle, key, out_value, &length, true);
+}
+
+esp_err_t nvs_set_u16(nvs_handle handle, const char *key, uint16_t value)
+{
+    return nvs_set(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_blob(nvs_handle handle, const char *key, void *out_value, size_t *length)
+{
+    return nvs_get(handle, key, out_value, length, false);
+}
+
+esp_err_t nvs_set_blob(nvs_handle handle, const char *key, const void *value, size_t length)
+{
+    return nvs_set(handle, key, value, length);
+}
+
+esp_err_t nvs_get_str(nvs_handle handle, const char *key, char *out_value, size_t *length)
+{
+    return nvs_get(handle, key, out_value, length, false);
+}
+
+esp_err_t nvs_set_str(nvs_handle handle, const char *key, const char *value)
+{
+    return nvs_set(handle, key, value, strlen(value) + 1);
+}
+
+
+// ********************************* tasks ********************************
+struct host_task {
+    TaskFunction_t fn;
+    void *param;
+    std::string name;
+    bool started = false;
+
+    std::mutex notify_mutex;
+    std::condition_variable notify_cv;
+    uint32_t notify_value = 0;
+    bool notify_pending = false;
+};
+
+static std::mutex s_task_mutex;
+static std::deque<host_task> s_tasks;
+static thread_local host_task *s_current_task = NULL;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *param,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core_id)
+{
+    std::lock_guard<std::mutex> lock(s_task_mutex);
+    s_tasks.emplace_back();
+    s_tasks.back().fn = fn;
+    s_tasks.back().param = param;
+    s_tasks.back().name = name;
+    if (handle != NULL) {
+        *handle = &s_tasks.back();
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *param,
+                       UBaseType_t priority, TaskHandle_t *handle)
+{
+    return xTaskCreatePinnedToCore(fn, name, stack_depth, param, priority, handle, -1);
+}
+
+bool host_task_run(const char *name)
+{
+    std::lock_guard<std::mutex> lock(s_task_mutex);
+    for (host_task &task : s_tasks) {
+        if (task.name == name && !task.started) {
+            host_task *self = &task;
+            task.started = true;
+            std::thread([self] {
+                s_current_task = self;
+                self->fn(self->param);
+            }).detach();
+            return true;
+        }
+    }
+    return false;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS));
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(host_clock_now_us() / 1000 / portTICK_PERIOD_MS);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return s_current_task;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+    if (task == NULL) {
+        return pdFAIL;
+    }
+    std::lock_guard<std::mutex> lock(task->notify_mutex);
+    switch (action) {
+        case eSetBits:
+            task->notify_value |= value;
+            break;
+        case eIncrement:
+            task->notify_value++;
+            break;
+        case eSetValueWithoutOverwrite:
+            if (task->notify_pending) {
+                return pdFAIL;
+            }
+            task->notify_value = value;
+            break;
+        case eSetValueWithOverwrite:
+            task->notify_value = value;
+            break;
+        case eNoAction:
+            break;
+    }
+    task->notify_pending = true;
+    task->notify_cv.notify_all();
+    return pdPASS;
+}
+
+static bool notify_wait(host_task *task, std::unique_lock<std::mutex> &lock, TickType_t ticks_to_wait)
+{
+    auto pending = [task] { return task->notify_pending; };
+    // a zero timeout is a poll. wait_for() would still sleep for the kernel timer slack
+    if (ticks_to_wait == 0) {
+        return pending();
+    }
+    if (ticks_to_wait == portMAX_DELAY) {
+        task->notify_cv.wait(lock, pending);
+        return true;
+    }
+    return task->notify_cv.wait_for(lock, std::chrono::milliseconds(ticks_to_wait * portTICK_PERIOD_MS), pending);
+}
+
+BaseType_t xTaskNotifyWait(uint32_t bits_to_clear_on_entry, uint32_t bits_to_clear_on_exit,
+                           uint32_t *notification_value, TickType_t ticks_to_wait)
+{
+    host_task *task = s_current_task;
+    if (task == NULL) {
+        return pdFALSE;
+    }
+    std::unique_lock<std::mutex> lock(task->notify_mutex);
+    if (!task->notify_pending) {
+        task->notify_value &= ~bits_to_clear_on_entry;
+    }
+    bool notified = notify_wait(task, lock, ticks_to_wait);
+    if (notification_value != NULL) {
+        *notification_value = task->notify_value;
+    }
+    if (!notified) {
+        return pdFALSE;
+    }
+    task->notify_value &= ~bits_to_clear_on_exit;
+    task->notify_pending = false;
+    return pdTRUE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_count_on_exit, TickType_t ticks_to_wait)
+{
+    host_task *task = s_current_task;
+    if (task == NULL) {
+        return 0;
+    }
+    std::unique_lock<std::mutex> lock(task->notify_mutex);
+    if (task->notify_value == 0) {
+        task->notify_pending = false;
+        notify_wait(task, lock, ticks_to_wait);
+    }
+    uint32_t value = task->notify_value;
+    if (value != 0) {
+        task->notify_value = clear_count_on_exit ? 0 : value - 1;
+    }
+    task->notify_pending = false;
+    return value;
+}
+
+
+// ********************************* timers *******************************
+// one service thread runs every callback, as the esp_timer task does on the target.
+// deadlines are in real time, independent of the manual host clock
+struct host_timer {
+    esp_timer_create_args_t args;
+    uint32_t generation = 0;
+};
+
+// never destroyed: the service thread is still running while statics are torn down at exit
+static std::mutex &s_timer_mutex = *new std::mutex();
+static std::condition_variable &s_timer_cv = *new std::condition_variable();
+static std::multimap<int64_t, std::pair<host_timer *, uint32_t>> &s_timer_queue = *new std::multimap<int64_t, std::pair<host_timer *, uint32_t>>();
+static host_timer *s_timer_running = NULL;
+
+static void timer_service()
+{
+    std::unique_lock<std::mutex> lock(s_timer_mutex);
+    while (1) {
+        if (s_timer_queue.empty()) {
+            s_timer_cv.wait(lock);
+            continue;
+        }
+
+        auto next = s_timer_queue.begin();
+        int64_t wait_us = next->first - host_clock_monotonic_us();
+        if (wait_us > 0) {
+            s_timer_cv.wait_for(lock, std::chrono::microseconds(wait_us));
+            continue;
+        }
+
+        host_timer *timer = next->second.first;
+        uint32_t generation = next->second.second;
+        s_timer_queue.erase(next);
+
+        // stopped or restarted since
+        if (timer->generation != generation) {
+            continue;
+        }
+
+        s_timer_running = timer;
+        esp_timer_cb_t callback = timer->args.callback;
+        void *arg = timer->args.arg;
+        lock.unlock();
+        callback(arg);
+        lock.lock();
+        s_timer_running = NULL;
+        s_timer_cv.notify_all();
+    }
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle)
+{
+    static std::once_flag s_service_started;
+    std::call_once(s_service_started, [] {
+        std::thread(timer_service).detach();
+    });
+
+    host_timer *timer = new host_timer();
+    timer->args = *create_args;
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    std::lock_guard<std::mutex> lock(s_timer_mutex);
+    uint32_t generation = ++timer->generation;
+    auto it = s_timer_queue.insert({ host_clock_monotonic_us() + (int64_t)timeout_us, { timer, generation } });
+    // the service thread only needs waking when this is now the earliest deadline
+    if (it == s_timer_queue.begin()) {
+        s_timer_cv.notify_all();
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    std::lock_guard<std::mutex> lock(s_timer_mutex);
+    ++timer->generation;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    std::unique_lock<std::mutex> lock(s_timer_mutex);
+    for (auto it = s_timer_queue.begin(); it != s_timer_queue.end(); ) {
+        if (it->second.first == timer) {
+            it = s_timer_queue.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    // a callback may be running on the service thread
+    s_timer_cv.wait(lock, [timer] { return s_timer_running != timer; });
+    delete timer;
+    return ESP_OK;
+}
+
+
+// ********************************* queues *******************************
+struct host_queue {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::vector<uint8_t>> items;
+    UBaseType_t length;
+    UBaseType_t item_size;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    host_queue *queue = new host_queue();
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    delete queue;
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait)
+{
+    if (queue == NULL) {
+        return pdFAIL;
+    }
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    // senders do not block on the host; a full queue behaves like a zero timeout
+    if (queue->items.size() >= queue->length) {
+        return pdFAIL;
+    }
+    const uint8_t *p = (const uint8_t *)item;
+    queue->items.emplace_back(p, p + queue->item_size);
+    queue->cv.notify_one();
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t ticks_to_wait)
+{
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    auto ready = [queue] { return !queue->items.empty(); };
+    if (ticks_to_wait == 0) {
+        if (!ready()) {
+            return pdFALSE;
+        }
+    } else if (ticks_to_wait == portMAX_DELAY) {
+        queue->cv.wait(lock, ready);
+    } else if (!queue->cv.wait_for(lock, std::chrono::milliseconds(ticks_to_wait * portTICK_PERIOD_MS), ready)) {
+        return pdFALSE;
+    }
+    memcpy(buffer, queue->items.front().data(), queue->item_size);
+    queue->items.pop_front();
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return queue->items.size();
+}
+
+
+// ********************************* semaphores ***************************
+struct host_semaphore {
+    std::mutex mutex;
+    std::condition_variable cv;
+    uint32_t count;
+};
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    host_semaphore *semaphore = new host_semaphore();
+    semaphore->count = 0;
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    host_semaphore *semaphore = new host_semaphore();
+    semaphore->count = 1;
+    return semaphore;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+    delete semaphore;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    std::lock_guard<std::mutex> lock(semaphore->mutex);
+    if (semaphore->count != 0) {
+        return pdFAIL;
+    }
+    semaphore->count = 1;
+    semaphore->cv.notify_one();
+    return pdPASS;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait)
+{
+    std::unique_lock<std::mutex> lock(semaphore->mutex);
+    auto available = [semaphore] { return semaphore->count != 0; };
+    if (ticks_to_wait == 0) {
+        if (!available()) {
+            return pdFALSE;
+        }
+    } else if (ticks_to_wait == portMAX_DELAY) {
+        semaphore->cv.wait(lock, available);
+    } else if (!semaphore->cv.wait_for(lock, std::chrono::milliseconds(ticks_to_wait * portTICK_PERIOD_MS), available)) {
+        return pdFALSE;
+    }
+    semaphore->count = 0;
+    return pdTRUE;
+}
+
+
+// ********************************* homekit ******************************
+homekit_service_t *homekit_service_by_type(homekit_accessory_t *accessory, const char *type)
+{
+    for (homekit_service_t **service = accessory->services; *service != NULL; service++) {
+        if (strcmp((*service)->type, type) == 0) {
+            return *service;
+        }
+    }
+    return NULL;
+}
+
+homekit_characteristic_t *homekit_service_characteristic_by_type(homekit_service_t *service, const char *type)
+{
+    for (homekit_characteristic_t **ch = service->characteristics; *ch != NULL; ch++) {
+        if (strcmp((*ch)->type, type) == 0) {
+            return *ch;
+        }
+    }
+    return NULL;
+}
+
+void homekit_characteristic_notify(homekit_characteristic_t *ch, homekit_value_t value)
+{
+    if (ch->callback != NULL) {
+        ch->callback(ch, value, ch->context);
+    }
+}
+
+void host_homekit_write(homekit_characteristic_t *ch, homekit_value_t value)
+{
+    ch->value = value;
+    homekit_characteristic_notify(ch, value);
+}
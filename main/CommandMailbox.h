@@ -0,0 +1,68 @@
+#pragma once
+
+/*-------------------------------------------------------------------------
+CommandMailbox passes the latest command from one task to another without
+a lock and without a queue that can fill up.
+
+It is a triple buffer: the producer writes into a slot of its own and
+swaps it with the shared slot, the consumer swaps the shared slot with a
+slot of its own when it holds a command it has not taken yet. A command
+posted before the previous one was taken replaces it (latest wins) and is
+counted as coalesced, so a flood of commands never blocks or drops the
+newest one, and the consumer never works through stale ones.
+
+One producer task and one consumer task only.
+-------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <atomic>
+
+template <typename T> class CommandMailbox
+{
+public:
+    // producer. never blocks
+    void Post(const T& command) {
+        _slots[_back] = command;
+        uint8_t previous = _shared.exchange(_back | Fresh, std::memory_order_acq_rel);
+        _back = previous & SlotMask;
+        if (previous & Fresh) {
+            _coalesced.fetch_add(1, std::memory_order_relaxed);
+        }
+        _posted.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // consumer. false if nothing was posted since the last Take()
+    bool Take(T& command) {
+        if (!Pending()) {
+            return false;
+        }
+        uint8_t previous = _shared.exchange(_front, std::memory_order_acq_rel);
+        _front = previous & SlotMask;
+        command = _slots[_front];
+        return true;
+    }
+
+    bool Pending() const {
+        return _shared.load(std::memory_order_acquire) & Fresh;
+    }
+
+    // commands posted, and of those replaced before they were taken
+    uint32_t Posted() const {
+        return _posted.load(std::memory_order_relaxed);
+    }
+
+    uint32_t Coalesced() const {
+        return _coalesced.load(std::memory_order_relaxed);
+    }
+
+private:
+    static const uint8_t SlotMask = 0x03;
+    static const uint8_t Fresh = 0x04;
+
+    T _slots[3];
+    uint8_t _back = 0;                          // producer's slot
+    uint8_t _front = 1;                         // consumer's slot
+    std::atomic<uint8_t> _shared {2};           // slot index, | Fresh when not taken yet
+    std::atomic<uint32_t> _posted {0};
+    std::atomic<uint32_t> _coalesced {0};
+};
@@ -0,0 +1,136 @@
+#pragma once
+
+/*-------------------------------------------------------------------------
+EaseTable replaces the NeoEase functions used by the effects with lookup
+tables generated at compile time.
+
+Each curve is sampled at 129 points as 16-bit values and interpolated
+linearly between them, which keeps every curve within 0.002 of NeoEase
+(half a step of an 8-bit channel). Ease() is a clamp, a multiply and one
+interpolation, whichever curve it is, instead of a call through a function
+pointer that, for the exponential curves, ends in powf().
+
+Curves are picked with EaseCurve, which fits in a byte, so per-pixel
+tweens can store one per pixel.
+-------------------------------------------------------------------------*/
+
+#include <stdint.h>
+
+enum EaseCurve : uint8_t
+{
+    EaseCurve_Linear,
+    EaseCurve_QuadraticIn,
+    EaseCurve_QuadraticOut,
+    EaseCurve_QuadraticInOut,
+    EaseCurve_CubicIn,
+    EaseCurve_CubicOut,
+    EaseCurve_QuarticInOut,
+    EaseCurve_QuinticIn,
+    EaseCurve_QuinticOut,
+    EaseCurve_ExponentialInOut,
+    EaseCurve_Count
+};
+
+#define EASE_TABLE_STEPS    128
+
+struct EaseTables
+{
+    uint16_t values[EaseCurve_Count][EASE_TABLE_STEPS + 1];
+
+    constexpr EaseTables() : values() {
+        for (uint8_t curve = 0; curve < EaseCurve_Count; curve++) {
+            for (uint16_t i = 0; i <= EASE_TABLE_STEPS; i++) {
+                double value = ease(curve, (double)i / EASE_TABLE_STEPS);
+                value = (value < 0.0) ? 0.0 : (value > 1.0) ? 1.0 : value;
+                values[curve][i] = (uint16_t)(value * 65535.0 + 0.5);
+            }
+        }
+    }
+
+    // the NeoEase formulas, in double so they can run at compile time
+    static constexpr double ease(uint8_t curve, double unit) {
+        switch (curve) {
+        case EaseCurve_QuadraticIn:
+            return unit * unit;
+        case EaseCurve_QuadraticOut:
+            return -unit * (unit - 2.0);
+        case EaseCurve_QuadraticInOut:
+            unit *= 2.0;
+            if (unit < 1.0) {
+                return 0.5 * unit * unit;
+            }
+            unit -= 1.0;
+            return -0.5 * (unit * (unit - 2.0) - 1.0);
+        case EaseCurve_CubicIn:
+            return unit * unit * unit;
+        case EaseCurve_CubicOut:
+            unit -= 1.0;
+            return unit * unit * unit + 1.0;
+        case EaseCurve_QuarticInOut:
+            unit *= 2.0;
+            if (unit < 1.0) {
+                return 0.5 * unit * unit * unit * unit;
+            }
+            unit -= 2.0;
+            return -0.5 * (unit * unit * unit * unit - 2.0);
+        case EaseCurve_QuinticIn:
+            return unit * unit * unit * unit * unit;
+        case EaseCurve_QuinticOut:
+            unit -= 1.0;
+            return unit * unit * unit * unit * unit + 1.0;
+        case EaseCurve_ExponentialInOut:
+            unit *= 2.0;
+            if (unit < 1.0) {
+                return 0.5 * pow2(10.0 * (unit - 1.0)) - 0.0005;
+            }
+            unit -= 1.0;
+            return 0.5 * 1.0005 * (-pow2(-10.0 * unit) + 2.0);
+        default:
+            return unit;
+        }
+    }
+
+    // 2^x for x <= 0, as the powf(2, x) of NeoEase
+    static constexpr double pow2(double x) {
+        double scale = 1.0;
+        while (x < 0.0) {
+            x += 1.0;
+            scale *= 0.5;
+        }
+        // e^(x ln 2) for x in [0, 1)
+        double term = 1.0;
+        double sum = 1.0;
+        for (int n = 1; n < 20; n++) {
+            term *= x * 0.6931471805599453 / n;
+            sum += term;
+        }
+        return scale * sum;
+    }
+};
+
+class EaseTable
+{
+public:
+    // 'unit' is clamped to 0.0 - 1.0
+    static float Ease(uint8_t curve, float unit) {
+        if (unit <= 0.0f) {
+            return Tables.values[curve][0] / 65535.0f;
+        }
+        if (unit >= 1.0f) {
+            return Tables.values[curve][EASE_TABLE_STEPS] / 65535.0f;
+        }
+        if (curve == EaseCurve_Linear) {
+            return unit;
+        }
+
+        float position = unit * EASE_TABLE_STEPS;
+        uint16_t index = (uint16_t)position;
+        float fraction = position - index;
+
+        const uint16_t* values = Tables.values[curve];
+        return (values[index] + (values[index + 1] - values[index]) * fraction) * (1.0f / 65535.0f);
+    }
+
+private:
+    static constexpr EaseTables Tables {};
+};
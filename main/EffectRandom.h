@@ -0,0 +1,51 @@
+#pragma once
+
+/*-------------------------------------------------------------------------
+EffectRandom is a small xorshift generator for the effects.
+
+esp_random() reads the hardware RNG register, which is slower than a few
+shifts and cannot be replayed. The effects draw their random numbers from
+an EffectRandom instead, seeded once when an effect is started, so the
+frames of a run follow from the seed alone.
+
+Not for anything that needs real randomness.
+-------------------------------------------------------------------------*/
+
+#include <stdint.h>
+
+class EffectRandom
+{
+public:
+    EffectRandom(uint32_t seed = 1) {
+        Seed(seed);
+    }
+
+    // xorshift never leaves 0, so 0 picks another seed
+    void Seed(uint32_t seed) {
+        _state = (seed != 0) ? seed : 0x9E3779B9;
+    }
+
+    // xorshift32 (Marsaglia), all 32 bits
+    uint32_t Next() {
+        uint32_t x = _state;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        _state = x;
+        return x;
+    }
+
+    // 0.0 <= value < 1.0
+    float Unit() {
+        // 24 bits, the precision of a float
+        return (Next() >> 8) * (1.0f / 16777216.0f);
+    }
+
+    // 0 <= value < bound, without a divide
+    uint32_t Below(uint32_t bound) {
+        return ((uint64_t)Next() * bound) >> 32;
+    }
+
+private:
+    uint32_t _state;
+};
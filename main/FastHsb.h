@@ -0,0 +1,154 @@
+#pragma once
+
+/*-------------------------------------------------------------------------
+FastHsb converts between RGB(W) and HSB in fixed point, for the per-pixel
+paths that would otherwise go through HsbColor's float maths.
+
+Hue is 16 bits (0..65535 is one turn, 0.0..1.0 in HsbColor), saturation
+and brightness are 8 bits. The divisions in RGB to HSB go through a
+256-entry reciprocal table; HSB to RGB only divides by 255 and 255 * 255,
+done as multiplies. Results are within 1 of the float conversion on every
+channel.
+
+ToRgbw() can also move the common part of R, G and B into the white
+channel.
+-------------------------------------------------------------------------*/
+
+#include <stdint.h>
+
+struct HsbColor16
+{
+    uint16_t H;
+    uint8_t S;
+    uint8_t B;
+};
+
+struct FastHsbTables
+{
+    uint32_t recip[256];     // 65536 / d, rounded
+
+    constexpr FastHsbTables() : recip() {
+        for (uint32_t d = 1; d < 256; d++) {
+            recip[d] = (65536 + d / 2) / d;
+        }
+    }
+};
+
+class FastHsb
+{
+public:
+    static RgbwColor ToRgbw(uint16_t hue, uint8_t saturation, uint8_t brightness, bool extractWhite = false) {
+        uint8_t r, g, b;
+
+        if (saturation == 0) {
+            r = g = b = brightness;
+        }
+        else {
+            uint32_t h6 = (uint32_t)hue * 6;
+            uint8_t sector = h6 >> 16;
+            uint32_t f = (h6 >> 8) & 0xff;
+
+            uint8_t v = brightness;
+            uint8_t p = Div255(v * (255 - saturation));
+            uint8_t q = Div65025(v * (65025 - saturation * f));
+            uint8_t t = Div65025(v * (65025 - saturation * (255 - f)));
+
+            switch (sector) {
+            case 0:
+                r = v; g = t; b = p;
+                break;
+            case 1:
+                r = q; g = v; b = p;
+                break;
+            case 2:
+                r = p; g = v; b = t;
+                break;
+            case 3:
+                r = p; g = q; b = v;
+                break;
+            case 4:
+                r = t; g = p; b = v;
+                break;
+            default:
+                r = v; g = p; b = q;
+                break;
+            }
+        }
+
+        if (extractWhite) {
+            uint8_t w = (r < g) ? ((r < b) ? r : b) : ((g < b) ? g : b);
+            return RgbwColor(r - w, g - w, b - w, w);
+        }
+        return RgbwColor(r, g, b, 0);
+    }
+
+    static RgbwColor ToRgbw(const HsbColor& color, bool extractWhite = false) {
+        return ToRgbw(HueToU16(color.H), UnitToU8(color.S), UnitToU8(color.B), extractWhite);
+    }
+
+    // ignores the white channel, as HsbColor(RgbColor(R, G, B)) does
+    static HsbColor16 FromRgb(const RgbwColor& color) {
+        uint8_t r = color.R;
+        uint8_t g = color.G;
+        uint8_t b = color.B;
+
+        uint8_t max = (r > g) ? ((r > b) ? r : b) : ((g > b) ? g : b);
+        uint8_t min = (r < g) ? ((r < b) ? r : b) : ((g < b) ? g : b);
+        uint8_t delta = max - min;
+
+        HsbColor16 hsb = { 0, 0, max };
+        if (delta == 0) {
+            return hsb;
+        }
+
+        uint32_t saturation = ((uint32_t)delta * 255 * Tables.recip[max] + 0x8000) >> 16;
+        hsb.S = (saturation > 255) ? 255 : saturation;
+
+        // position in sixths of a turn, 16 bit fraction
+        int32_t h6;
+        if (max == r) {
+            h6 = (g - b) * (int32_t)Tables.recip[delta];
+            if (h6 < 0) {
+                h6 += 6 << 16;
+            }
+        }
+        else if (max == g) {
+            h6 = (2 << 16) + (b - r) * (int32_t)Tables.recip[delta];
+        }
+        else {
+            h6 = (4 << 16) + (r - g) * (int32_t)Tables.recip[delta];
+        }
+        uint32_t hue = (uint32_t)h6 / 6;
+        hsb.H = (hue > 0xffff) ? 0 : hue;
+        return hsb;
+    }
+
+    static uint16_t HueToU16(float hue) {
+        // wrap into one turn as HsbColor does
+        if (hue < 0.0f) {
+            hue += 1.0f;
+        }
+        else if (hue >= 1.0f) {
+            hue -= 1.0f;
+        }
+        return hue * 65535.0f;
+    }
+
+    static uint8_t UnitToU8(float unit) {
+        return (unit <= 0.0f) ? 0 : (unit >= 1.0f) ? 255 : (uint8_t)(unit * 255.0f);
+    }
+
+private:
+    static constexpr FastHsbTables Tables {};
+
+    // x / 255 for x up to 255 * 255, and x / 65025 for x up to 255 * 65025, exactly.
+    // spelled out as multiplies: inlined into a large function, GCC can keep the
+    // divisor in a register and emit a hardware divide
+    static uint32_t Div255(uint32_t x) {
+        return (x * 32897) >> 23;
+    }
+
+    static uint32_t Div65025(uint32_t x) {
+        return ((uint64_t)x * 16909061) >> 40;
+    }
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+/*-------------------------------------------------------------------------
+FrameScheduler keeps a fixed frame interval using absolute deadlines, so
+the frame rate does not depend on the FreeRTOS tick rate or on how long a
+frame took to render.
+
+It only does the deadline arithmetic; the caller supplies the time (in
+microseconds, from esp_timer_get_time()) and does the waiting.
+-------------------------------------------------------------------------*/
+
+#include <stdint.h>
+
+class FrameScheduler
+{
+public:
+    void Begin(uint8_t fps, int64_t now_us) {
+        SetFrameRate(fps);
+        Resync(now_us);
+        _framesRendered = 0;
+        _framesSkipped = 0;
+    }
+
+    void SetFrameRate(uint8_t fps) {
+        if (fps == 0) {
+            fps = 1;
+        }
+        _fps = fps;
+        _intervalUs = 1000000 / fps;
+    }
+
+    uint8_t FrameRate() const {
+        return _fps;
+    }
+
+    int64_t FrameInterval() const {
+        return _intervalUs;
+    }
+
+    // after the strip has been idle, start counting deadlines again from now
+    // rather than counting every frame since as skipped
+    void Resync(int64_t now_us) {
+        _deadlineUs = now_us;
+    }
+
+    // microseconds until the next frame is due. 0 when it is due now
+    int64_t TimeToNextFrame(int64_t now_us) const {
+        return (_deadlineUs > now_us) ? (_deadlineUs - now_us) : 0;
+    }
+
+    // call as each frame starts rendering. if rendering ran late and one or more
+    // deadlines have already passed, those frames are skipped (and counted) rather
+    // than rendered back to back to catch up
+    void FrameStarted(int64_t now_us) {
+        if (now_us >= _deadlineUs + _intervalUs) {
+            uint32_t missed = (now_us - _deadlineUs) / _intervalUs;
+            _framesSkipped += missed;
+            _deadlineUs += (int64_t)missed * _intervalUs;
+        }
+        _deadlineUs += _intervalUs;
+        _framesRendered++;
+    }
+
+    uint32_t FramesRendered() const {
+        return _framesRendered;
+    }
+
+    uint32_t FramesSkipped() const {
+        return _framesSkipped;
+    }
+
+private:
+    uint8_t _fps = 1;
+    int64_t _intervalUs = 1000000;
+    int64_t _deadlineUs = 0;
+    uint32_t _framesRendered = 0;
+    uint32_t _framesSkipped = 0;
+};
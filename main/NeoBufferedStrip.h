@@ -0,0 +1,340 @@
+#pragma once
+
+/*-------------------------------------------------------------------------
+NeoBufferedStrip puts a back buffer in front of one or more NeoPixelBus
+outputs.
+
+The render task composes each frame into the back buffer (one RgbwColor
+per pixel) from the canvases the effects draw into (PixelCanvas). The
+transmitter never touches it, so GetPixelColor() returns the last frame
+without the bus having to copy its sending buffer back after every Show().
+
+The pixels are split into consecutive ranges, one per output. Each output
+has its own bus on its own GPIO and RMT channel, so all outputs are sent
+at the same time and the wire time is that of the longest output rather
+than of the whole strip.
+
+Show() waits for the previous frame to leave the wire, encodes the back
+buffer into the buses and starts every transmit without waiting for it.
+The next frame is rendered while this one is being sent. Completion is
+signalled by a one-shot esp_timer set to the wire time of the frame, and
+confirmed with NeoPixelBus::CanShow(). If the estimate is early, the rest
+is polled in microseconds; another semaphore wait would sleep a whole tick
+(10ms), a frame at the configured rates.
+
+FillSpan(), CopySpan(), ComposeSpan() and DarkenSpan() work on a contiguous
+range of pixels (a ring, from NeoDynamicRingTopology::getFirstPixelAtRing())
+with one bounds check, instead of one per pixel. Show() encodes a run of equal
+pixels once and copies the wire bytes for the rest of the run.
+
+The back buffer holds what the effects drew, at full scale. Brightness,
+gamma, white extraction and calibration are applied by the output stage
+(NeoOutputStage) as each pixel is encoded.
+
+Only writes that change a pixel mark the buffer dirty. Show() skips clean
+frames, but still resends at the keep-alive interval so a pixel corrupted
+by noise on the data line does not stay wrong.
+-------------------------------------------------------------------------*/
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_rom_sys.h"
+
+#include <string.h>
+
+#include "NeoOutputStage.h"
+
+// SK6812 runs at 800Kbps (10us per byte) and latches after 80us low
+#define NEO_WIRE_US_PER_BYTE    10
+#define NEO_WIRE_RESET_US       80
+
+// how often WaitShown() checks the outputs once the wire time is up
+#define NEO_WAIT_POLL_US        10
+
+// the ESP32 has 8 RMT channels
+#define NEO_MAX_OUTPUTS         8
+
+struct NeoStripOutput
+{
+    uint8_t pin;
+    uint16_t first;     // first pixel of the back buffer sent on this output
+    uint16_t count;
+};
+
+template <typename T_BUS> class NeoBufferedStrip
+{
+public:
+    // output i is sent on RMT channel i
+    NeoBufferedStrip(uint16_t countPixels, const NeoStripOutput* outputs, uint8_t countOutputs) :
+        _countPixels(countPixels),
+        _countOutputs(0),
+        _maxOutputPixels(0)
+    {
+        for (uint8_t i = 0; i < countOutputs && i < NEO_MAX_OUTPUTS; i++) {
+            // outputs must lie inside the back buffer
+            if (outputs[i].count == 0 || outputs[i].first + outputs[i].count > countPixels) {
+                continue;
+            }
+            _outputs[_countOutputs] = outputs[i];
+            _buses[_countOutputs] = new T_BUS(outputs[i].count, outputs[i].pin, (NeoBusChannel)_countOutputs);
+            if (outputs[i].count > _maxOutputPixels) {
+                _maxOutputPixels = outputs[i].count;
+            }
+            _countOutputs++;
+        }
+
+        _pixels = new RgbwColor[countPixels];
+        _txDone = xSemaphoreCreateBinary();
+
+        const esp_timer_create_args_t tx_timer_args = {
+            .callback = &txTimerCallback,
+            .arg = this,
+            .name = "neo_tx"
+        };
+        esp_timer_create(&tx_timer_args, &_txTimer);
+    }
+
+    ~NeoBufferedStrip() {
+        WaitShown();
+        esp_timer_stop(_txTimer);
+        esp_timer_delete(_txTimer);
+        vSemaphoreDelete(_txDone);
+        for (uint8_t i = 0; i < _countOutputs; i++) {
+            delete _buses[i];
+        }
+        delete[] _pixels;
+    }
+
+    void Begin() {
+        for (uint8_t i = 0; i < _countOutputs; i++) {
+            _buses[i]->Begin();
+        }
+        _dirty = true;
+    }
+
+    // 0 never resends an unchanged frame
+    void SetKeepAlive(uint32_t keepAliveMs) {
+        _keepAliveUs = (int64_t)keepAliveMs * 1000;
+    }
+
+    bool IsDirty() const {
+        return _dirty;
+    }
+
+    // true when the back buffer or the brightness changed, or nothing has been sent for the
+    // keep-alive interval
+    bool NeedsShow(int64_t now_us) const {
+        return _dirty || _stage.IsStale() || (_keepAliveUs != 0 && now_us - _lastShowUs >= _keepAliveUs);
+    }
+
+    // sends the frame if NeedsShow(). returns as soon as it has started transmitting,
+    // or false if it was skipped
+    bool Show() {
+        int64_t now = esp_timer_get_time();
+        if (!NeedsShow(now)) {
+            return false;
+        }
+
+        WaitShown();
+
+        _stage.Update();
+        for (uint8_t o = 0; o < _countOutputs; o++) {
+            encode(*_buses[o], _pixels + _outputs[o].first, _outputs[o].count);
+        }
+
+        // drop a completion left over from an earlier frame
+        xSemaphoreTake(_txDone, 0);
+
+        // encode everything first, then start the outputs back to back so they run together.
+        // the back buffer is the consistent copy, so the buses can swap without copying
+        for (uint8_t o = 0; o < _countOutputs; o++) {
+            _buses[o]->Show(false);
+        }
+
+        esp_timer_stop(_txTimer);
+        esp_timer_start_once(_txTimer, WireTimeUs());
+
+        _dirty = false;
+        _lastShowUs = now;
+        _framesSent++;
+        return true;
+    }
+
+    uint32_t FramesSent() const {
+        return _framesSent;
+    }
+
+    // true once the last frame has been sent on every output
+    bool CanShow() const {
+        for (uint8_t i = 0; i < _countOutputs; i++) {
+            if (!_buses[i]->CanShow()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // blocks until the last frame has been sent. sleeps until the tx timer says the wire
+    // time is up, then polls whatever the estimate was short by
+    void WaitShown() {
+        if (CanShow()) {
+            return;
+        }
+        // a tick over the wire time, in case the timer has been stopped
+        xSemaphoreTake(_txDone, pdMS_TO_TICKS(WireTimeUs() / 1000) + 1);
+        while (!CanShow()) {
+            esp_rom_delay_us(NEO_WAIT_POLL_US);
+        }
+    }
+
+    // the outputs are sent in parallel, so this is the wire time of the longest
+    uint32_t WireTimeUs() const {
+        if (_countOutputs == 0) {
+            return 0;
+        }
+        return _maxOutputPixels * _buses[0]->PixelSize() * NEO_WIRE_US_PER_BYTE + NEO_WIRE_RESET_US;
+    }
+
+    uint8_t OutputCount() const {
+        return _countOutputs;
+    }
+
+    const NeoStripOutput& Output(uint8_t indexOutput) const {
+        return _outputs[indexOutput];
+    }
+
+    uint16_t PixelCount() const {
+        return _countPixels;
+    }
+
+    NeoOutputStage& OutputStage() {
+        return _stage;
+    }
+
+    void SetPixelColor(uint16_t indexPixel, RgbwColor color) {
+        if (indexPixel < _countPixels && _pixels[indexPixel] != color) {
+            _pixels[indexPixel] = color;
+            _dirty = true;
+        }
+    }
+
+    RgbwColor GetPixelColor(uint16_t indexPixel) const {
+        if (indexPixel < _countPixels) {
+            return _pixels[indexPixel];
+        }
+        // out of bounds reads as black, as NeoPixelBus does
+        return RgbwColor(0);
+    }
+
+    void ClearTo(RgbwColor color) {
+        FillSpan(0, _countPixels, color);
+    }
+
+    void ClearTo(RgbwColor color, uint16_t first, uint16_t last) {
+        if (first <= last) {
+            FillSpan(first, last - first + 1, color);
+        }
+    }
+
+    // sets count pixels from first. a span running past the end is cut short
+    void FillSpan(uint16_t first, uint16_t count, RgbwColor color) {
+        count = clipSpan(first, count);
+        RgbwColor* pixels = _pixels + first;
+
+        // compare until the first change, then it is a plain store loop
+        uint16_t i = 0;
+        while (i < count && pixels[i] == color) {
+            i++;
+        }
+        if (i < count) {
+            _dirty = true;
+            for (; i < count; i++) {
+                pixels[i] = color;
+            }
+        }
+    }
+
+    // copies count pixels of pattern to first
+    void CopySpan(uint16_t first, const RgbwColor* pattern, uint16_t count) {
+        count = clipSpan(first, count);
+        if (count != 0 && memcmp(_pixels + first, pattern, count * sizeof(RgbwColor)) != 0) {
+            memcpy(_pixels + first, pattern, count * sizeof(RgbwColor));
+            _dirty = true;
+        }
+    }
+
+    // sets count pixels from first to source.Pixel(0) onwards, e.g. the layers of a
+    // PixelCompositor, in one pass
+    template <typename T_SOURCE> void ComposeSpan(uint16_t first, uint16_t count, const T_SOURCE& source) {
+        count = clipSpan(first, count);
+        RgbwColor* pixels = _pixels + first;
+        for (uint16_t i = 0; i < count; i++) {
+            RgbwColor color = source.Pixel(i);
+            if (color != pixels[i]) {
+                pixels[i] = color;
+                _dirty = true;
+            }
+        }
+    }
+
+    // RgbwColor::Darken() on count pixels from first
+    void DarkenSpan(uint16_t first, uint16_t count, uint8_t delta) {
+        count = clipSpan(first, count);
+        RgbwColor* pixels = _pixels + first;
+        for (uint16_t i = 0; i < count; i++) {
+            RgbwColor color = pixels[i];
+            color.Darken(delta);
+            if (color != pixels[i]) {
+                pixels[i] = color;
+                _dirty = true;
+            }
+        }
+    }
+
+private:
+    uint16_t clipSpan(uint16_t first, uint16_t count) const {
+        if (first >= _countPixels) {
+            return 0;
+        }
+        return (count > _countPixels - first) ? (_countPixels - first) : count;
+    }
+
+    // a ring fill is a run of equal pixels. only the first of a run goes through
+    // the output stage and is encoded, the rest copy the wire bytes of the pixel before
+    void encode(T_BUS& bus, const RgbwColor* pixels, uint16_t count) const {
+        uint8_t* data = bus.Pixels();
+        const size_t size = bus.PixelSize();
+
+        bus.SetPixelColor(0, _stage.Apply(pixels[0]));
+        for (uint16_t i = 1; i < count; i++) {
+            if (pixels[i] == pixels[i - 1]) {
+                memcpy(data + i * size, data + (i - 1) * size, size);
+            } else {
+                bus.SetPixelColor(i, _stage.Apply(pixels[i]));
+            }
+        }
+    }
+
+    static void txTimerCallback(void* arg) {
+        NeoBufferedStrip* self = (NeoBufferedStrip*)arg;
+        xSemaphoreGive(self->_txDone);
+    }
+
+    const uint16_t _countPixels;
+    RgbwColor* _pixels;
+    NeoOutputStage _stage;
+
+    T_BUS* _buses[NEO_MAX_OUTPUTS];
+    NeoStripOutput _outputs[NEO_MAX_OUTPUTS];
+    uint8_t _countOutputs;
+    uint16_t _maxOutputPixels;
+
+    bool _dirty = true;
+    int64_t _keepAliveUs = 0;
+    int64_t _lastShowUs = 0;
+    uint32_t _framesSent = 0;
+
+    SemaphoreHandle_t _txDone;
+    esp_timer_handle_t _txTimer;
+};
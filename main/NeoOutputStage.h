@@ -0,0 +1,119 @@
+#pragma once
+
+/*-------------------------------------------------------------------------
+NeoOutputStage turns the colours the effects draw into the colours sent on
+the wire: white extraction, then global brightness, per-channel calibration
+and gamma through one 256-entry table per channel.
+
+Effects draw at full scale and never apply brightness or gamma themselves.
+The tables depend only on the brightness, gamma and calibration, so they
+are rebuilt when one of those changes instead of every frame, and applying
+the stage is four table lookups per pixel.
+
+SetBrightness() may be called from any task. The new brightness is picked
+up by Update(), which the render task calls before encoding a frame.
+-------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <math.h>
+#include <atomic>
+
+#define NEO_OUTPUT_DEFAULT_GAMMA        22      // tenths
+#define NEO_OUTPUT_DEFAULT_WHITE        204     // the white LED at 80%, as FadeAnimationSet used
+
+class NeoOutputStage
+{
+public:
+    NeoOutputStage() :
+        _brightness(100),
+        _tableBrightness(0xff),
+        _whiteExtract(true)
+    {
+        uint8_t calibration[4] = { 255, 255, 255, NEO_OUTPUT_DEFAULT_WHITE };
+        SetCalibration(calibration);
+        SetGamma(NEO_OUTPUT_DEFAULT_GAMMA);
+    }
+
+    // 0..100
+    void SetBrightness(uint8_t brightness) {
+        _brightness = (brightness > 100) ? 100 : brightness;
+    }
+
+    uint8_t Brightness() const {
+        return _brightness;
+    }
+
+    // in tenths, 22 is a gamma of 2.2. 10 turns gamma correction off
+    void SetGamma(uint8_t gamma) {
+        for (uint16_t v = 0; v < 256; v++) {
+            _gamma[v] = (uint16_t)(65535.0f * powf(v / 255.0f, gamma / 10.0f) + 0.5f);
+        }
+        _tableBrightness = 0xff;
+    }
+
+    // scales R, G, B and W before gamma, 255 is full
+    void SetCalibration(const uint8_t calibration[4]) {
+        for (uint8_t c = 0; c < 4; c++) {
+            _calibration[c] = calibration[c];
+        }
+        _tableBrightness = 0xff;
+    }
+
+    // moves the common part of R, G and B to the white LED
+    void SetWhiteExtraction(bool whiteExtract) {
+        _whiteExtract = whiteExtract;
+    }
+
+    // true when the tables do not match the settings yet
+    bool IsStale() const {
+        return _tableBrightness != _brightness;
+    }
+
+    // rebuilds the tables if a setting changed. returns true if it did
+    bool Update() {
+        uint8_t brightness = _brightness;
+        if (brightness == _tableBrightness) {
+            return false;
+        }
+
+        for (uint8_t c = 0; c < 4; c++) {
+            uint32_t scale = brightness * _calibration[c];
+
+            for (uint16_t v = 0; v < 256; v++) {
+                // position in the gamma table in 8.8, v * brightness/100 * calibration/255
+                uint32_t position = v * scale * 256 / 25500;
+                uint32_t index = position >> 8;
+                uint32_t fraction = position & 0xff;
+
+                uint32_t gamma = _gamma[index];
+                if (index < 255) {
+                    gamma += ((_gamma[index + 1] - gamma) * fraction) >> 8;
+                }
+                _table[c][v] = (gamma * 255 + 32767) / 65535;
+            }
+        }
+
+        _tableBrightness = brightness;
+        return true;
+    }
+
+    RgbwColor Apply(RgbwColor color) const {
+        if (_whiteExtract) {
+            uint8_t white = (color.R < color.G) ? ((color.R < color.B) ? color.R : color.B) : ((color.G < color.B) ? color.G : color.B);
+            color.R -= white;
+            color.G -= white;
+            color.B -= white;
+            color.W = (color.W + white > 255) ? 255 : color.W + white;
+        }
+        return RgbwColor(_table[0][color.R], _table[1][color.G], _table[2][color.B], _table[3][color.W]);
+    }
+
+private:
+    std::atomic<uint8_t> _brightness;
+    uint8_t _tableBrightness;       // 0xff forces a rebuild
+    bool _whiteExtract;
+    uint8_t _calibration[4];
+
+    uint16_t _gamma[256];           // v^gamma, 0..65535
+    uint8_t _table[4][256];         // R, G, B, W
+};
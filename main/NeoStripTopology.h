@@ -98,6 +98,18 @@ public:
         return T_LAYOUT::Rings[ring + 1] - T_LAYOUT::Rings[ring]; // using the extra value for count calc
     }
 
+    // the pixels of a ring are contiguous, so a ring is the span
+    // getFirstPixelAtRing(ring) .. + getPixelCountAtRing(ring)
+    uint16_t getFirstPixelAtRing(uint8_t ring) const
+    {
+        if (ring >= getCountOfRings())
+        {
+            return getPixelCount(); // invalid, out of bounds
+        }
+
+        return T_LAYOUT::Rings[ring];
+    }
+
     uint16_t getPixelCount() const
     {
         return T_LAYOUT::Rings[T_LAYOUT::_ringCount() - 1]; // the last entry is the total count
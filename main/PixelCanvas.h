@@ -0,0 +1,84 @@
+#pragma once
+
+/*-------------------------------------------------------------------------
+PixelCanvas is a pixel buffer an effect draws into, one RgbwColor per
+pixel, with the drawing calls of NeoBufferedStrip.
+
+Each running effect has its own canvas, so an effect reading back what it
+drew last frame (the Cylon trails, the Flicker start colours) sees only
+its own pixels. The render task composes the canvases into the strip's
+back buffer once per frame: a copy of one, or a blend of two while one
+effect crossfades into the next.
+-------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <string.h>
+
+class PixelCanvas
+{
+public:
+    PixelCanvas(uint16_t countPixels) :
+        _countPixels(countPixels)
+    {
+        _pixels = new RgbwColor[countPixels];
+    }
+
+    ~PixelCanvas() {
+        delete[] _pixels;
+    }
+
+    uint16_t PixelCount() const {
+        return _countPixels;
+    }
+
+    const RgbwColor* Pixels() const {
+        return _pixels;
+    }
+
+    void SetPixelColor(uint16_t indexPixel, RgbwColor color) {
+        if (indexPixel < _countPixels) {
+            _pixels[indexPixel] = color;
+        }
+    }
+
+    RgbwColor GetPixelColor(uint16_t indexPixel) const {
+        if (indexPixel < _countPixels) {
+            return _pixels[indexPixel];
+        }
+        // out of bounds reads as black, as NeoPixelBus does
+        return RgbwColor(0);
+    }
+
+    void ClearTo(RgbwColor color) {
+        FillSpan(0, _countPixels, color);
+    }
+
+    // sets count pixels from first. a span running past the end is cut short
+    void FillSpan(uint16_t first, uint16_t count, RgbwColor color) {
+        count = clipSpan(first, count);
+        RgbwColor* pixels = _pixels + first;
+        for (uint16_t i = 0; i < count; i++) {
+            pixels[i] = color;
+        }
+    }
+
+    // RgbwColor::Darken() on count pixels from first
+    void DarkenSpan(uint16_t first, uint16_t count, uint8_t delta) {
+        count = clipSpan(first, count);
+        RgbwColor* pixels = _pixels + first;
+        for (uint16_t i = 0; i < count; i++) {
+            pixels[i].Darken(delta);
+        }
+    }
+
+private:
+    uint16_t clipSpan(uint16_t first, uint16_t count) const {
+        if (first >= _countPixels) {
+            return 0;
+        }
+        return (count > _countPixels - first) ? (_countPixels - first) : count;
+    }
+
+    const uint16_t _countPixels;
+    RgbwColor* _pixels;
+};
@@ -0,0 +1,137 @@
+#pragma once
+
+/*-------------------------------------------------------------------------
+PixelCompositor stacks the canvases of several effects into one frame.
+
+Each layer is a row of pixels (a PixelCanvas), an opacity and a blend
+mode. Pixel() composes every layer for one pixel, bottom first over
+black, so the strip is written in one pass whatever the number of layers
+instead of one full-strip loop per layer:
+
+    blended = mode(below, layer)
+    result  = below + (blended - below) * opacity
+
+Normal takes the layer's colour, Add sums the channels (clipped at full),
+Screen brightens as two projectors on one wall would (1 - (1-a)(1-b)) and
+Max keeps the brighter of each channel. Opacity is out of 256, so 256 is
+opaque and a crossfade is the incoming layer in Normal at its progress.
+
+SetLevel() dims the composed pixel as a whole, after the blends, for a
+zone whose brightness the output stage cannot apply as the zones share it.
+
+The layers are set again each frame; Add() only keeps a pointer to the
+pixels.
+-------------------------------------------------------------------------*/
+
+#include <stdint.h>
+
+enum PixelBlend
+{
+    PixelBlend_Normal,
+    PixelBlend_Add,
+    PixelBlend_Screen,
+    PixelBlend_Max,
+    PixelBlend_Count
+};
+
+template <uint8_t V_MAX_LAYERS> class PixelCompositor
+{
+public:
+    void Clear() {
+        _countLayers = 0;
+        _level = 256;
+    }
+
+    // 'level' out of 256, applied to the result of every layer
+    void SetLevel(uint16_t level) {
+        _level = level > 256 ? 256 : level;
+    }
+
+    // 'opacity' out of 256. a layer that would not show is left out
+    void Add(const RgbwColor* pixels, uint16_t opacity, PixelBlend blend) {
+        if (_countLayers == V_MAX_LAYERS || opacity == 0) {
+            return;
+        }
+        _layers[_countLayers++] = { pixels, opacity > 256 ? (uint16_t)256 : opacity, blend };
+    }
+
+    uint8_t LayerCount() const {
+        return _countLayers;
+    }
+
+    // true when the frame is just the bottom layer, which can be copied as it is
+    bool IsCopy() const {
+        return _countLayers == 1 && _layers[0].opacity == 256 && _layers[0].blend == PixelBlend_Normal && _level == 256;
+    }
+
+    const RgbwColor* Bottom() const {
+        return _layers[0].pixels;
+    }
+
+    RgbwColor Pixel(uint16_t indexPixel) const {
+        RgbwColor color(0);
+        for (uint8_t i = 0; i < _countLayers; i++) {
+            const Layer& layer = _layers[i];
+            RgbwColor blended = Blend(layer.blend, color, layer.pixels[indexPixel]);
+            if (layer.opacity == 256) {
+                color = blended;
+            }
+            else {
+                color = RgbwColor(Mix(color.R, blended.R, layer.opacity), Mix(color.G, blended.G, layer.opacity),
+                    Mix(color.B, blended.B, layer.opacity), Mix(color.W, blended.W, layer.opacity));
+            }
+        }
+        if (_level != 256) {
+            color = RgbwColor(color.R * _level >> 8, color.G * _level >> 8, color.B * _level >> 8, color.W * _level >> 8);
+        }
+        return color;
+    }
+
+private:
+    struct Layer
+    {
+        const RgbwColor* pixels;
+        uint16_t opacity;
+        PixelBlend blend;
+    };
+
+    Layer _layers[V_MAX_LAYERS];
+    uint8_t _countLayers = 0;
+    uint16_t _level = 256;
+
+    // one switch per layer and pixel, not per channel
+    static RgbwColor Blend(PixelBlend blend, RgbwColor below, RgbwColor above) {
+        switch (blend) {
+        case PixelBlend_Add:
+            return RgbwColor(Add(below.R, above.R), Add(below.G, above.G), Add(below.B, above.B), Add(below.W, above.W));
+        case PixelBlend_Screen:
+            return RgbwColor(Screen(below.R, above.R), Screen(below.G, above.G), Screen(below.B, above.B), Screen(below.W, above.W));
+        case PixelBlend_Max:
+            return RgbwColor(Max(below.R, above.R), Max(below.G, above.G), Max(below.B, above.B), Max(below.W, above.W));
+        default:
+            return above;
+        }
+    }
+
+    static uint8_t Add(uint8_t a, uint8_t b) {
+        uint16_t sum = a + b;
+        return sum > 255 ? 255 : sum;
+    }
+
+    static uint8_t Screen(uint8_t a, uint8_t b) {
+        return 255 - Div255((255 - a) * (255 - b));
+    }
+
+    static uint8_t Max(uint8_t a, uint8_t b) {
+        return a > b ? a : b;
+    }
+
+    // exact x / 255 for 0 <= x <= 255 * 255
+    static uint8_t Div255(uint16_t x) {
+        return (x + 1 + (x >> 8)) >> 8;
+    }
+
+    static uint8_t Mix(uint8_t below, uint8_t blended, uint16_t opacity) {
+        return (below * (256 - opacity) + blended * opacity) >> 8;
+    }
+};
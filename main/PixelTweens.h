@@ -0,0 +1,106 @@
+#pragma once
+
+/*-------------------------------------------------------------------------
+PixelTweens blends every pixel from a start colour to a target colour,
+each with its own easing, start time and duration.
+
+It replaces one NeoPixelAnimator slot (and one std::function) per pixel
+with flat arrays, 13 bytes per pixel, allocated once for the strip and
+advanced by a single loop per frame. Re-arming is just Set() on each
+pixel, so it never allocates.
+
+Easing is a lookup in EaseTable, so a pixel costs the same whichever curve
+it uses.
+
+Times are milliseconds from the start of the cycle. The caller drives the
+cycle, usually from one NeoPixelAnimator slot lasting Period().
+-------------------------------------------------------------------------*/
+
+#include <stdint.h>
+
+#include "EaseTable.h"
+
+class PixelTweens
+{
+public:
+    PixelTweens(uint16_t countPixels) :
+        _countPixels(countPixels),
+        _periodMs(0)
+    {
+        _startColor = new RgbwColor[countPixels];
+        _targetColor = new RgbwColor[countPixels];
+        _easing = new uint8_t[countPixels];
+        _startMs = new uint16_t[countPixels];
+        _durationMs = new uint16_t[countPixels];
+        for (uint16_t i = 0; i < countPixels; i++) {
+            Set(i, RgbwColor(0), RgbwColor(0), EaseCurve_Linear, 0, 0);
+        }
+    }
+
+    ~PixelTweens() {
+        delete[] _startColor;
+        delete[] _targetColor;
+        delete[] _easing;
+        delete[] _startMs;
+        delete[] _durationMs;
+    }
+
+    uint16_t PixelCount() const {
+        return _countPixels;
+    }
+
+    // call before setting up a new cycle
+    void Clear() {
+        _periodMs = 0;
+    }
+
+    void Set(uint16_t pixel, RgbwColor startColor, RgbwColor targetColor, EaseCurve easing, uint16_t startMs, uint16_t durationMs) {
+        if (pixel >= _countPixels) {
+            return;
+        }
+        _startColor[pixel] = startColor;
+        _targetColor[pixel] = targetColor;
+        _easing[pixel] = easing;
+        _startMs[pixel] = startMs;
+        _durationMs[pixel] = durationMs;
+
+        if (startMs + durationMs > _periodMs) {
+            _periodMs = startMs + durationMs;
+        }
+    }
+
+    // when the last tween set since Clear() ends
+    uint32_t Period() const {
+        return _periodMs;
+    }
+
+    // writes every pixel for 'elapsedMs' into the cycle
+    template <typename T_STRIP> void Update(T_STRIP& strip, uint32_t elapsedMs) const {
+        for (uint16_t i = 0; i < _countPixels; i++) {
+            RgbwColor color;
+
+            if (elapsedMs <= _startMs[i]) {
+                color = _startColor[i];
+            }
+            else if (elapsedMs >= (uint32_t)_startMs[i] + _durationMs[i]) {
+                color = _targetColor[i];
+            }
+            else {
+                float progress = EaseTable::Ease(_easing[i], (float)(elapsedMs - _startMs[i]) / _durationMs[i]);
+                color = RgbwColor::LinearBlend(_startColor[i], _targetColor[i], progress);
+            }
+
+            strip.SetPixelColor(i, color);
+        }
+    }
+
+private:
+    const uint16_t _countPixels;
+    uint32_t _periodMs;
+
+    RgbwColor* _startColor;
+    RgbwColor* _targetColor;
+    uint8_t* _easing;
+    uint16_t* _startMs;
+    uint16_t* _durationMs;
+};
@@ -0,0 +1,140 @@
+#pragma once
+
+/*-------------------------------------------------------------------------
+RingFades moves the colour of each ring towards a target that can change
+while it is moving.
+
+SetTarget() on a ring that is still fading starts a straight line from
+wherever the ring is at that moment to the new target, so a HomeKit
+slider drag bends the fade instead of restarting it. Rings move at a slew
+rate: a full-scale change takes 'fullScaleMs', a smaller one takes that
+much less. A ring at rest can be given a delay before it starts moving;
+a ring already waiting or moving keeps going, so a directional fade is
+not held back by every write of a drag.
+
+Times are milliseconds, from any clock that only moves forwards. The
+caller draws Current() once Update() has advanced to the frame time.
+-------------------------------------------------------------------------*/
+
+#include <stdint.h>
+
+class RingFades
+{
+public:
+    RingFades(uint8_t countRings) :
+        _countRings(countRings)
+    {
+        _fromColor = new RgbwColor[countRings];
+        _toColor = new RgbwColor[countRings];
+        _currentColor = new RgbwColor[countRings];
+        _startMs = new uint32_t[countRings];
+        _durationMs = new uint16_t[countRings];
+        for (uint8_t i = 0; i < countRings; i++) {
+            SetCurrent(i, RgbwColor(0));
+        }
+    }
+
+    ~RingFades() {
+        delete[] _fromColor;
+        delete[] _toColor;
+        delete[] _currentColor;
+        delete[] _startMs;
+        delete[] _durationMs;
+    }
+
+    uint8_t RingCount() const {
+        return _countRings;
+    }
+
+    // puts a ring at rest on 'color', e.g. what the strip shows after an effect
+    void SetCurrent(uint8_t ring, RgbwColor color) {
+        if (ring >= _countRings) {
+            return;
+        }
+        _fromColor[ring] = color;
+        _toColor[ring] = color;
+        _currentColor[ring] = color;
+        _startMs[ring] = 0;
+        _durationMs[ring] = 0;
+    }
+
+    void SetTarget(uint8_t ring, RgbwColor target, uint32_t nowMs, uint16_t delayMs, uint16_t fullScaleMs) {
+        if (ring >= _countRings) {
+            return;
+        }
+        RgbwColor current = ColorAt(ring, nowMs);
+
+        if (!InFlight(ring, nowMs)) {
+            _startMs[ring] = nowMs + delayMs;
+        }
+        else if (!Before(nowMs, _startMs[ring])) {
+            _startMs[ring] = nowMs;
+        }
+        // else still waiting, keep the rest of the delay
+        _fromColor[ring] = current;
+        _toColor[ring] = target;
+        _durationMs[ring] = (uint32_t)Distance(current, target) * fullScaleMs / 255;
+    }
+
+    // advances every ring to 'nowMs'. false once they have all reached their targets
+    bool Update(uint32_t nowMs) {
+        bool active = false;
+        for (uint8_t i = 0; i < _countRings; i++) {
+            _currentColor[i] = ColorAt(i, nowMs);
+            if (InFlight(i, nowMs)) {
+                active = true;
+            }
+            else {
+                _fromColor[i] = _toColor[i];
+            }
+        }
+        return active;
+    }
+
+    RgbwColor Current(uint8_t ring) const {
+        return _currentColor[ring];
+    }
+
+    // the largest change of any channel, so no channel moves faster than
+    // the slew rate. TransitionMap measures its fades by it too
+    static uint8_t Distance(RgbwColor a, RgbwColor b) {
+        uint8_t r = a.R > b.R ? a.R - b.R : b.R - a.R;
+        uint8_t g = a.G > b.G ? a.G - b.G : b.G - a.G;
+        uint8_t bl = a.B > b.B ? a.B - b.B : b.B - a.B;
+        uint8_t w = a.W > b.W ? a.W - b.W : b.W - a.W;
+        uint8_t max = r > g ? r : g;
+        max = max > bl ? max : bl;
+        return max > w ? max : w;
+    }
+
+private:
+    const uint8_t _countRings;
+
+    RgbwColor* _fromColor;
+    RgbwColor* _toColor;
+    RgbwColor* _currentColor;
+    uint32_t* _startMs;
+    uint16_t* _durationMs;
+
+    // a ring is at rest once its start colour is its target, so the times of rings
+    // at rest are never compared and may be as old as they like
+    bool InFlight(uint8_t ring, uint32_t nowMs) const {
+        return _fromColor[ring] != _toColor[ring] && Before(nowMs, _startMs[ring] + _durationMs[ring]);
+    }
+
+    // wrap-safe a < b
+    static bool Before(uint32_t a, uint32_t b) {
+        return (int32_t)(a - b) < 0;
+    }
+
+    RgbwColor ColorAt(uint8_t ring, uint32_t nowMs) const {
+        if (!InFlight(ring, nowMs)) {
+            return _toColor[ring];
+        }
+        if (Before(nowMs, _startMs[ring])) {
+            return _fromColor[ring];
+        }
+        uint32_t elapsedMs = nowMs - _startMs[ring];
+        return RgbwColor::LinearBlend(_fromColor[ring], _toColor[ring], (float)elapsedMs / _durationMs[ring]);
+    }
+};
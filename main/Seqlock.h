@@ -0,0 +1,74 @@
+#pragma once
+
+/*-------------------------------------------------------------------------
+Seqlock shares a small block of values with a reader that must never
+wait for the writer.
+
+The writer bumps a sequence number to odd, stores the block and bumps it
+back to even. The reader copies the block and keeps the copy only if the
+sequence was even and unchanged across the copy. The block is stored as
+words of std::atomic, so a copy racing a write is torn but never
+undefined.
+
+Writers must be serialised by the caller. TryRead() gives up after a few
+attempts rather than spin on a writer it has preempted; the reader keeps
+the copy it had, and picks up the write on its next read.
+-------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+template <typename T> class Seqlock
+{
+public:
+    Seqlock(const T& value) {
+        Write(value);
+    }
+
+    // one writer at a time
+    void Write(const T& value) {
+        uint32_t words[Words] = {};
+        memcpy(words, &value, sizeof(T));
+
+        uint32_t seq = _seq.load(std::memory_order_relaxed);
+        _seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < Words; i++) {
+            _words[i].store(words[i], std::memory_order_relaxed);
+        }
+        _seq.store(seq + 2, std::memory_order_release);
+    }
+
+    // false, leaving 'value' alone, if every attempt raced a write
+    bool TryRead(T& value) const {
+        uint32_t words[Words];
+        for (int attempt = 0; attempt < MaxAttempts; attempt++) {
+            uint32_t before = _seq.load(std::memory_order_acquire);
+            if (before & 1) {
+                continue;
+            }
+            for (size_t i = 0; i < Words; i++) {
+                words[i] = _words[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (_seq.load(std::memory_order_relaxed) == before) {
+                memcpy(&value, words, sizeof(T));
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // even, and moves on by 2 with every write
+    uint32_t Sequence() const {
+        return _seq.load(std::memory_order_acquire);
+    }
+
+private:
+    static const size_t Words = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+    static const int MaxAttempts = 4;
+
+    std::atomic<uint32_t> _seq {0};
+    std::atomic<uint32_t> _words[Words];
+};
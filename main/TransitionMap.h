@@ -0,0 +1,180 @@
+#pragma once
+
+/*-------------------------------------------------------------------------
+TransitionMap holds the order in which the pixels of a zone take part in
+a fade, worked out once per style rather than every frame.
+
+Styles that move whole rings (up, down, centre out) give each ring a rank;
+RingDelay() spreads the rings' start times over the fade by rank, and the
+fade itself runs in RingFades, a ring at a time.
+
+Styles that move pixels within a ring (around each ring, diagonally, a
+random dissolve) give each pixel a phase from 0 (first) to 255 (last).
+Start() takes the colour every pixel shows from SetFrom() and the target,
+and every frame Update() only does, per pixel,
+
+    amount = clamp(2 * progress - phase)
+    pixel  = from + (target - from) * amount
+
+so each pixel takes half the fade and the last starts halfway through.
+The fade's length follows the largest change of any pixel, as RingFades
+does for a ring. A new Start() while it runs carries on from what the
+pixels show, passed in again through SetFrom().
+-------------------------------------------------------------------------*/
+
+#include <stdint.h>
+
+#include "EffectRandom.h"
+#include "RingFades.h"
+
+// in the order of the Remote Switch ID characteristic
+enum TransitionStyle
+{
+    TransitionStyle_Uniform,
+    TransitionStyle_Up,             // the first ring first
+    TransitionStyle_Down,           // the last ring first
+    TransitionStyle_CenterOut,      // the middle ring first
+    TransitionStyle_Around,         // from the first pixel of each ring to its last
+    TransitionStyle_Diagonal,       // the first pixel of the first ring to the last of the last
+    TransitionStyle_Dissolve,       // pixels in a random order
+    TransitionStyle_Count
+};
+
+class TransitionMap
+{
+public:
+    TransitionMap(uint8_t countRings, uint16_t countPixels) :
+        _countRings(countRings),
+        _countPixels(countPixels)
+    {
+        _ringRank = new uint8_t[countRings];
+        _phase = new uint8_t[countPixels];
+        _from = new RgbwColor[countPixels];
+    }
+
+    ~TransitionMap() {
+        delete[] _ringRank;
+        delete[] _phase;
+        delete[] _from;
+    }
+
+    // works out the order of 'style' over the rings of 'topology', unless it is the one
+    // already built. a dissolve draws its order from 'random'
+    template <typename T_TOPOLOGY> void Build(TransitionStyle style, const T_TOPOLOGY& topology, EffectRandom& random) {
+        if (style == _style || style >= TransitionStyle_Count) {
+            return;
+        }
+        _style = style;
+        _maxRank = 0;
+
+        uint8_t last = _countRings - 1;
+        for (uint8_t j = 0; j < _countRings; j++) {
+            uint8_t rank = 0;
+            if (style == TransitionStyle_Up) {
+                rank = j;
+            }
+            else if (style == TransitionStyle_Down) {
+                rank = last - j;
+            }
+            else if (style == TransitionStyle_CenterOut) {
+                // twice the distance from the middle, which falls between two rings of an even count
+                rank = 2 * j > last ? 2 * j - last : last - 2 * j;
+            }
+            _ringRank[j] = rank;
+            _maxRank = rank > _maxRank ? rank : _maxRank;
+        }
+        _minRank = _maxRank;
+        for (uint8_t j = 0; j < _countRings; j++) {
+            _minRank = _ringRank[j] < _minRank ? _ringRank[j] : _minRank;
+        }
+
+        for (uint8_t j = 0; j < _countRings && IsPerPixel(); j++) {
+            uint16_t first = topology.getFirstPixelAtRing(j);
+            uint16_t count = topology.getPixelCountAtRing(j);
+            uint8_t ringPhase = _countRings > 1 ? 255 * j / last : 0;
+            for (uint16_t i = 0; i < count && first + i < _countPixels; i++) {
+                uint8_t around = 255 * i / count;
+                switch (style) {
+                case TransitionStyle_Around:
+                    _phase[first + i] = around;
+                    break;
+                case TransitionStyle_Diagonal:
+                    _phase[first + i] = (ringPhase + around) / 2;
+                    break;
+                default:
+                    _phase[first + i] = random.Below(256);
+                    break;
+                }
+            }
+        }
+    }
+
+    TransitionStyle Style() const {
+        return _style;
+    }
+
+    // true when the pixels of a ring start at different times, so the fade runs per pixel
+    bool IsPerPixel() const {
+        return _style >= TransitionStyle_Around;
+    }
+
+    // how long after the first ring 'ring' starts, with the last starting 'spreadMs' in
+    uint16_t RingDelay(uint8_t ring, uint16_t spreadMs) const {
+        if (ring >= _countRings || _maxRank == _minRank) {
+            return 0;
+        }
+        return (uint32_t)spreadMs * (_ringRank[ring] - _minRank) / (_maxRank - _minRank);
+    }
+
+    // what 'pixel' shows as the fade starts
+    void SetFrom(uint16_t pixel, RgbwColor color) {
+        if (pixel < _countPixels) {
+            _from[pixel] = color;
+        }
+    }
+
+    // fades every pixel from SetFrom() to 'target'. a full-scale change takes 'fullScaleMs'
+    void Start(RgbwColor target, uint32_t nowMs, uint16_t fullScaleMs) {
+        uint8_t distance = 0;
+        for (uint16_t i = 0; i < _countPixels; i++) {
+            uint8_t d = RingFades::Distance(_from[i], target);
+            distance = d > distance ? d : distance;
+        }
+        _target = target;
+        _startMs = nowMs;
+        _durationMs = (uint32_t)distance * fullScaleMs / 255;
+    }
+
+    // draws every pixel at 'nowMs'. false once they have all reached the target
+    template <typename T_CANVAS> bool Update(uint32_t nowMs, T_CANVAS& canvas) const {
+        uint32_t elapsedMs = nowMs - _startMs;
+        uint16_t progress = elapsedMs >= _durationMs ? 256 : elapsedMs * 256 / _durationMs;
+        for (uint16_t i = 0; i < _countPixels; i++) {
+            int16_t amount = 2 * progress - _phase[i];
+            amount = amount < 0 ? 0 : (amount > 256 ? 256 : amount);
+            canvas.SetPixelColor(i, Mix(_from[i], _target, amount));
+        }
+        return progress < 256;
+    }
+
+private:
+    const uint8_t _countRings;
+    const uint16_t _countPixels;
+
+    TransitionStyle _style = TransitionStyle_Count;
+    uint8_t* _ringRank;
+    uint8_t _minRank = 0;
+    uint8_t _maxRank = 0;
+    uint8_t* _phase;
+
+    RgbwColor* _from;
+    RgbwColor _target;
+    uint32_t _startMs = 0;
+    uint32_t _durationMs = 0;
+
+    // 'amount' out of 256
+    static RgbwColor Mix(RgbwColor from, RgbwColor to, uint16_t amount) {
+        return RgbwColor((from.R * (256 - amount) + to.R * amount) >> 8, (from.G * (256 - amount) + to.G * amount) >> 8,
+            (from.B * (256 - amount) + to.B * amount) >> 8, (from.W * (256 - amount) + to.W * amount) >> 8);
+    }
+};
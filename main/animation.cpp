@@ -1,10 +1,17 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 
 #include <sys/param.h>   
+#include <inttypes.h>
+#include <math.h>
 #include <atomic>                       // note: this is a cpp file, so use <atomic>, not <stdatomic.h>
+#include <assert.h>
 
 #include "nvs_flash.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"                    // esp_cpu_get_cycle_count
+#include "esp_rom_sys.h"                // esp_rom_get_cpu_ticks_per_us
 
 #include "esp_log.h"
 static const char *TAG = "anim";
@@ -12,9 +19,36 @@ static const char *TAG = "anim";
 #include <NeoPixelBus.h>
 #include <NeoPixelAnimator.h>
 #include "NeoStripTopology.h"
+#include "FrameScheduler.h"
+#include "NeoBufferedStrip.h"
+#include "PixelTweens.h"
+#include "PixelCanvas.h"
+#include "PixelCompositor.h"
+#include "RingFades.h"
+#include "TransitionMap.h"
+#include "EaseTable.h"
+#include "FastHsb.h"
+#include "EffectRandom.h"
+#include "CommandMailbox.h"
+#include "Seqlock.h"
 
 #include "esp_random.h"
 #include "animation.h"
+#include "latency_trace.h"
+
+// where a pixel is, each 0-255, worked out once from the layout so a spatial effect is one
+// pass over the pixels with no float or ring loops. x/y are of concentric rings, or uploaded
+// to pixel_coords for an irregular install; angle and radius follow from them. step and
+// position are the ring and the place along it, the height and position on a staircase
+struct PixelCoord
+{
+    uint8_t x;
+    uint8_t y;
+    uint8_t angle;              // around the centre, 256 a full turn
+    uint8_t radius;             // from the centre, 255 the outermost ring
+    uint8_t step;               // 0 the first ring, 255 the last
+    uint8_t position;           // along the ring from its first pixel, 256 all the way
+};
 
 class MyRingsLayout 
 {
@@ -40,12 +74,15 @@ public:
                 if (err == ESP_OK) {
                     RingCount = num_rings + 1;
 
+                    // Begin() is called again whenever the animation task is restarted
+                    delete[] Rings;
                     Rings = new uint16_t[RingCount];
                     Rings[0] = 0;
 
                     for (uint16_t i = 1; i < RingCount; i++) {
                         Rings[i] = pixel_layout[i-1] + Rings[i-1];
                     }
+                    beginCoords(config_handle);
                 }
                 else {
                     ESP_LOGW(TAG, "error nvs_get_u8 pixel_layout err %d", err);
@@ -55,17 +92,99 @@ public:
         }
     }
 
+    // rings first .. first + count - 1 of 'layout', numbered from 0 with their pixels
+    // from 0, as the effects of a zone see them
+    void BeginRange(const MyRingsLayout& layout, uint8_t first, uint8_t count) {
+        RingCount = count + 1;
+
+        delete[] Rings;
+        Rings = new uint16_t[RingCount];
+        for (uint8_t i = 0; i < RingCount; i++) {
+            Rings[i] = layout.Rings[first + i] - layout.Rings[first];
+        }
+
+        // a zone keeps its place in the layout, so a gradient carries on across zones
+        if (OwnsCoords) {
+            delete[] Coords;
+        }
+        Coords = layout.Coords + layout.Rings[first];
+        OwnsCoords = false;
+    }
+
+    // getPixelCoords()[i] is where pixel i is
+    const PixelCoord* getPixelCoords() const {
+        return Coords;
+    }
+
 protected:
-    uint16_t* Rings; 
+    uint16_t* Rings = NULL; 
     uint8_t RingCount = 0;
+    PixelCoord* Coords = NULL;
+    bool OwnsCoords = false;
 
     uint8_t _ringCount() const
     {
         return RingCount;
     }
+
+private:
+    // the table for the rings just read. x/y from pixel_coords if it has a pixel for every one
+    void beginCoords(nvs_handle config_handle) {
+        uint8_t count = RingCount - 1;
+        uint16_t pixels = Rings[count];
+
+        if (OwnsCoords) {
+            delete[] Coords;
+        }
+        Coords = new PixelCoord[pixels];
+        OwnsCoords = true;
+
+        for (uint8_t j = 0; j < count; j++) {
+            uint16_t width = Rings[j + 1] - Rings[j];
+            for (uint16_t i = 0; i < width; i++) {
+                PixelCoord& coord = Coords[Rings[j] + i];
+                coord.step = count > 1 ? 255 * j / (count - 1) : 0;
+                coord.position = 256 * i / width;
+                coord.angle = coord.position;
+                coord.radius = 255 * (j + 1) / count;
+
+                float angle = coord.angle * (2.0f * (float)M_PI / 256.0f);
+                coord.x = MIN(255, lroundf(127.5f + coord.radius / 2.0f * cosf(angle)));
+                coord.y = MIN(255, lroundf(127.5f + coord.radius / 2.0f * sinf(angle)));
+            }
+        }
+
+        size_t size = 0;
+        if (nvs_get_blob(config_handle, "pixel_coords", NULL, &size) != ESP_OK) {
+            return;
+        }
+        if (size != pixels * sizeof(led_pixel_coord_t)) {
+            ESP_LOGW(TAG, "pixel_coords has %d pixels, the layout %d. not used", (int)(size / sizeof(led_pixel_coord_t)), pixels);
+            return;
+        }
+        led_pixel_coord_t* uploaded = new led_pixel_coord_t[pixels];
+        if (nvs_get_blob(config_handle, "pixel_coords", uploaded, &size) == ESP_OK) {
+            for (uint16_t i = 0; i < pixels; i++) {
+                PixelCoord& coord = Coords[i];
+                coord.x = uploaded[i].x;
+                coord.y = uploaded[i].y;
+
+                float dx = coord.x - 127.5f;
+                float dy = coord.y - 127.5f;
+                coord.angle = (int32_t)lroundf(atan2f(dy, dx) * (256.0f / (2.0f * (float)M_PI))) & 0xff;
+                coord.radius = MIN(255, lroundf(sqrtf(dx * dx + dy * dy) * 2.0f));
+            }
+            ESP_LOGI(TAG, "Pixel coordinates from pixel_coords");
+        }
+        delete[] uploaded;
+    }
 };
 
-NeoDynamicRingTopology<MyRingsLayout> segment;
+// the whole layout, as it is wired
+static NeoDynamicRingTopology<MyRingsLayout> s_layout;
+
+// the rings of the zone being rendered or started, from its first ring
+NeoDynamicRingTopology<MyRingsLayout>* segment = NULL;
 
 
 // Default is NeoEsp32Rmt6Ws2812xMethod (channel 6)
@@ -73,128 +192,573 @@ NeoDynamicRingTopology<MyRingsLayout> segment;
 
 //NeoPixelBus<NeoGrbwFeature, NeoEsp32I2s1Sk6812Method> strip(PixelCount, PixelPin); // using i2s
 //NeoPixelBus<NeoGrbwFeature, NeoEsp32Rmt0Sk6812Method> strip(PixelCount, PixelPin); // using RMT
-NeoPixelBus<NeoGrbwFeature, NeoEsp32Rmt0Sk6812Method>* strip = NULL;
+// effects draw into the back buffer while the previous frame is sent over RMT.
+// each output has its own RMT channel, picked at runtime
+NeoBufferedStrip<NeoPixelBus<NeoGrbwFeature, NeoEsp32RmtNSk6812Method>>* strip = NULL;
 
 //NeoPixelAnimator animations(PixelCount, NEO_CENTISECONDS);
 NeoPixelAnimator* animations = NULL;
 
+// per-pixel blends for Glitter and Flicker, so the animator only needs a slot per ring
+PixelTweens* tweens = NULL;
+
+// what the effects draw into. the render task composes it into the strip
+PixelCanvas* canvas = NULL;
+
+// what Cylon and Snake keep from one frame to the next
+typedef struct {
+    uint16_t last_pixel;
+    int8_t direction;
+    float hue;
+} sweep_state_t;
+
+// what RainbowFade and Ripple keep
+typedef struct {
+    float offset;
+    int8_t direction;
+} rainbow_state_t;
+
+// the state of the effect being started or updated, as large as the largest state_size in
+// the registry. each instance has its own, so one effect can run in two zones at once
+void* effect_state = NULL;
+
+// every effect runs on its own animator, tweens and canvas. during a crossfade the
+// outgoing effect carries on in one of the first two instances while the incoming one
+// starts in the other; each layer over them has one more. animations, tweens, canvas
+// and effect_state point at the one being started or updated
+typedef struct {
+    NeoPixelAnimator* animations;
+    PixelTweens* tweens;
+    PixelCanvas* canvas;
+    uint8_t* state;
+    uint32_t animation_id;      // the effect it runs, 0 for a fade
+} effect_instance_t;
+
+#define BASE_INSTANCES          2
+
+// the on/off and colour fades of the zone, per ring. retargeted by every change while they run
+RingFades* fades = NULL;
+
+// the order of the zone's pixels in a fade, and the fade itself when it runs per pixel
+TransitionMap* transition = NULL;
+
+// what set_strip() posts. seq numbers the commands for the latency trace
+typedef struct {
+    led_strip_t led_strip;
+    uint32_t seq;
+} anim_command_t;
+
+// a range of rings with a light of its own: its own commands, effects, fades and brightness.
+// render_frame() renders every zone into its pixels of the strip, one after the other.
+// segment, animations, tweens, canvas and fades point at the zone being rendered or started
+struct zone_t
+{
+    NeoDynamicRingTopology<MyRingsLayout> rings;
+    uint16_t first_pixel = 0;                   // of the strip
+
+    effect_instance_t effects[BASE_INSTANCES + MAX_LAYERS] = {};
+    uint8_t incoming = 0;                       // the instance of the running effect
+    bool crossfading = false;                   // the other instance is fading out
+    uint32_t crossfade_start_ms = 0;
+    uint32_t outgoing_id = 0;                   // the effect fading out
+    uint16_t layer_level = 0;                   // out of 256, 0 while the layers are stopped
+
+    RingFades* fades = NULL;
+    TransitionMap* transition = NULL;
+    bool fading = false;
+    bool fading_pixels = false;                 // the fade runs in transition, not fades
+
+    // the effect running, 0 for none or a fade
+    uint32_t animation_id = 0;
+
+    // brightness for animations, set from another thread at any time. with one zone the
+    // output stage applies it, otherwise the zone is dimmed as it is composed
+    std::atomic<int> brightness {100};
+
+    // set_strip() (on the HomeKit commit task) posts, animation_task takes
+    // the latest at the start of a frame. a command not taken yet is replaced by a newer one
+    CommandMailbox<anim_command_t> commands;
+
+    // the zone's colour this frame, and how many frames saw a new one
+    float hue = 0.0f;
+    float saturation = 0.0f;
+    uint32_t colour_changes = 0;
+
+    // ColorCycle's last NUM_COLOR_CYCLE colours, kept between runs of the effect
+    HsbColor cycle_colors[NUM_COLOR_CYCLE];
+    uint8_t cycle_next = 0;
+    uint32_t cycle_colour_changes = 0;
+
+    // render time since get_zone_timing() last read it, in CPU cycles
+    uint64_t render_cycles = 0;
+    uint32_t render_max_cycles = 0;
+    uint32_t render_frames = 0;
+};
+
+static zone_t s_zones[MAX_ZONES];
+static uint8_t s_zone_count = 0;
+static zone_t* s_zone = &s_zones[0];        // the zone being rendered or started
+static effect_instance_t* s_effect = NULL;  // the instance of the zone bound
+
+// instances per zone: the two base ones and one per layer
+static uint8_t s_effect_count = 0;
+
+// the layers over the light of every zone, from NVS. layer i runs in instance BASE_INSTANCES + i
+static led_layer_t s_layers[MAX_LAYERS];
+static uint8_t s_layer_count = 0;
+
+// stacks the running effects of a zone into the strip every frame
+static PixelCompositor<BASE_INSTANCES + MAX_LAYERS> s_compositor;
+
+// random numbers for the effects. reseeded whenever an effect is started, from
+// esp_random(), or from ANIMATION_RANDOM_SEED so test builds render the same frames
+EffectRandom effect_random;
+
+static uint32_t s_command_seq = 0;
+
+// the task set_strip() runs on. the first call claims it
+static std::atomic<TaskHandle_t> s_strip_producer (NULL);
+
+// animation_task waits on task notifications; either the frame timer or a new command
+#define ANIM_NOTIFY_FRAME       (1 << 0)
+#define ANIM_NOTIFY_WAKE        (1 << 1)
+
+static TaskHandle_t s_animation_task_handle = NULL;
+static esp_timer_handle_t s_frame_timer = NULL;
+static FrameScheduler s_frame_scheduler;
+static uint8_t s_frame_rate = DEFAULT_FRAME_RATE;
+static uint16_t s_keep_alive_ms = DEFAULT_KEEP_ALIVE_MS;
+static uint16_t s_fade_ms = DEFAULT_FADE_MS;
+static uint16_t s_crossfade_ms = DEFAULT_CROSSFADE_MS;
+
+// live parameters of the running effects. the colour is per zone
+typedef struct {
+    float hue[MAX_ZONES];
+    float saturation[MAX_ZONES];
+    uint16_t speed;             // percent
+    uint16_t density;           // percent
+    int8_t direction;           // 1, or -1 reversed
+} effect_params_t;
+
+#define EFFECT_PARAMS_DEFAULT   { {}, {}, DEFAULT_EFFECT_SPEED, DEFAULT_EFFECT_DENSITY, 1 }
+
+// set_effect_colour() and set_effect_motion() write them from any task, one at a time under
+// s_params_mutex. animation_task copies them into s_frame_params once per frame, and that
+// copy is all the effects read
+static effect_params_t s_params_written = EFFECT_PARAMS_DEFAULT;
+static Seqlock<effect_params_t> s_effect_params(s_params_written);
+static SemaphoreHandle_t s_params_mutex = NULL;
+static effect_params_t s_frame_params = EFFECT_PARAMS_DEFAULT;
+
+
+// commands posted to every zone that were replaced before they were taken
+static uint32_t commands_coalesced()
+{
+    uint32_t coalesced = 0;
+    for (uint8_t z = 0; z < MAX_ZONES; z++) {
+        coalesced += s_zones[z].commands.Coalesced();
+    }
+    return coalesced;
+}
+
+
+#ifdef ANIMATION_LATENCY_TRACE
+// see latency_trace.h. set_strip() runs on the HomeKit commit task, everything
+// else on animation_task
+static latency_record_t s_latency[LATENCY_TRACE_DEPTH];
+static std::atomic<int64_t> s_latency_callback_us (0);
+static std::atomic<uint32_t> s_latency_callbacks (0);
+static std::atomic<uint32_t> s_latency_posted (0);
+static uint32_t s_latency_received = 0;
+static uint32_t s_latency_applied = 0;
+static uint32_t s_latency_rendered = 0;
+
+static inline latency_record_t& latency_record(uint32_t seq)
+{
+    return s_latency[seq % LATENCY_TRACE_DEPTH];
+}
+
+void latency_trace_callback(bool opens_transaction)
+{
+    if (opens_transaction) {
+        s_latency_callback_us = esp_timer_get_time();
+    }
+    s_latency_callbacks++;
+}
+
+bool latency_trace_get(uint32_t seq, latency_record_t *record)
+{
+    uint32_t posted = s_latency_posted;
+    if (seq == 0 || seq > posted || posted - seq >= LATENCY_TRACE_DEPTH) {
+        return false;
+    }
+    *record = latency_record(seq);
+    return true;
+}
+
+void latency_trace_counts(latency_counts_t *counts)
+{
+    counts->callbacks = s_latency_callbacks;
+    counts->posted = s_latency_posted;
+    counts->coalesced = commands_coalesced();
+}
+
+// stamps the record of a command before it is posted, so it is complete when taken
+static void latency_trace_enqueue(uint32_t seq)
+{
+    latency_record_t& record = latency_record(seq);
+    record = {};
+    record.us[LATENCY_CALLBACK] = s_latency_callback_us;
+    record.us[LATENCY_ENQUEUE] = esp_timer_get_time();
+}
+
+static void latency_trace_posted(uint32_t seq)
+{
+    s_latency_posted = seq;
+}
+
+// commands posted since the last one taken were replaced in the mailbox
+static void latency_trace_receive(uint32_t seq)
+{
+    for (uint32_t skipped = s_latency_received + 1; skipped < seq; skipped++) {
+        latency_record(skipped).superseded = true;
+    }
+    s_latency_received = seq;
+    latency_record(seq).us[LATENCY_RECEIVE] = esp_timer_get_time();
+}
+
+static void latency_trace_applied(uint32_t seq)
+{
+    s_latency_applied = seq;
+}
+
+// the command this frame is the first to render, 0 if none. a command applied
+// while idle and replaced before a frame rendered it is superseded
+static uint32_t latency_trace_render()
+{
+    uint32_t applied = s_latency_applied;
+    if (applied == s_latency_rendered) {
+        return 0;
+    }
+    for (uint32_t seq = s_latency_rendered + 1; seq < applied; seq++) {
+        latency_record(seq).superseded = true;
+    }
+    s_latency_rendered = applied;
+    latency_record(applied).us[LATENCY_RENDER] = esp_timer_get_time();
+    return applied;
+}
+
+static void latency_trace_shown(uint32_t seq)
+{
+    if (seq != 0) {
+        latency_record(seq).us[LATENCY_SHOWN] = esp_timer_get_time();
+    }
+}
+#else
+#define latency_trace_enqueue(seq)
+#define latency_trace_posted(seq)
+#define latency_trace_receive(seq)
+#define latency_trace_applied(seq)
+#define latency_trace_render()          0
+#define latency_trace_shown(seq)        (void)(seq)
+#endif
+
+
 
-static QueueHandle_t s_led_message_queue;
+// sets every pixel of a ring as one span
+static inline void FillRing(uint8_t ring, RgbwColor color)
+{
+    canvas->FillSpan(segment->getFirstPixelAtRing(ring), segment->getPixelCountAtRing(ring), color);
+}
+
+
+// an effect's animation duration (centiseconds) at the current speed
+static inline uint16_t effect_duration(uint16_t duration)
+{
+    if (s_frame_params.speed == 100) {
+        return duration;
+    }
+    return MAX(1, MIN(UINT16_MAX, (uint32_t)duration * 100 / s_frame_params.speed));
+}
+
+// how much an effect with a fading trail darkens each frame. density 100 is 'darken_by'
+static inline uint8_t effect_trail(uint8_t darken_by)
+{
+    if (s_frame_params.density == 100) {
+        return darken_by;
+    }
+    return MAX(1, MIN(UINT8_MAX, (uint32_t)darken_by * 100 / MAX(1, s_frame_params.density)));
+}
+
+// the fades' clock
+static inline uint32_t fade_time_ms()
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
 
-// let the compiler know that this variable can be updated from another thread at any time
-// this is faster than using a mutex
-std::atomic<int> atomic_brightness (100);
+// points animations, tweens, canvas and effect_state at an effect instance of the zone
+static inline void bind_effect(uint8_t instance)
+{
+    s_effect = &s_zone->effects[instance];
+    animations = s_effect->animations;
+    tweens = s_effect->tweens;
+    canvas = s_effect->canvas;
+    effect_state = s_effect->state;
+}
 
+// points segment, fades, transition and the effect instance at a zone, and at its running effect
+void bind_zone(uint8_t zone)
+{
+    s_zone = &s_zones[zone];
+    segment = &s_zone->rings;
+    fades = s_zone->fades;
+    transition = s_zone->transition;
+    bind_effect(s_zone->incoming);
+}
+
+// the brightness 'zone' is shown at. with one zone the output stage applies it, as its tables
+// cost nothing per pixel. zones share the output stage, so then each is dimmed as it is composed
+static void set_zone_brightness(zone_t& zone, int brightness)
+{
+    zone.brightness = brightness;
+    if (s_zone_count == 1 && strip != NULL) {
+        strip->OutputStage().SetBrightness(brightness);
+    }
+}
 
+// stops the effect fading out, if there is one
+static void end_crossfade()
+{
+    if (s_zone->crossfading) {
+        s_zone->effects[1 - s_zone->incoming].animations->StopAll();
+        s_zone->crossfading = false;
+    }
+}
+
+// gets an instance ready for 'animation_id', stopped and, if the effect draws over its last
+// frame, cleared to black. the others draw every pixel on their first frame, before it is
+// composed. with 'crossfade' the running effect carries on in the other instance and fades
+// out over crossfade_ms. an effect still fading out from an earlier change is dropped
+void begin_effect(uint32_t animation_id, bool crossfade)
+{
+    end_crossfade();
+    if (crossfade && s_crossfade_ms != 0) {
+        s_zone->incoming = 1 - s_zone->incoming;
+        s_zone->crossfading = true;
+        s_zone->crossfade_start_ms = fade_time_ms();
+        s_zone->outgoing_id = s_zone->animation_id;
+    }
+    bind_effect(s_zone->incoming);
+    animations->StopAll();
+    const effect_info_t* effect = find_effect(animation_id);
+    if (effect == NULL || effect->reads_back) {
+        canvas->ClearTo(RgbwColor(0));
+    }
+}
+
+// after the effects it starts
+void show_layers(uint16_t level);
+
+// runs the zone's effects for one frame and composes what they drew into its pixels of the
+// strip in one pass: the running effect, or during a crossfade the outgoing one under it,
+// then the layers
+static void render_zone()
+{
+    for (uint8_t e = 0; e < s_effect_count; e++) {
+        if (e != s_zone->incoming && s_zone->effects[e].animations->IsAnimating()) {
+            bind_effect(e);
+            animations->UpdateAnimations();
+        }
+    }
+    bind_effect(s_zone->incoming);
+    animations->UpdateAnimations();
+
+    uint32_t elapsed_ms = fade_time_ms() - s_zone->crossfade_start_ms;
+    if (s_zone->crossfading && elapsed_ms >= s_crossfade_ms) {
+        end_crossfade();
+        // a layer held back by the effect that was fading out can start
+        show_layers(s_zone->layer_level);
+    }
+
+    s_compositor.Clear();
+    if (s_zone->crossfading) {
+        s_compositor.Add(s_zone->effects[1 - s_zone->incoming].canvas->Pixels(), 256, PixelBlend_Normal);
+        s_compositor.Add(canvas->Pixels(), elapsed_ms * 256 / s_crossfade_ms, PixelBlend_Normal);
+    }
+    else {
+        s_compositor.Add(canvas->Pixels(), 256, PixelBlend_Normal);
+    }
+    for (uint8_t i = 0; i < s_layer_count; i++) {
+        const effect_instance_t& layer = s_zone->effects[BASE_INSTANCES + i];
+        if (layer.animations->IsAnimating()) {
+            uint16_t opacity = s_layers[i].opacity + (s_layers[i].opacity >> 7);
+            s_compositor.Add(layer.canvas->Pixels(), opacity * s_zone->layer_level >> 8, (PixelBlend)s_layers[i].blend);
+        }
+    }
+    if (s_zone_count > 1) {
+        s_compositor.SetLevel(s_zone->brightness * 256 / 100);
+    }
+
+    if (s_compositor.IsCopy()) {
+        strip->CopySpan(s_zone->first_pixel, s_compositor.Bottom(), canvas->PixelCount());
+    }
+    else {
+        strip->ComposeSpan(s_zone->first_pixel, canvas->PixelCount(), s_compositor);
+    }
+}
+
+// renders every zone into the strip, one after the other, and times each
+void render_frame()
+{
+    for (uint8_t z = 0; z < s_zone_count; z++) {
+        uint32_t start = esp_cpu_get_cycle_count();
+        bind_zone(z);
+        render_zone();
+
+        zone_t& zone = s_zones[z];
+        uint32_t cycles = esp_cpu_get_cycle_count() - start;
+        zone.render_cycles += cycles;
+        zone.render_max_cycles = MAX(zone.render_max_cycles, cycles);
+        zone.render_frames++;
+    }
+}
+
+// true while there is anything to render, in any zone
+static inline bool effects_animating()
+{
+    for (uint8_t z = 0; z < s_zone_count; z++) {
+        for (uint8_t e = 0; e < s_effect_count; e++) {
+            if (s_zones[z].effects[e].animations->IsAnimating()) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
 
 // *********** This is the standard animation for on/off ******************
-void FadeAnimationSet(HsbColor targetColor, int8_t direction)
+// a change while a fade runs moves the fade's target; each ring carries on from
+// where it is instead of the fade starting over. 'style' orders the rings or pixels
+void FadeAnimationSet(HsbColor targetColor, TransitionStyle style)
 {
-    // convert Hsb to Rgbw
+    // white channel and gamma are done by the output stage
     RgbwColor rgbwTargetColor = targetColor;
-    // create white channel
-    rgbwTargetColor.W = MIN( rgbwTargetColor.R, MIN(rgbwTargetColor.G, rgbwTargetColor.B));
-    rgbwTargetColor.R = rgbwTargetColor.R - rgbwTargetColor.W; 
-    rgbwTargetColor.G = rgbwTargetColor.G - rgbwTargetColor.W; 
-    rgbwTargetColor.B = rgbwTargetColor.B - rgbwTargetColor.W; 
-    rgbwTargetColor.W *= 0.8;
-
-    // can gamma correct using Rgbw compatible NeoGamma
-    NeoGamma<NeoGammaTableMethod> colorGamma;
-    rgbwTargetColor = colorGamma.Correct(rgbwTargetColor);
-
-    // use pixel color of pixel(0) as the start color to transition from
-    RgbwColor originalColor = strip->GetPixelColor(0);
-
-    // this runs AFTER the fade animation below. Normally, when an animation finishes, the last pixel colour stays forever. 
-    //   Due to wiring issue, I sometimes get odd pixel colours appear, as the data wire I use is effectively acting as an antenna.
-    //   So, I need to keep refreshing all the pixel colours.
-    AnimUpdateCallback refreshColour = [=](const AnimationParam& param)
-    {
-        // only update the pixels once (at the start of the animation)
-        if (param.state == AnimationState_Started) {
-            uint8_t NumSteps = segment.getCountOfRings();
+    uint8_t NumSteps = segment->getCountOfRings();
+    uint32_t now = fade_time_ms();
+
+    // the order of each style is worked out once, not every frame
+    transition->Build(style, *segment, effect_random);
+    bool per_pixel = transition->IsPerPixel();
+
+    // the brightness is part of the target color, so the zone is shown at full brightness.
+    // a new fade starts from what the zone is showing, dimmed to the brightness it is shown at.
+    // one running carries on from the frame it drew last
+    if (!s_zone->fading) {
+        uint8_t dim = strip->OutputStage().Brightness() * 255 / 100;
+        if (per_pixel) {
+            for (uint16_t i = 0; i < canvas->PixelCount(); i++) {
+                transition->SetFrom(i, strip->GetPixelColor(s_zone->first_pixel + i).Dim(dim));
+            }
+        }
+        else {
             for (uint8_t j = 0; j < NumSteps; j++) {
-                uint16_t StepWidth = segment.getPixelCountAtRing(j);
-                for (uint16_t i = 0; i < StepWidth; i++) {
-                    strip->SetPixelColor(segment.Map(j, i), rgbwTargetColor);
-                }
+                RgbwColor showing = strip->GetPixelColor(s_zone->first_pixel + segment->getFirstPixelAtRing(j));
+                fades->SetCurrent(j, showing.Dim(dim));
             }
         }
-
-        if (param.state == AnimationState_Completed) {
-            animations->RestartAnimation(param.index);
+        set_zone_brightness(*s_zone, 100);
+    }
+    else if (per_pixel) {
+        for (uint16_t i = 0; i < canvas->PixelCount(); i++) {
+            transition->SetFrom(i, canvas->GetPixelColor(i));
         }
-    };
-
-    AnimUpdateCallback animUpdate = [=](const AnimationParam& param)
-    {
-        float step_progress;
-
-        uint8_t NumSteps = segment.getCountOfRings();
+    }
+    else if (s_zone->fading_pixels) {
+        for (uint8_t j = 0; j < NumSteps; j++) {
+            fades->SetCurrent(j, canvas->GetPixelColor(segment->getFirstPixelAtRing(j)));
+        }
+    }
+    s_zone->fading_pixels = per_pixel;
 
-        // use 'direction' to start fade from top or bottom
+    // other than uniform, the rings or pixels start one after the other over as long as
+    // each takes, half again as slow as a plain fade
+    uint16_t fade_ms = style != TransitionStyle_Uniform ? s_fade_ms * 3 / 2 : s_fade_ms;
+    if (per_pixel) {
+        transition->Start(rgbwTargetColor, now, fade_ms);
+    }
+    else {
         for (uint8_t j = 0; j < NumSteps; j++) {
-            if (direction > 0) {
-                step_progress = fmin(1.0f,fmax(0.0f,( 2.0f*param.progress - 1.0f*j/(NumSteps-1.0f))));
-            } else if (direction < 0) {
-                step_progress = fmin(1.0f,fmax(0.0f,( 2.0f*param.progress - (1.0f*NumSteps-1.0f-j)/(NumSteps-1.0f))));
-            } else {
-                step_progress = param.progress;
-            }
+            fades->SetTarget(j, rgbwTargetColor, now, transition->RingDelay(j, fade_ms), fade_ms);
+        }
+    }
 
-            RgbwColor updatedColor = RgbwColor::LinearBlend(originalColor, rgbwTargetColor, 
-                step_progress  
-            );
+    if (s_zone->fading) {
+        return;
+    }
 
-            uint16_t StepWidth = segment.getPixelCountAtRing(j);
-            for (uint16_t i = 0; i < StepWidth; i++) {
-                strip->SetPixelColor(segment.Map(j, i), updatedColor);
+    AnimUpdateCallback animUpdate = [=](const AnimationParam& param)
+    {
+        bool active;
+        if (s_zone->fading_pixels) {
+            active = transition->Update(fade_time_ms(), *canvas);
+        }
+        else {
+            active = fades->Update(fade_time_ms());
+            for (uint8_t j = 0; j < NumSteps; j++) {
+                FillRing(j, fades->Current(j));
             }
         }
 
-        // once fade is complete, don't restart
-        if (param.state == AnimationState_Completed) {
+        // once every ring is there, don't restart. the final colour stays in the back buffer
+        // and animation_task resends it at the keep-alive interval, as the data wire I use
+        // effectively acts as an antenna and odd pixel colours sometimes appear
+        if (!active) {
             animations->StopAnimation(param.index);
-
-            // see above. I need to keep refreshing the pixel colours periodically
-            animations->StartAnimation(0, 500, refreshColour);
-
+            s_zone->fading = false;
+        }
+        else if (param.state == AnimationState_Completed) {
+            animations->RestartAnimation(param.index);
         }
     };
 
-    animations->StartAnimation(0, direction != 0 ? 300 : 100, animUpdate);
-
+    // the animator only paces the frames; the fade ends when the rings arrive
+    animations->StartAnimation(0, 100, animUpdate);
+    s_zone->fading = true;
 }
 // ************************************************************************
 
 
-// Stores NUM_COLOR_CYCLE colors and cycle up the segment
-void ColorCycleAnimationSet(float hue, float saturation)
+// the last NUM_COLOR_CYCLE colors chosen are kept by the zone, between runs of the effect
+static void ColorCycleAddColor(float hue, float saturation)
 {
-    // static variables maintain values between function calls
-    static HsbColor selectedColors[NUM_COLOR_CYCLE];
-    static uint8_t next_index = 0;
-
-    if (next_index == NUM_COLOR_CYCLE) {
-        next_index = 0;
+    if (s_zone->cycle_next == NUM_COLOR_CYCLE) {
+        s_zone->cycle_next = 0;
     }
- 
-    // select target brightness. gamma corrected 
-    float brightness = atomic_brightness/100.0f;
-    brightness = pow(brightness,2.2);
 
-    selectedColors[next_index] = HsbColor(hue, saturation, brightness);
-    next_index++;
+    // full brightness. the output stage applies the global brightness
+    s_zone->cycle_colors[s_zone->cycle_next] = HsbColor(hue, saturation, 1.0f);
+    s_zone->cycle_next++;
+    s_zone->cycle_colour_changes = s_zone->colour_changes;
+}
+
+// Stores NUM_COLOR_CYCLE colors and cycle up the segment. a colour chosen while it
+// runs joins the cycle from the next frame
+void ColorCycleAnimationSet(float hue, float saturation)
+{
+    ColorCycleAddColor(hue, saturation);
 
     // spend more time at start/end (to see the color), rather than during the linear blend
-    AnimEaseFunction easing =  NeoEase::ExponentialInOut;
+    EaseCurve easing = EaseCurve_ExponentialInOut;
 
-    uint8_t NumSteps = segment.getCountOfRings();
+    uint8_t NumSteps = segment->getCountOfRings();
     for (uint8_t j = 0; j < NumSteps; j++) {
 
         AnimUpdateCallback animUpdate = [=](const AnimationParam& param)
         {
+            if (s_zone->cycle_colour_changes != s_zone->colour_changes) {
+                ColorCycleAddColor(s_zone->hue, s_zone->saturation);
+            }
+
             uint8_t this_color = 0;
             uint8_t i;
             // divide total progress up by the number of colors to display
@@ -204,8 +768,8 @@ void ColorCycleAnimationSet(float hue, float saturation)
                     break;
                 }    
             }
-            // then offset for each step
-            this_color += j % NUM_COLOR_CYCLE;
+            // then offset for each step, cycling up or down
+            this_color += (s_frame_params.direction > 0 ? j : NumSteps - 1 - j) % NUM_COLOR_CYCLE;
             if (this_color >= NUM_COLOR_CYCLE) {
                 this_color -= NUM_COLOR_CYCLE;
             }
@@ -216,293 +780,282 @@ void ColorCycleAnimationSet(float hue, float saturation)
             }
 
             // stretch the overall progress to 0.0 -> 1.0 for use in linear blend
-            float progress = easing(param.progress * NUM_COLOR_CYCLE - i);
-
-            // update brightness from global
-            float brightness = atomic_brightness/100.0f;
-            brightness = pow(brightness,2.2);
-            for (uint8_t i = 0; i < NUM_COLOR_CYCLE; i++) {
-                selectedColors[i].B = brightness;
-            }
+            float progress = EaseTable::Ease(easing, param.progress * NUM_COLOR_CYCLE - i);
 
             // LinearBlend can work with hsb color objects
-            RgbwColor color = RgbwColor::LinearBlend(selectedColors[this_color], selectedColors[next_color], progress);
+            RgbwColor color = RgbwColor::LinearBlend(s_zone->cycle_colors[this_color], s_zone->cycle_colors[next_color], progress);
 
-            uint16_t StepWidth = segment.getPixelCountAtRing(j);
-            for (uint16_t i = 0; i < StepWidth; i++) {
-                strip->SetPixelColor(segment.Map(j, i), color);
-            }
+            FillRing(j, color);
 
             if (param.state == AnimationState_Completed) {
                 animations->RestartAnimation(j);
             }
         };
 
-        animations->StartAnimation(j, 200*NUM_COLOR_CYCLE, animUpdate);
+        animations->StartAnimation(j, effect_duration(200*NUM_COLOR_CYCLE), animUpdate);
     }
 
 }
 
-// Color cycle up each step
+// Color cycle up each step, or down when reversed
 void RainbowFadeAnimationSet()
 {
+    // a reversal carries on from the hue showing
+    rainbow_state_t* start = (rainbow_state_t*)effect_state;
+    start->offset = 0.0f;
+    start->direction = 1;
+
     AnimUpdateCallback animUpdate = [=](const AnimationParam& param)
     {
-        uint8_t NumSteps = segment.getCountOfRings();
+        rainbow_state_t* state = (rainbow_state_t*)effect_state;
+        if (s_frame_params.direction != state->direction) {
+            state->offset += 2 * state->direction * param.progress;
+            state->offset -= floorf(state->offset);
+            state->direction = s_frame_params.direction;
+        }
+
+        uint8_t NumSteps = segment->getCountOfRings();
         for (uint8_t j = 0; j < NumSteps; j++) {
-            float hue = param.progress + (1.0*j/NumSteps);
-            if (hue > 1) {
-                hue -= 1;
-            }
+            float hue = state->offset + state->direction * param.progress + (1.0*j/NumSteps);
+            hue -= floorf(hue);
 
-            // select target brightness. don't let brightness go higher than global brightness
-            float brightness = atomic_brightness/100.0f;
-            // gamma corrected
-            brightness = pow(brightness,2.2);
+            // convert once per ring, not once per pixel
+            FillRing(j, FastHsb::ToRgbw(FastHsb::HueToU16(hue), 255, 255));
+        }
 
-            HsbColor color = HsbColor(hue, 1.0f, brightness);
+        // no need to call parent setup function RainbowFadeAnimationSet(). just restart animation
+        if (param.state == AnimationState_Completed) {
+            animations->RestartAnimation(param.index);
+        }
+    };
 
-            uint16_t StepWidth = segment.getPixelCountAtRing(j);
-            for (uint16_t i = 0; i < StepWidth; i++) {
-                strip->SetPixelColor(segment.Map(j, i), color);
-            }
+    animations->StartAnimation(0, effect_duration(1000), animUpdate);
+
+}
+
+// rainbow rings moving out from the centre, or in when reversed. one pass over the pixels
+// by their distance from the centre, so it follows uploaded pixel coordinates too
+void RippleAnimationSet()
+{
+    // a reversal carries on from the colours showing
+    rainbow_state_t* start = (rainbow_state_t*)effect_state;
+    start->offset = 0.0f;
+    start->direction = 1;
+
+    AnimUpdateCallback animUpdate = [=](const AnimationParam& param)
+    {
+        rainbow_state_t* state = (rainbow_state_t*)effect_state;
+        if (s_frame_params.direction != state->direction) {
+            state->offset += 2 * state->direction * param.progress;
+            state->offset -= floorf(state->offset);
+            state->direction = s_frame_params.direction;
+        }
+
+        float phase = state->offset + state->direction * param.progress;
+        uint16_t shift = FastHsb::HueToU16(phase - floorf(phase));
+
+        // two rainbows from the centre to the outermost ring
+        const PixelCoord* coords = segment->getPixelCoords();
+        for (uint16_t i = 0; i < canvas->PixelCount(); i++) {
+            uint16_t hue = (coords[i].radius << 9) - shift;
+            canvas->SetPixelColor(i, FastHsb::ToRgbw(hue, 255, 255));
         }
 
-        // no need to call parent setup function RainbowFadeAnimationSet(). just restart animation
         if (param.state == AnimationState_Completed) {
             animations->RestartAnimation(param.index);
         }
     };
 
-    animations->StartAnimation(0, 1000, animUpdate);
+    animations->StartAnimation(0, effect_duration(400), animUpdate);
+}
 
+// random easing for the per-pixel tweens
+static EaseCurve RandomEaseCurve()
+{
+    switch (effect_random.Below(6))
+    {
+    case 0:
+        return EaseCurve_CubicIn;
+    case 1:
+        return EaseCurve_CubicOut;
+    case 2:
+        return EaseCurve_QuadraticIn;
+    case 3:
+        return EaseCurve_QuadraticOut;
+    case 4:
+        return EaseCurve_QuinticIn;
+    default:
+        return EaseCurve_QuinticOut;
+    }
 }
 
-// User selected color. Brightness fades in/out
+// User selected color. Brightness fades in/out. a new colour takes over from the next
+// frame, each pixel carrying on from its brightness
 void FlickerAnimationSet(float hue, float saturation)
 {
-    // Every pixel is a standalone animation
-    for (uint16_t pixel = 0; strip->PixelCount(); pixel++)
+    uint32_t colour_changes = s_zone->colour_changes;
+
+    tweens->Clear();
+
+    // Every pixel is a standalone tween
+    for (uint16_t pixel = 0; pixel < canvas->PixelCount(); pixel++)
     {
         // we need the current brightness of the pixel at the start of the animation
-        RgbwColor startColorRgbw = strip->GetPixelColor(pixel);
+        RgbwColor startColorRgbw = canvas->GetPixelColor(pixel);
 
         // we need hsb color to set start color, so use the retrieved rgbw pixel and convert to hsb
         HsbColor startColor = HsbColor(RgbColor(startColorRgbw.R, startColorRgbw.G, startColorRgbw.B));
         // set the color to chosen hue/saturation, and the current pixel brightness 'originalColor.B'
         startColor = HsbColor(hue, saturation, startColor.B);
 
-        // select target brightness. don't let brightness go higher than global brightness
-        float brightness = atomic_brightness/100.0f;
-        brightness = fmin(brightness, (1.0*esp_random()/UINT32_MAX));
-        // gamma corrected
-        brightness = pow(brightness,2.2);
+        // random target brightness. the output stage scales it by the global brightness.
+        // below 100% density, some pixels go dark
+        float brightness = effect_random.Unit();
+        if (s_frame_params.density < 100 && effect_random.Below(100) >= s_frame_params.density) {
+            brightness = 0.0f;
+        }
 
         HsbColor targetColor = HsbColor(startColor.H, startColor.S, brightness);
 
-        AnimEaseFunction easing;
+        tweens->Set(pixel, startColor, targetColor, EaseCurve_Linear, 0, 2000);
+    }
 
-        switch (esp_random()%6)
-        {
-        case 0:
-            easing = NeoEase::CubicIn;
-            break;
-        case 1:
-            easing = NeoEase::CubicOut;
-            break;
-        case 2:
-            easing = NeoEase::QuadraticIn;
-            break;
-        case 3:
-            easing = NeoEase::QuadraticOut;
-            break;
-        case 4:
-            easing = NeoEase::QuinticIn;
-            break;
-        case 5:
-            easing = NeoEase::QuinticOut;
-            break;
+    // one animation drives every tween. it only captures two floats and a count, so
+    // the callback fits std::function's local storage and re-arming does not allocate
+    AnimUpdateCallback animUpdate = [=](const AnimationParam& param)
+    {
+        if (colour_changes != s_zone->colour_changes) {
+            FlickerAnimationSet(s_zone->hue, s_zone->saturation);
+            return;
         }
 
+        tweens->Update(*canvas, param.progress * tweens->Period());
 
+        // once ALL pixels have completed, run it all again
+        if (param.state == AnimationState_Completed) {
+            FlickerAnimationSet(hue, saturation);
+        }
+    };
 
-        easing = NeoEase::Linear;
-
-
-
-        AnimUpdateCallback animUpdate = [=](const AnimationParam& param)
-        {
-            float progress = easing(param.progress);
-
-            RgbwColor updatedColor = RgbwColor::LinearBlend(startColor, targetColor, progress);
-            strip->SetPixelColor(pixel, updatedColor);
-
-            // once ALL animations have completed, run it all again
-            if (!animations->IsAnimating()) {
-                FlickerAnimationSet(hue, saturation);
-            }
-        };
-
-        animations->StartAnimation(pixel, 200, animUpdate);
-    }
+    // the animator runs in centiseconds
+    animations->StartAnimation(0, effect_duration(tweens->Period() / 10), animUpdate);
 }
 
 // Randomly selected color. Brightness fades in/out
 void GlitterAnimationSet()
 {
-    // Every pixel is a standalone animation
-    for (uint16_t pixel = 0; pixel < strip->PixelCount(); pixel++)
+    tweens->Clear();
+
+    // Every pixel is a standalone tween
+    for (uint16_t pixel = 0; pixel < canvas->PixelCount(); pixel++)
     {
         // each animation starts with the color that was present
-        RgbwColor startColorRgbw = strip->GetPixelColor(pixel);
+        RgbwColor startColorRgbw = canvas->GetPixelColor(pixel);
 
-        // select target brightness. don't let brightness go higher than global brightness
-        float brightness = atomic_brightness/100.0f;
-        brightness = fmin(brightness, (1.0*esp_random()/UINT32_MAX));
-        brightness = pow(brightness,2.2);
+        // random target brightness. the output stage scales it by the global brightness
+        float brightness = effect_random.Unit();
 
         // and a random color
-        float hue = (float)(1.0*esp_random()/UINT32_MAX);
+        float hue = effect_random.Unit();
+
+        // below 100% density, some pixels go dark
+        if (s_frame_params.density < 100 && effect_random.Below(100) >= s_frame_params.density) {
+            brightness = 0.0f;
+        }
 
         HsbColor targetColor = HsbColor(hue, 1.0, brightness);
 
         // with the random ease function
-        AnimEaseFunction easing;
-
-        switch (esp_random()%6)
-        {
-        case 0:
-            easing = NeoEase::CubicIn;
-            break;
-        case 1:
-            easing = NeoEase::CubicOut;
-            break;
-        case 2:
-            easing = NeoEase::QuadraticIn;
-            break;
-        case 3:
-            easing = NeoEase::QuadraticOut;
-            break;
-        case 4:
-            easing = NeoEase::QuinticIn;
-            break;
-        case 5:
-            easing = NeoEase::QuinticOut;
-            break;
-        }
-
-        // we must supply a function that will define the animation, in this example
-        // we are using "lambda expression" to define the function inline, which gives
-        // us an easy way to "capture" the originalColor and targetColor for the call back.
-        AnimUpdateCallback animUpdate = [=](const AnimationParam& param)
-        {
-            float progress = easing(param.progress);
-
-            // LinearBlend can accept Rgbw and Hsb color objects
-            RgbwColor updatedColor = RgbwColor::LinearBlend(startColorRgbw, targetColor, progress);
-            strip->SetPixelColor(pixel, updatedColor);
+        tweens->Set(pixel, startColorRgbw, targetColor, RandomEaseCurve(), 0, 2000);
+    }
 
-            // once ALL animations have completed, run it all again
-            if (!animations->IsAnimating()) {
-                GlitterAnimationSet();
-            }
-        };
+    AnimUpdateCallback animUpdate = [](const AnimationParam& param)
+    {
+        tweens->Update(*canvas, param.progress * tweens->Period());
 
-        animations->StartAnimation(pixel, 200, animUpdate);
+        // once ALL pixels have completed, run it all again
+        if (param.state == AnimationState_Completed) {
+            GlitterAnimationSet();
+        }
+    };
 
-    }
+    animations->StartAnimation(0, effect_duration(tweens->Period() / 10), animUpdate);
 }
 
-
 void CylonAnimationSet() 
 {
-    static uint16_t s_last_pixel;
-    static int8_t s_direction;
-    static float hue;
-
-    s_last_pixel = 0;
-    s_direction = 1;
+    sweep_state_t* start = (sweep_state_t*)effect_state;
+    start->last_pixel = 0;
+    start->direction = 1;
 
     AnimUpdateCallback animUpdate = [=](const AnimationParam& param)
     {
+        sweep_state_t* state = (sweep_state_t*)effect_state;
         if (param.state == AnimationState_Started) {
-            hue = (float)(1.0*esp_random()/UINT32_MAX);
+            state->hue = effect_random.Unit();
         }
 
-        float brightness = atomic_brightness/100.0f;
-        brightness = pow(brightness,2.2);
-        brightness = fmax(0.03, brightness);
+        // full brightness. the output stage applies the global brightness
+        RgbwColor color = FastHsb::ToRgbw(FastHsb::HueToU16(state->hue), 255, 255);
 
-        HsbColor hsbColor = HsbColor(hue, 1.0, brightness); 
+        float progress = EaseTable::Ease(EaseCurve_QuarticInOut, param.progress);
 
-        AnimEaseFunction easing = NeoEase::QuarticInOut;
-        float progress = easing(param.progress);
-
-        // darken all pixels
-        int darken_by = 50 * hsbColor.B + 1;
-        for (uint16_t i = 0; i < strip->PixelCount(); i++) {
-            RgbwColor pixel_color = strip->GetPixelColor(i);
-            pixel_color.Darken(darken_by);
-            strip->SetPixelColor(i, pixel_color);
-        }
+        // darken all pixels. the trail lasts 5 frames, longer with more density
+        canvas->DarkenSpan(0, canvas->PixelCount(), effect_trail(51));
 
         // use the curved progress to calculate the pixel to effect.
         uint16_t next_pixel;
-        if (s_direction > 0) {
-            next_pixel = progress * strip->PixelCount();
+        if (state->direction > 0) {
+            next_pixel = progress * canvas->PixelCount();
         }
         else {
-            next_pixel = (1.0f - progress) * strip->PixelCount();
+            next_pixel = (1.0f - progress) * canvas->PixelCount();
         }
-        if (next_pixel == strip->PixelCount()) {
+        if (next_pixel == canvas->PixelCount()) {
             next_pixel -= 1;
         }
 
         // how many pixels missed?
-        uint8_t pixel_diff = abs(next_pixel - s_last_pixel);
+        uint8_t pixel_diff = abs(next_pixel - state->last_pixel);
 
         uint8_t i = 0;
         do {
-            uint16_t i_pixel = next_pixel - i * s_direction;
-            strip->SetPixelColor(i_pixel, hsbColor);
+            uint16_t i_pixel = next_pixel - i * state->direction;
+            canvas->SetPixelColor(i_pixel, color);
             i++;
         } while ( i < pixel_diff);
 
-        s_last_pixel = next_pixel;
+        state->last_pixel = next_pixel;
         
         if (param.state == AnimationState_Completed) {
-            s_direction *= -1;
+            state->direction *= -1;
 
             // time is centiseconds
-            uint16_t time = 1000 + esp_random()%1000;
-            animations->AnimationDuration(time);
+            uint16_t time = 1000 + effect_random.Below(1000);
+            animations->ChangeAnimationDuration(param.index, effect_duration(time));
             animations->RestartAnimation(param.index);
         }
     };
 
     // start animation for the first time
-    uint16_t time = 1000 + esp_random()%1000;
-    animations->StartAnimation(0, time, animUpdate);
+    uint16_t time = 1000 + effect_random.Below(1000);
+    animations->StartAnimation(0, effect_duration(time), animUpdate);
 }
 
 // Each step has an animated back and forth 'Cylon' transition
 void StepCylonAnimationSet()
 {
-    uint8_t NumSteps = segment.getCountOfRings();
+    uint8_t NumSteps = segment->getCountOfRings();
     for (uint8_t j = 0; j < NumSteps; j++) {
         
         AnimUpdateCallback animUpdate = [=](const AnimationParam& param)
         {
              if (param.state == AnimationState_Started) {
-                float hue = (float)(1.0*esp_random()/UINT32_MAX);
+                float hue = effect_random.Unit();
 
-                float brightness = atomic_brightness/100.0f;
-                brightness = pow(brightness, 2.2);
-                // do not go lower than this. it will cause CalculateBrightness to return 0
-                brightness = fmax(0.03, brightness);
-
-                HsbColor hsbColor = HsbColor(hue, 1.0, brightness);                
-                strip->SetPixelColor(segment.Map(j, 0), hsbColor);
+                // full brightness. the output stage applies the global brightness
+                HsbColor hsbColor = HsbColor(hue, 1.0, 1.0);
+                canvas->SetPixelColor(segment->Map(j, 0), hsbColor);
            }
 
             float progress;
@@ -515,10 +1068,9 @@ void StepCylonAnimationSet()
                 direction = 1;
                 progress = 2 * param.progress;
             }
-            AnimEaseFunction easing = NeoEase::QuarticInOut;
-            progress = easing(progress);
+            progress = EaseTable::Ease(EaseCurve_QuarticInOut, progress);
 
-            uint16_t StepWidth = segment.getPixelCountAtRing(j);
+            uint16_t StepWidth = segment->getPixelCountAtRing(j);
 
             int16_t next_pixel, last_pixel;
             // use the curved progress to calculate next pixel. pixels are 0 -> StepWidth-1
@@ -536,29 +1088,24 @@ void StepCylonAnimationSet()
             // not storing s_last_pixel, so iterate backwards and find the leading edge of the trail
             for (last_pixel = next_pixel; ; last_pixel -= direction) {
                 // GetPixelColor returns a Rgbw color object
-                uint8_t this_brightness = strip->GetPixelColor(segment.Map(j, last_pixel)).CalculateBrightness();
-                uint8_t prev_brightness = strip->GetPixelColor(segment.Map(j, last_pixel + direction)).CalculateBrightness();
+                uint8_t this_brightness = canvas->GetPixelColor(segment->Map(j, last_pixel)).CalculateBrightness();
+                uint8_t prev_brightness = canvas->GetPixelColor(segment->Map(j, last_pixel + direction)).CalculateBrightness();
 
                 if (last_pixel == 0 || last_pixel == StepWidth - 1) {
                     prev_brightness = 0;
                 }
 
                 if (this_brightness > prev_brightness ) {
-                    color = strip->GetPixelColor(segment.Map(j, last_pixel));
+                    color = canvas->GetPixelColor(segment->Map(j, last_pixel));
                     break;
                 } 
             }
 
             // determine brightness by converting to Hsb
-            HsbColor colorHsb = HsbColor(RgbColor(color.R, color.G, color.B));
-            int darken_by = 40 * colorHsb.B + 1;
+            HsbColor16 colorHsb = FastHsb::FromRgb(color);
+            int darken_by = 40 * colorHsb.B / 255 + 1;
             // darken the pixels on the strip
-            for (uint16_t i = 0; i < StepWidth; i++)
-            {
-                RgbwColor pixel_color = strip->GetPixelColor(segment.Map(j, i));
-                pixel_color.Darken(darken_by);
-                strip->SetPixelColor(segment.Map(j, i), pixel_color);
-            }
+            canvas->DarkenSpan(segment->getFirstPixelAtRing(j), StepWidth, darken_by);
 
             // how many pixels missed?
             uint8_t pixel_diff = abs(next_pixel - last_pixel);
@@ -566,120 +1113,110 @@ void StepCylonAnimationSet()
             uint8_t i = 0;
             do {
                 uint16_t i_pixel = next_pixel - i * direction;
-                strip->SetPixelColor(segment.Map(j, i_pixel), color);
+                canvas->SetPixelColor(segment->Map(j, i_pixel), color);
                 i++;
             } while ( i < pixel_diff);
 
             if (param.state == AnimationState_Completed) {
-                uint16_t time = 400 + esp_random()%600;
-                animations->ChangeAnimationDuration(j, time);
+                uint16_t time = 400 + effect_random.Below(600);
+                animations->ChangeAnimationDuration(j, effect_duration(time));
                 animations->RestartAnimation(j);
             }
         };
 
         // start the animation for the first time
-        uint16_t time = 400 + esp_random()%600;
-        animations->StartAnimation(j, time, animUpdate);
+        uint16_t time = 400 + effect_random.Below(600);
+        animations->StartAnimation(j, effect_duration(time), animUpdate);
     }
 }
 
 // similar to Cylon, but go left-right-left
 void SnakeAnimationSet()
 {
-    static uint16_t s_last_pixel;
-    static int8_t s_direction;
-    static float hue;
-
-    s_last_pixel = 0;
-    s_direction = 1;
+    sweep_state_t* start = (sweep_state_t*)effect_state;
+    start->last_pixel = 0;
+    start->direction = 1;
  
     AnimUpdateCallback animUpdate = [=](const AnimationParam& param)
     {
+        sweep_state_t* state = (sweep_state_t*)effect_state;
         if (param.state == AnimationState_Started) {
-            hue = (float)(1.0*esp_random()/UINT32_MAX);
+            state->hue = effect_random.Unit();
         }
 
-        float brightness = atomic_brightness/100.0f;
-        brightness = pow(brightness,2.2);
-        brightness = fmax(0.03, brightness);
-
-        HsbColor hsbColor = HsbColor(hue, 1.0, brightness); 
+        // full brightness. the output stage applies the global brightness
+        RgbwColor color = FastHsb::ToRgbw(FastHsb::HueToU16(state->hue), 255, 255);
         
-        AnimEaseFunction easing = NeoEase::QuadraticInOut;
-        float progress = easing(param.progress);
+        float progress = EaseTable::Ease(EaseCurve_QuadraticInOut, param.progress);
 
-        // darken all pixels
-        int darken_by = 50 * hsbColor.B + 1;
-        for (uint16_t i = 0; i < strip->PixelCount(); i++) {
-            RgbwColor pixel_color = strip->GetPixelColor(i);
-            pixel_color.Darken(darken_by);
-            strip->SetPixelColor(i, pixel_color);
-        }
+        // darken all pixels. the trail lasts 5 frames, longer with more density
+        canvas->DarkenSpan(0, canvas->PixelCount(), effect_trail(51));
 
         // work out which pixel is next
         uint16_t next_pixel;
-        if (s_direction > 0) {
-            next_pixel = progress * strip->PixelCount();
+        if (state->direction > 0) {
+            next_pixel = progress * canvas->PixelCount();
         }
         else {
-            next_pixel = (1.0f - progress) * strip->PixelCount();
+            next_pixel = (1.0f - progress) * canvas->PixelCount();
         }
-        if (next_pixel == strip->PixelCount()) {
+        if (next_pixel == canvas->PixelCount()) {
             next_pixel -= 1;
         }
 
         // how many pixels missed?
-        uint8_t pixel_diff = abs(next_pixel - s_last_pixel);
+        uint8_t pixel_diff = abs(next_pixel - state->last_pixel);
 
         uint8_t i = 0;
         do {
             uint8_t step_num = 0;
             uint8_t pixel_num = 0;
             uint16_t pixel_count = 0;
-            uint16_t i_pixel = next_pixel - i * s_direction;
+            uint16_t i_pixel = next_pixel - i * state->direction;
 
-            uint8_t NumSteps = segment.getCountOfRings();
+            uint8_t NumSteps = segment->getCountOfRings();
             for (step_num = 0; step_num < NumSteps; step_num++ ) {
                 pixel_num = i_pixel - pixel_count;
-                pixel_count += segment.getPixelCountAtRing(step_num);  
+                pixel_count += segment->getPixelCountAtRing(step_num);  
                 if (pixel_count > i_pixel) {
                     break;
                 }
             }
 
             if(step_num % 2 == 0) {
-                pixel_num = segment.getPixelCountAtRing(step_num) - pixel_num -1;
+                pixel_num = segment->getPixelCountAtRing(step_num) - pixel_num -1;
             }
 
-            strip->SetPixelColor(segment.Map(step_num, pixel_num), hsbColor);
+            canvas->SetPixelColor(segment->Map(step_num, pixel_num), color);
 
             i++;
         } while ( i < pixel_diff);
 
-        s_last_pixel = next_pixel;
+        state->last_pixel = next_pixel;
         
         if (param.state == AnimationState_Completed) {     
-            s_direction *= -1;
+            state->direction *= -1;
 
-            uint16_t time = 1000 + esp_random()%1000;
-            animations->AnimationDuration(time);
+            uint16_t time = 1000 + effect_random.Below(1000);
+            animations->ChangeAnimationDuration(param.index, effect_duration(time));
             animations->RestartAnimation(param.index);
         }
     };
 
-    uint16_t time = 1000 + esp_random()%1000;
-    animations->StartAnimation(0, time, animUpdate);
+    uint16_t time = 1000 + effect_random.Below(1000);
+    animations->StartAnimation(0, effect_duration(time), animUpdate);
 }
 
 
 void FireworksAnimationSetHsb() 
 {
-    // Set random pixels on (exclude bottom and top step)
+    // Set random pixels on (exclude bottom and top step). density scales how many
+    uint16_t one_in = s_frame_params.density ? 300 * 100 / s_frame_params.density : 0;
 
-    for (uint16_t indexPixel = segment.getPixelCountAtRing(0); indexPixel < strip->PixelCount() - segment.getPixelCountAtRing(segment.getCountOfRings()-1); indexPixel++)  {
-        if(esp_random()%300 == 0) {
-            HsbColor hsbColor = HsbColor(1.0f*esp_random()/UINT32_MAX, 1.0, ( 0.2f + (1.0f*esp_random()/UINT32_MAX)/2.0f ));
-            strip->SetPixelColor(indexPixel, hsbColor);
+    for (uint16_t indexPixel = segment->getPixelCountAtRing(0); indexPixel < canvas->PixelCount() - segment->getPixelCountAtRing(segment->getCountOfRings()-1); indexPixel++)  {
+        if(one_in != 0 && effect_random.Below(one_in) == 0) {
+            HsbColor hsbColor = HsbColor(effect_random.Unit(), 1.0, ( 0.2f + effect_random.Unit()/2.0f ));
+            canvas->SetPixelColor(indexPixel, hsbColor);
         }
     }
 
@@ -692,32 +1229,26 @@ void FireworksAnimationSetHsb()
         // the brightest pixel, and then decrements away. However, the decrement comes after
         // the brightest pixel, so if you dim that and then move to the next pixel, it would be a
         // different value than the left pixel used as a value.
-        for (uint16_t i = 0; i < strip->PixelCount(); i++ ) {
-            RgbwColor color = strip->GetPixelColor(i);
-            HsbColor hsbColor = HsbColor(RgbColor(color.R, color.G, color.B));
-            hsbColor = HsbColor(hsbColor.H, 1.0, hsbColor.B/1.1f);
-            strip->SetPixelColor(i, hsbColor);
+        // fixed point, as this and the passes below convert every pixel, every frame
+        for (uint16_t i = 0; i < canvas->PixelCount(); i++ ) {
+            HsbColor16 hsbColor = FastHsb::FromRgb(canvas->GetPixelColor(i));
+            canvas->SetPixelColor(i, FastHsb::ToRgbw(hsbColor.H, 255, hsbColor.B * 10 / 11));
         }
 
         // Left to Right first
-        uint8_t NumSteps = segment.getCountOfRings();
+        uint8_t NumSteps = segment->getCountOfRings();
         for (uint16_t j = 0; j < NumSteps; j++ ) {
-            uint16_t StepWidth = segment.getPixelCountAtRing(j);
+            uint16_t StepWidth = segment->getPixelCountAtRing(j);
             for (uint16_t i = 0; i < StepWidth; i++) {
-                RgbwColor this_pixel, left_pixel, right_pixel;
-                HsbColor hsb_this_pixel, hsb_left_pixel, hsb_right_pixel;
-                float brightness = 0.0, hue = 0.0;
+                HsbColor16 hsb_this_pixel, hsb_left_pixel, hsb_right_pixel;
+                uint16_t brightness = 0, hue = 0;
 
-                this_pixel = strip->GetPixelColor(segment.Map(j, i));
-                left_pixel = strip->GetPixelColor(segment.Map(j, i-1));
-                right_pixel = strip->GetPixelColor(segment.Map(j, i+1));
-
-                hsb_this_pixel = HsbColor(RgbColor(this_pixel.R, this_pixel.G, this_pixel.B));
-                hsb_left_pixel = HsbColor(RgbColor(left_pixel.R, left_pixel.G, left_pixel.B));
-                hsb_right_pixel = HsbColor(RgbColor(right_pixel.R, right_pixel.G, right_pixel.B));
+                hsb_this_pixel = FastHsb::FromRgb(canvas->GetPixelColor(segment->Map(j, i)));
+                hsb_left_pixel = FastHsb::FromRgb(canvas->GetPixelColor(segment->Map(j, i-1)));
+                hsb_right_pixel = FastHsb::FromRgb(canvas->GetPixelColor(segment->Map(j, i+1)));
                                                 
                 if (hsb_right_pixel.B > hsb_this_pixel.B) {
-                    brightness = hsb_this_pixel.B / 6.0f + hsb_right_pixel.B / 3.0f;
+                    brightness = (hsb_this_pixel.B + 2 * hsb_right_pixel.B) / 6;
                     hue = hsb_right_pixel.H;
                     inc++;
                     turn = true;
@@ -727,35 +1258,29 @@ void FireworksAnimationSetHsb()
                     hue = hsb_this_pixel.H;
                     turn = false;
                 } else if (inc > 0) {
-                    brightness = hsb_this_pixel.B / 6.0f + hsb_left_pixel.B / 3.0f;
+                    brightness = (hsb_this_pixel.B + 2 * hsb_left_pixel.B) / 6;
                     hue = hsb_left_pixel.H;
                     inc--;
                 }
-                brightness = brightness > 1.0 ? 1.0 : brightness;
+                brightness = MIN(brightness, 255);
 
-                HsbColor color = HsbColor(hue, 1.0f, brightness);
-                strip->SetPixelColor(segment.Map(j, i), color);
+                canvas->SetPixelColor(segment->Map(j, i), FastHsb::ToRgbw(hue, 255, brightness));
             }
         }
 
         // Bottom to Top
-        uint16_t StepWidth = segment.getPixelCountAtRing(0);
+        uint16_t StepWidth = segment->getPixelCountAtRing(0);
         for (uint16_t i = 0; i < StepWidth; i++) {
             for (uint16_t j = 0; j < NumSteps; j++ ) {
-                RgbwColor this_pixel, bottom_pixel, top_pixel;
-                HsbColor hsb_this_pixel, hsb_bottom_pixel, hsb_top_pixel;
-                float brightness = 0.0, hue = 0.0;
-
-                this_pixel = strip->GetPixelColor(segment.Map(j, i));
-                bottom_pixel = strip->GetPixelColor(segment.Map(j-1, i));
-                top_pixel = strip->GetPixelColor(segment.Map(j+1, i));
+                HsbColor16 hsb_this_pixel, hsb_bottom_pixel, hsb_top_pixel;
+                uint16_t brightness = 0, hue = 0;
 
-                hsb_this_pixel = HsbColor(RgbColor(this_pixel.R, this_pixel.G, this_pixel.B));
-                hsb_bottom_pixel = HsbColor(RgbColor(bottom_pixel.R, bottom_pixel.G, bottom_pixel.B));
-                hsb_top_pixel = HsbColor(RgbColor(top_pixel.R, top_pixel.G, top_pixel.B));
+                hsb_this_pixel = FastHsb::FromRgb(canvas->GetPixelColor(segment->Map(j, i)));
+                hsb_bottom_pixel = FastHsb::FromRgb(canvas->GetPixelColor(segment->Map(j-1, i)));
+                hsb_top_pixel = FastHsb::FromRgb(canvas->GetPixelColor(segment->Map(j+1, i)));
 
                 if (hsb_top_pixel.B > hsb_this_pixel.B) {
-                    brightness = hsb_this_pixel.B / 6.0f + hsb_top_pixel.B / 3.0f;
+                    brightness = (hsb_this_pixel.B + 2 * hsb_top_pixel.B) / 6;
                     hue = hsb_top_pixel.H;
                     inc++;
                     turn = true;
@@ -765,14 +1290,13 @@ void FireworksAnimationSetHsb()
                     hue = hsb_this_pixel.H;
                     turn = false;
                 } else if (inc > 0) {
-                    brightness = hsb_this_pixel.B / 6.0f + hsb_bottom_pixel.B / 3.0f;
+                    brightness = (hsb_this_pixel.B + 2 * hsb_bottom_pixel.B) / 6;
                     hue = hsb_bottom_pixel.H;
                     inc--;
                 }
-                brightness = brightness > 1.0 ? 1.0 : brightness;
+                brightness = MIN(brightness, 255);
 
-                HsbColor color = HsbColor(hue, 1.0f, brightness);
-                strip->SetPixelColor(segment.Map(j, i), color);
+                canvas->SetPixelColor(segment->Map(j, i), FastHsb::ToRgbw(hue, 255, brightness));
             }
         }
 
@@ -786,98 +1310,424 @@ void FireworksAnimationSetHsb()
 
     // fire off the animation even before the previous firework has faded away
     // this ensures fireworks are being generated at random times
-    animations->StartAnimation(0, 50, animUpdate);
+    animations->StartAnimation(0, effect_duration(50), animUpdate);
     
 }
 
 
 
-void animation_task(void * param)
+void seed_effect_random()
 {
-    strip->Begin();   
-    strip->Show();
+#ifdef ANIMATION_RANDOM_SEED
+    effect_random.Seed(ANIMATION_RANDOM_SEED);
+#else
+    effect_random.Seed(esp_random());
+#endif
+}
 
-    while(1) {
-        if (animations->IsAnimating()) {
-            animations->UpdateAnimations();
-            strip->Show();
+static void frame_timer_callback(void* arg)
+{
+    xTaskNotify(s_animation_task_handle, ANIM_NOTIFY_FRAME, eSetBits);
+}
+
+// the effects HomeKit can start, in input source order. init_accessory() makes an input
+// source of each; /setconfig.json takes their ids for layers. the trails of Cylon, Snake,
+// StepCylon and Fireworks fade by a step a frame, tuned at 50 fps. the others blend over
+// seconds and look the same at 25
+static const effect_info_t s_effect_registry[] = {
+    // id  name            start                                                fps  state                     reads back
+    { 1, "Cylon",        [](float, float) { CylonAnimationSet(); },            50, sizeof(sweep_state_t),    true },
+    { 2, "Glitter",      [](float, float) { GlitterAnimationSet(); },          25, 0,                        true },
+    { 3, "StepCylon",    [](float, float) { StepCylonAnimationSet(); },        50, 0,                        true },
+    { 4, "RainbowFade",  [](float, float) { RainbowFadeAnimationSet(); },      25, sizeof(rainbow_state_t),  false },
+    { 5, "Fireworks",    [](float, float) { FireworksAnimationSetHsb(); },     50, 0,                        true },
+    { 6, "Flicker",      FlickerAnimationSet,                                  25, 0,                        true },
+    { 7, "Snake",        [](float, float) { SnakeAnimationSet(); },            50, sizeof(sweep_state_t),    true },
+    { 8, "ColorCycle",   ColorCycleAnimationSet,                               25, 0,                        false },
+    { 9, "Ripple",       [](float, float) { RippleAnimationSet(); },           25, sizeof(rainbow_state_t),  false },
+};
+
+#define EFFECT_COUNT    (sizeof(s_effect_registry) / sizeof(s_effect_registry[0]))
+static_assert(EFFECT_COUNT <= MAX_ANIMATIONS, "more effects than MAX_ANIMATIONS");
+
+uint8_t get_effect_count()
+{
+    return EFFECT_COUNT;
+}
+
+const effect_info_t* get_effect(uint8_t index)
+{
+    return index < EFFECT_COUNT ? &s_effect_registry[index] : NULL;
+}
+
+const effect_info_t* find_effect(uint32_t animation_id)
+{
+    for (const effect_info_t& effect : s_effect_registry) {
+        if (effect.id == animation_id) {
+            return &effect;
         }
-        vTaskDelay(3);
     }
+    return NULL;
 }
 
-void animation_select_task(void * param)
+// the state an instance needs for any effect in the registry
+static uint8_t effect_state_size()
 {
-    s_led_message_queue = xQueueCreate( 10, sizeof(led_strip_t));
-    led_strip_t led_strip;
+    uint8_t size = 1;
+    for (const effect_info_t& effect : s_effect_registry) {
+        size = MAX(size, effect.state_size);
+    }
+    return size;
+}
+
+// starts an effect in the instance animations, tweens and canvas point at
+static void start_effect(uint32_t animation_id, float hue, float saturation)
+{
+    const effect_info_t* effect = find_effect(animation_id);
+    if (effect == NULL) {
+        return;
+    }
+    s_effect->animation_id = animation_id;
+    effect->start(hue, saturation);
+}
 
-    led_strip.hue               = 0.0f;
-    led_strip.saturation        = 0.0f;
-    led_strip.brightness        = 0;
-    led_strip.animate           = false;
+// the rate the running effects of every zone need: the fastest any of them asks for, and
+// no faster than frame_rate. fades and effects without a rate of their own run at frame_rate
+static uint8_t effects_frame_rate()
+{
+    uint8_t rate = 0;
+    for (uint8_t z = 0; z < s_zone_count; z++) {
+        for (uint8_t e = 0; e < s_effect_count; e++) {
+            const effect_instance_t& instance = s_zones[z].effects[e];
+            if (!instance.animations->IsAnimating()) {
+                continue;
+            }
+            const effect_info_t* effect = find_effect(instance.animation_id);
+            if (effect == NULL || effect->frame_rate == 0) {
+                return s_frame_rate;
+            }
+            rate = MAX(rate, MIN(effect->frame_rate, s_frame_rate));
+        }
+    }
+    return rate ? rate : s_frame_rate;
+}
 
-    set_strip(led_strip);
+// runs the layers over the zone's light at 'level' (out of 256) of their opacity, 0 stops
+// them. a layer is left out while its effect runs below it or in an earlier layer
+void show_layers(uint16_t level)
+{
+    s_zone->layer_level = level;
+    for (uint8_t i = 0; i < s_layer_count; i++) {
+        uint32_t id = s_layers[i].animation_id;
+        bool wanted = level != 0 && id != s_zone->animation_id && !(s_zone->crossfading && id == s_zone->outgoing_id);
+        for (uint8_t j = 0; j < i; j++) {
+            if (s_layers[j].animation_id == id) {
+                wanted = false;
+            }
+        }
 
-    while(1) {
-        if (xQueueReceive(s_led_message_queue, (void *) &led_strip, portMAX_DELAY) == pdTRUE) {
-            if (led_strip.animate) {
+        bind_effect(BASE_INSTANCES + i);
+        if (wanted && !animations->IsAnimating()) {
+            canvas->ClearTo(RgbwColor(0));
+            start_effect(id, s_zone->hue, s_zone->saturation);
+        }
+        else if (!wanted && animations->IsAnimating()) {
+            animations->StopAll();
+        }
+    }
+    bind_effect(s_zone->incoming);
+}
+
+// starts what a command asks for in the zone bound. runs on animation_task between frames,
+// so the animator and strip are never changed while UpdateAnimations() runs
+static void apply_command(const led_strip_t& led_strip)
+{
+    // the effect already running carries on. set_strip() has passed the colour on
+    // through the live parameters
+    if (led_strip.animate && led_strip.animation_id == s_zone->animation_id && animations->IsAnimating()) {
+        set_zone_brightness(*s_zone, led_strip.brightness);
+        return;
+    }
+
+    seed_effect_random();
+
+    if (led_strip.animate) {
+        // effects start from a black canvas. from another effect, that one crossfades
+        // into the new one; otherwise the first frame of the effect goes out straight away
+        begin_effect(led_strip.animation_id, s_zone->animation_id != 0 && animations->IsAnimating());
+        s_zone->fading = false;
+        s_zone->animation_id = led_strip.animation_id;
+
+        set_zone_brightness(*s_zone, led_strip.brightness);
+        start_effect(led_strip.animation_id, led_strip.hue, led_strip.saturation);
+
+        // the output stage dims the layers along with the effect
+        show_layers(256);
+    } 
+    
+    else {
+        // an effect is stopped, along with one fading out; a fade still running is retargeted
+        if (!s_zone->fading) {
+            end_crossfade();
+            if (animations->IsAnimating()) {
                 animations->StopAll();
-                strip->ClearTo(HsbColor(0.0, 0.0, 0.0));
-                strip->Show();
+            }
+        }
+        s_zone->animation_id = 0;
 
-                vTaskDelay(50);
-
-                atomic_brightness = led_strip.brightness;
-                
-                switch(led_strip.animation_id) {
-                    case 1:
-                        CylonAnimationSet();
-                        break;
-                    case 2:
-                        GlitterAnimationSet();
-                        break;
-                    case 3:
-                        StepCylonAnimationSet();
-                        break;
-                    case 4:
-                        RainbowFadeAnimationSet();
-                        break;
-                    case 5:
-                        FireworksAnimationSetHsb();
-                        break;
-                    case 6:
-                        FlickerAnimationSet(led_strip.hue, led_strip.saturation);
-                        break;  
-                    case 7:
-                        SnakeAnimationSet();
-                        break;  
-                    case 8:
-                        ColorCycleAnimationSet(led_strip.hue, led_strip.saturation);
-                        break;         
-                }
-            } 
-            
-            else {
-                if (animations->IsAnimating()) {
-                    animations->StopAll();
+        // the fade carries the brightness in its colours, so the layers are dimmed to match
+        show_layers(led_strip.brightness * 256 / 100);
+
+        // the custom/switch id picks the order the fade moves in
+        TransitionStyle style = led_strip.custom_id < TransitionStyle_Count ? (TransitionStyle)led_strip.custom_id : TransitionStyle_Uniform;
+        s_effect->animation_id = 0;
+        FadeAnimationSet(HsbColor(led_strip.hue, led_strip.saturation, led_strip.brightness/100.0f), style);
+    }
+}
+
+// copies the live parameters for this frame. a new speed stretches or squeezes what is
+// left of every running animation, so the effects keep their place
+static void read_effect_params()
+{
+    effect_params_t previous = s_frame_params;
+    if (!s_effect_params.TryRead(s_frame_params)) {
+        return;
+    }
+
+    for (uint8_t z = 0; z < s_zone_count; z++) {
+        zone_t& zone = s_zones[z];
+        if (s_frame_params.hue[z] != zone.hue || s_frame_params.saturation[z] != zone.saturation) {
+            zone.hue = s_frame_params.hue[z];
+            zone.saturation = s_frame_params.saturation[z];
+            zone.colour_changes++;
+        }
+
+        if (s_frame_params.speed != previous.speed) {
+            for (uint8_t e = 0; e < s_effect_count; e++) {
+                effect_instance_t& effect = zone.effects[e];
+                for (uint16_t i = 0; i < zone.rings.getCountOfRings(); i++) {
+                    if (effect.animations->IsAnimationActive(i)) {
+                        uint32_t duration = (uint32_t)effect.animations->AnimationDuration(i) * previous.speed / s_frame_params.speed;
+                        effect.animations->ChangeAnimationDuration(i, MAX(1, MIN(UINT16_MAX, duration)));
+                    }
                 }
-                // look at custom/switch id and determine direction for fade
-                int8_t direction = 0;
-                switch (led_strip.custom_id) {
-                    case 0:
-                        direction = 0;
-                        break;
-                    case 1:
-                        direction = 1;
-                        break;
-                    case 2:
-                        direction = -1;
-                        break;
+            }
+        }
+    }
+}
+
+// applies the latest command from set_strip() to each zone that has one
+static bool take_command()
+{
+    bool taken = false;
+    for (uint8_t z = 0; z < s_zone_count; z++) {
+        anim_command_t command;
+        if (!s_zones[z].commands.Take(command)) {
+            continue;
+        }
+        latency_trace_receive(command.seq);
+        bind_zone(z);
+        apply_command(command.led_strip);
+        latency_trace_applied(command.seq);
+        taken = true;
+    }
+    return taken;
+}
+
+void animation_task(void * param)
+{
+    uint32_t notify_bits;
+    uint32_t reported_skipped = 0;
+    uint32_t reported_coalesced = 0;
+    int64_t last_report = 0;
+    int64_t last_zone_report = 0;
+
+    strip->Begin();   
+    strip->Show();
+
+    // start dark, until HomeKit says otherwise
+    for (uint8_t z = 0; z < s_zone_count; z++) {
+        led_strip_t off = {};
+        bind_zone(z);
+        apply_command(off);
+    }
+
+    s_frame_scheduler.Begin(s_frame_rate, esp_timer_get_time());
+
+    while(1) {
+        // nothing to render. sleep until set_strip() posts a command, waking at the
+        // keep-alive interval to resend the unchanged strip
+        if (!effects_animating()) {
+            TickType_t keep_alive = s_keep_alive_ms ? MAX(pdMS_TO_TICKS(s_keep_alive_ms), 1) : portMAX_DELAY;
+            xTaskNotifyWait(0, ANIM_NOTIFY_FRAME | ANIM_NOTIFY_WAKE, &notify_bits, keep_alive);
+            read_effect_params();
+            // a command renders its first frame straight away
+            if (!take_command()) {
+                strip->Show();
+            }
+            s_frame_scheduler.Resync(esp_timer_get_time());
+            continue;
+        }
+
+        // esp_timer has microsecond resolution, so the frame rate is not tied to the tick rate
+        int64_t wait_us = s_frame_scheduler.TimeToNextFrame(esp_timer_get_time());
+        if (wait_us > 0) {
+            esp_timer_start_once(s_frame_timer, wait_us);
+            do {
+                xTaskNotifyWait(0, ANIM_NOTIFY_FRAME | ANIM_NOTIFY_WAKE, &notify_bits, portMAX_DELAY);
+            } while (!(notify_bits & ANIM_NOTIFY_FRAME));
+        }
+
+        int64_t now = esp_timer_get_time();
+        s_frame_scheduler.FrameStarted(now);
+
+        // only the latest command posted since the last frame is applied
+        read_effect_params();
+        take_command();
+
+        // Show() only transmits when a pixel changed, or the keep-alive is due
+        uint32_t traced = latency_trace_render();
+        render_frame();
+        strip->Show();
+        latency_trace_shown(traced);
+
+        // the next frame comes at the rate of what is running now
+        s_frame_scheduler.SetFrameRate(effects_frame_rate());
+
+        // report late frames and replaced commands, at most every 10 seconds
+        uint32_t coalesced = commands_coalesced();
+        if ((s_frame_scheduler.FramesSkipped() != reported_skipped || coalesced != reported_coalesced) && now - last_report > 10000000) {
+            if (s_frame_scheduler.FramesSkipped() != reported_skipped) {
+                ESP_LOGW(TAG, "%" PRIu32 " frames skipped (%" PRIu32 " rendered) at %d fps", 
+                    s_frame_scheduler.FramesSkipped() - reported_skipped, s_frame_scheduler.FramesRendered(), s_frame_scheduler.FrameRate());
+            }
+            if (coalesced != reported_coalesced) {
+                uint32_t posted = 0;
+                for (uint8_t z = 0; z < MAX_ZONES; z++) {
+                    posted += s_zones[z].commands.Posted();
                 }
-                FadeAnimationSet(HsbColor(led_strip.hue, led_strip.saturation, led_strip.brightness/100.0f), direction);
+                ESP_LOGI(TAG, "%" PRIu32 " commands replaced by newer ones before a frame (%" PRIu32 " posted)",
+                    coalesced - reported_coalesced, posted);
+            }
+            reported_skipped = s_frame_scheduler.FramesSkipped();
+            reported_coalesced = coalesced;
+            last_report = now;
+        }
+
+        // with zones, what each costs to render, every 10 seconds
+        if (s_zone_count > 1 && now - last_zone_report > 10000000) {
+            for (uint8_t z = 0; z < s_zone_count; z++) {
+                led_zone_timing_t timing;
+                get_zone_timing(z, &timing);
+                ESP_LOGI(TAG, "Zone %d: %" PRIu32 " us/frame, max %" PRIu32 " us over %" PRIu32 " frames", z,
+                    timing.average_us, timing.max_us, timing.frames);
             }
+            last_zone_report = now;
+        }
+    }
+}
+
+// splits the rings over the configured outputs. without an "outputs" config
+// every ring is sent on data_gpio
+static uint8_t build_outputs(const led_output_t* output_config, uint8_t num_outputs, uint8_t data_gpio, NeoStripOutput* outputs)
+{
+    uint8_t ring_count = s_layout.getCountOfRings();
+    uint8_t ring = 0;
+    uint16_t first = 0;
+    uint8_t count = 0;
+
+    if (num_outputs == 0) {
+        outputs[0] = { data_gpio, 0, s_layout.getPixelCount() };
+        return 1;
+    }
+
+    for (uint8_t i = 0; i < num_outputs && ring < ring_count; i++) {
+        uint8_t last_ring = (i == num_outputs - 1) ? ring_count : MIN(ring + output_config[i].rings, ring_count);
+
+        uint16_t pixels = 0;
+        for (; ring < last_ring; ring++) {
+            pixels += s_layout.getPixelCountAtRing(ring);
+        }
+
+        if (pixels == 0) {
+            ESP_LOGW(TAG, "output %d (gpio %d) has no pixels", i, output_config[i].gpio);
+            continue;
+        }
+        outputs[count++] = { output_config[i].gpio, first, pixels };
+        first += pixels;
+    }
+    return count;
+}
+
+// checks the zones configured against a layout of 'ring_count' rings. a zone has to start
+// after the one before and end by the last ring, or it is left out. without a zones
+// config, or none left, the whole layout is one zone
+static uint8_t build_zones(const led_zone_t* zone_config, uint8_t num_zones, uint8_t ring_count, led_zone_t* zones)
+{
+    uint8_t count = 0;
+    uint16_t next_ring = 0;
+
+    for (uint8_t i = 0; i < num_zones && count < MAX_ZONES; i++) {
+        const led_zone_t& zone = zone_config[i];
+        if (zone.rings == 0 || zone.first_ring < next_ring || zone.first_ring + zone.rings > ring_count) {
+            ESP_LOGW(TAG, "zone %d (rings %d to %d) left out", i, zone.first_ring, zone.first_ring + zone.rings - 1);
+            continue;
+        }
+        zones[count++] = zone;
+        next_ring = zone.first_ring + zone.rings;
+    }
+
+    if (count == 0) {
+        zones[count++] = { 0, ring_count };
+    }
+    return count;
+}
+
+uint8_t get_zone_count() {
+    uint8_t num_rings = 0;
+    led_zone_t zone_config[MAX_ZONES];
+    size_t size = 0;
+
+    nvs_handle config_handle;
+    if (nvs_open("lights", NVS_READONLY, &config_handle) == ESP_OK) {
+        nvs_get_u8(config_handle, "num_rings", &num_rings);
+        size = sizeof(zone_config);
+        if (nvs_get_blob(config_handle, "zones", zone_config, &size) != ESP_OK) {
+            size = 0;
         }
+        nvs_close(config_handle);
     }
+
+    led_zone_t zones[MAX_ZONES];
+    return build_zones(zone_config, size / sizeof(led_zone_t), num_rings, zones);
+}
+
+void get_zone_timing(uint8_t zone, led_zone_timing_t *timing) {
+    *timing = {};
+    if (zone >= s_zone_count) {
+        return;
+    }
+
+    zone_t& z = s_zones[zone];
+    uint32_t ticks_per_us = esp_rom_get_cpu_ticks_per_us();
+    timing->frames = z.render_frames;
+    timing->average_us = z.render_frames ? z.render_cycles / z.render_frames / ticks_per_us : 0;
+    timing->max_us = z.render_max_cycles / ticks_per_us;
+
+    z.render_cycles = 0;
+    z.render_max_cycles = 0;
+    z.render_frames = 0;
+}
+
+esp_err_t init_animation() {
+    if (s_params_mutex == NULL) {
+        s_params_mutex = xSemaphoreCreateMutex();
+        if (s_params_mutex == NULL) {
+            ESP_LOGE(TAG, "unable to create effect params mutex");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    return ESP_OK;
 }
 
 esp_err_t start_animation_task() {
@@ -885,6 +1735,13 @@ esp_err_t start_animation_task() {
     esp_err_t err;
     nvs_handle config_handle;
     uint8_t data_gpio;
+    led_output_t output_config[MAX_OUTPUTS];
+    uint8_t num_outputs = 0;
+    led_zone_t zone_config[MAX_ZONES];
+    uint8_t num_zones = 0;
+    uint8_t gamma = DEFAULT_GAMMA;
+    uint8_t calibration[4] = DEFAULT_CALIBRATION;
+    uint8_t white_extract = DEFAULT_WHITE_EXTRACT;
     err = nvs_open("lights", NVS_READWRITE, &config_handle);
     if (err == ESP_OK) {
         // Data GPIO
@@ -892,6 +1749,70 @@ esp_err_t start_animation_task() {
         if (err != ESP_OK) {
             ESP_LOGW(TAG, "error nvs_get_u8 data_gpio err %d", err);
         }
+
+        // Frame rate is optional
+        if (nvs_get_u8(config_handle, "frame_rate", &s_frame_rate) != ESP_OK || s_frame_rate == 0) {
+            s_frame_rate = DEFAULT_FRAME_RATE;
+        }
+        s_frame_rate = MIN(s_frame_rate, MAX_FRAME_RATE);
+
+        // Keep-alive is optional. 0 turns it off
+        if (nvs_get_u16(config_handle, "keep_alive_ms", &s_keep_alive_ms) != ESP_OK) {
+            s_keep_alive_ms = DEFAULT_KEEP_ALIVE_MS;
+        }
+
+        // Fade time is optional. 0 jumps straight to the new colour
+        if (nvs_get_u16(config_handle, "fade_ms", &s_fade_ms) != ESP_OK) {
+            s_fade_ms = DEFAULT_FADE_MS;
+        }
+        s_fade_ms = MIN(s_fade_ms, MAX_FADE_MS);
+
+        // Crossfade between effects is optional. 0 cuts straight to the new effect
+        if (nvs_get_u16(config_handle, "crossfade_ms", &s_crossfade_ms) != ESP_OK) {
+            s_crossfade_ms = DEFAULT_CROSSFADE_MS;
+        }
+        s_crossfade_ms = MIN(s_crossfade_ms, MAX_CROSSFADE_MS);
+
+        // Layers are optional. a layer with an unknown effect or blend is left out
+        led_layer_t layers[MAX_LAYERS];
+        size_t layers_size = sizeof(layers);
+        s_layer_count = 0;
+        if (nvs_get_blob(config_handle, "layers", layers, &layers_size) == ESP_OK) {
+            for (uint8_t i = 0; i < layers_size / sizeof(led_layer_t); i++) {
+                if (find_effect(layers[i].animation_id) != NULL && layers[i].blend < PixelBlend_Count) {
+                    s_layers[s_layer_count++] = layers[i];
+                }
+            }
+        }
+
+        // Effect speed, density and direction are optional. /setconfig.json also sets them live
+        uint16_t speed = DEFAULT_EFFECT_SPEED;
+        uint16_t density = DEFAULT_EFFECT_DENSITY;
+        uint8_t reverse = 0;
+        nvs_get_u16(config_handle, "effect_speed", &speed);
+        nvs_get_u16(config_handle, "effect_density", &density);
+        nvs_get_u8(config_handle, "effect_reverse", &reverse);
+        set_effect_motion(speed, density, reverse != 0);
+
+        // Outputs are optional. without them everything is sent on data_gpio
+        size_t size = sizeof(output_config);
+        if (nvs_get_blob(config_handle, "outputs", output_config, &size) == ESP_OK) {
+            num_outputs = size / sizeof(led_output_t);
+        }
+
+        // Zones are optional. without them the whole layout is one light
+        size = sizeof(zone_config);
+        if (nvs_get_blob(config_handle, "zones", zone_config, &size) == ESP_OK) {
+            num_zones = size / sizeof(led_zone_t);
+        }
+
+        // Output stage is optional
+        if (nvs_get_u8(config_handle, "gamma", &gamma) != ESP_OK || gamma < 10 || gamma > MAX_GAMMA) {
+            gamma = DEFAULT_GAMMA;
+        }
+        size = sizeof(calibration);
+        nvs_get_blob(config_handle, "calibration", calibration, &size);
+        nvs_get_u8(config_handle, "white_extract", &white_extract);
         nvs_close(config_handle);
     }
     if (err != ESP_OK) {
@@ -900,43 +1821,181 @@ esp_err_t start_animation_task() {
     }
 
     // read in pixel_layout
-    segment.Begin();
+    s_layout.Begin();
 
-    if (segment.getCountOfRings() == 0) {
+    if (s_layout.getCountOfRings() == 0) {
         ESP_LOGE(TAG, "unable to create strip or animations object. ring/strip not defined");
         return ESP_ERR_NOT_FOUND;
     }
 
-    ESP_LOGI(TAG, "Ring/segment size %d.     Num Pixels % d", segment.getCountOfRings(), segment.getPixelCount());
+    ESP_LOGI(TAG, "Ring/segment size %d.     Num Pixels % d", s_layout.getCountOfRings(), s_layout.getPixelCount());
 
     if (strip != NULL) {  
        delete strip;
     }
-    if (animations != NULL) {  
-       delete animations;
+    for (zone_t& zone : s_zones) {
+        for (effect_instance_t& effect : zone.effects) {
+            delete effect.animations;
+            delete effect.tweens;
+            delete effect.canvas;
+            delete[] effect.state;
+            effect = {};
+        }
+        delete zone.fades;
+        zone.fades = NULL;
+        delete zone.transition;
+        zone.transition = NULL;
     }
+    s_effect_count = BASE_INSTANCES + s_layer_count;
 
-    strip = new NeoPixelBus<NeoGrbwFeature, NeoEsp32Rmt0Sk6812Method>(segment.getPixelCount(), data_gpio);   // using RMT
-    animations = new NeoPixelAnimator(segment.getPixelCount(), NEO_CENTISECONDS);
+    NeoStripOutput outputs[MAX_OUTPUTS];
+    uint8_t output_count = build_outputs(output_config, num_outputs, data_gpio, outputs);
+    for (uint8_t i = 0; i < output_count; i++) {
+        ESP_LOGI(TAG, "Output %d: gpio %d, pixels %d to %d", i, outputs[i].pin, outputs[i].first, outputs[i].first + outputs[i].count - 1);
+    }
 
-    if (strip == NULL || animations == NULL) {
+    strip = new NeoBufferedStrip<NeoPixelBus<NeoGrbwFeature, NeoEsp32RmtNSk6812Method>>(s_layout.getPixelCount(), outputs, output_count);   // using RMT
+    if (strip == NULL) {
         ESP_LOGE(TAG, "unable to create strip or animations object. out of memory");
         return ESP_ERR_NO_MEM;
     }
 
+    led_zone_t zones[MAX_ZONES];
+    s_zone_count = build_zones(zone_config, num_zones, s_layout.getCountOfRings(), zones);
+    for (uint8_t z = 0; z < s_zone_count; z++) {
+        zone_t& zone = s_zones[z];
+        zone.rings.BeginRange(s_layout, zones[z].first_ring, zones[z].rings);
+        zone.first_pixel = s_layout.getFirstPixelAtRing(zones[z].first_ring);
+        if (s_zone_count > 1) {
+            ESP_LOGI(TAG, "Zone %d: rings %d to %d, pixels %d to %d", z, zones[z].first_ring, zones[z].first_ring + zones[z].rings - 1,
+                zone.first_pixel, zone.first_pixel + zone.rings.getPixelCount() - 1);
+        }
+
+        // effects use at most one animation per ring; per-pixel effects use tweens
+        for (uint8_t e = 0; e < s_effect_count; e++) {
+            effect_instance_t& effect = zone.effects[e];
+            effect.animations = new NeoPixelAnimator(zone.rings.getCountOfRings(), NEO_CENTISECONDS);
+            effect.tweens = new PixelTweens(zone.rings.getPixelCount());
+            effect.canvas = new PixelCanvas(zone.rings.getPixelCount());
+            effect.state = new uint8_t[effect_state_size()]();
+            if (effect.animations == NULL || effect.tweens == NULL || effect.canvas == NULL || effect.state == NULL) {
+                ESP_LOGE(TAG, "unable to create strip or animations object. out of memory");
+                return ESP_ERR_NO_MEM;
+            }
+        }
+        zone.fades = new RingFades(zone.rings.getCountOfRings());
+        zone.transition = new TransitionMap(zone.rings.getCountOfRings(), zone.rings.getPixelCount());
+        if (zone.fades == NULL || zone.transition == NULL) {
+            ESP_LOGE(TAG, "unable to create strip or animations object. out of memory");
+            return ESP_ERR_NO_MEM;
+        }
+        zone.incoming = 0;
+        zone.crossfading = false;
+        zone.layer_level = 0;
+        zone.fading = false;
+        zone.fading_pixels = false;
+        zone.animation_id = 0;
+        zone.render_cycles = 0;
+        zone.render_max_cycles = 0;
+        zone.render_frames = 0;
+    }
+    bind_zone(0);
+
+    strip->SetKeepAlive(s_keep_alive_ms);
+
+    NeoOutputStage& stage = strip->OutputStage();
+    stage.SetGamma(gamma);
+    stage.SetCalibration(calibration);
+    stage.SetWhiteExtraction(white_extract != 0);
+    // zones are dimmed as they are composed
+    stage.SetBrightness(s_zone_count == 1 ? s_zones[0].brightness.load() : 100);
 
 
-    xTaskCreatePinnedToCore(&animation_task, "anim", 4096, NULL, 10, NULL, 1);
 
-    xTaskCreate(&animation_select_task, "anim_select", 4096, NULL, 5, NULL);
+    if (s_frame_timer == NULL) {
+        const esp_timer_create_args_t frame_timer_args = {
+            .callback = &frame_timer_callback,
+            .name = "anim_frame"
+        };
+        err = esp_timer_create(&frame_timer_args, &s_frame_timer);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "unable to create frame timer err %d", err);
+            return err;
+        }
+    }
+
+    ESP_LOGI(TAG, "Frame rate %d fps. Keep-alive %d ms. Fade %d ms. Crossfade %d ms", s_frame_rate, s_keep_alive_ms, s_fade_ms, s_crossfade_ms);
+    ESP_LOGI(TAG, "Effect speed %d%%. Density %d%%. %s", s_params_written.speed, s_params_written.density,
+        s_params_written.direction > 0 ? "Forwards" : "Reversed");
+    static const char* blend_names[] = LAYER_BLEND_NAMES;
+    for (uint8_t i = 0; i < s_layer_count; i++) {
+        ESP_LOGI(TAG, "Layer %d: animation %d, opacity %d, %s", i, s_layers[i].animation_id, s_layers[i].opacity,
+            blend_names[s_layers[i].blend]);
+    }
+    ESP_LOGI(TAG, "Gamma %d.%d. Calibration %d %d %d %d. White extraction %s", gamma / 10, gamma % 10,
+        calibration[0], calibration[1], calibration[2], calibration[3], white_extract ? "on" : "off");
+
+    xTaskCreatePinnedToCore(&animation_task, "anim", 4096, NULL, 10, &s_animation_task_handle, 1);
 
     return ESP_OK;
 }
 
+// called from one task only, the HomeKit commit task (see commit_task() in
+// homekit_lights.c); the mailbox has a single producer
 void set_strip(led_strip_t led_strip) {
-    xQueueSendToBack(s_led_message_queue, (void *) &led_strip, (TickType_t) 0);
+    if (led_strip.zone >= MAX_ZONES) {
+        ESP_LOGE(TAG, "set_strip zone %d out of range", led_strip.zone);
+        return;
+    }
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    TaskHandle_t producer = NULL;
+    if (!s_strip_producer.compare_exchange_strong(producer, self)) {
+        assert(producer == self && "set_strip() called from a second task");
+    }
+
+    anim_command_t command = { led_strip, ++s_command_seq };
+    latency_trace_enqueue(command.seq);
+    // a colour for the running effect, or the layers over a plain colour, is picked
+    // up without the command
+    set_effect_colour(led_strip.zone, led_strip.hue, led_strip.saturation);
+    s_zones[led_strip.zone].commands.Post(command);
+    latency_trace_posted(command.seq);
+
+    // animation_task sleeps while nothing is animating
+    if (s_animation_task_handle != NULL) {
+        xTaskNotify(s_animation_task_handle, ANIM_NOTIFY_WAKE, eSetBits);
+    }
+}
+
+void set_brightness(uint8_t zone, int brightness) {
+    // picked up by the render task at the next frame
+    if (zone < MAX_ZONES) {
+        set_zone_brightness(s_zones[zone], brightness);
+    }
+}
+
+// takes s_params_mutex, which init_animation() has created
+static void lock_effect_params()
+{
+    xSemaphoreTake(s_params_mutex, portMAX_DELAY);
+}
+
+void set_effect_colour(uint8_t zone, float hue, float saturation) {
+    if (zone >= MAX_ZONES) {
+        return;
+    }
+    lock_effect_params();
+    s_params_written.hue[zone] = hue;
+    s_params_written.saturation[zone] = saturation;
+    s_effect_params.Write(s_params_written);
+    xSemaphoreGive(s_params_mutex);
 }
 
-void set_brightness(int brightness) {
-    atomic_brightness = brightness;
+void set_effect_motion(uint16_t speed, uint16_t density, bool reverse) {
+    lock_effect_params();
+    s_params_written.speed = MAX(MIN_EFFECT_SPEED, MIN(speed, MAX_EFFECT_SPEED));
+    s_params_written.density = MIN(density, MAX_EFFECT_DENSITY);
+    s_params_written.direction = reverse ? -1 : 1;
+    s_effect_params.Write(s_params_written);
+    xSemaphoreGive(s_params_mutex);
 }
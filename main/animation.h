@@ -2,8 +2,26 @@
 extern "C" {
 #endif
 
-#define NUM_ANIMATIONS          8
+#define MAX_ANIMATIONS          16          // effects in the registry, each an input source of every zone
 #define NUM_COLOR_CYCLE         4
+#define DEFAULT_FRAME_RATE      50          // frames per second. NVS "lights" frame_rate overrides
+#define MAX_FRAME_RATE          100         // NeoPixelAnimator runs in centiseconds; faster frames change nothing
+#define DEFAULT_KEEP_ALIVE_MS   1000        // resend an unchanged strip this often. NVS "lights" keep_alive_ms overrides
+#define DEFAULT_FADE_MS         1000        // on/off and colour fades from black to full take this long. NVS "lights" fade_ms overrides
+#define MAX_FADE_MS             20000       // directional fades take half again as long, which must fit 16 bits
+#define DEFAULT_CROSSFADE_MS    1000        // one effect fades into the next over this long. NVS "lights" crossfade_ms overrides
+#define MAX_CROSSFADE_MS        10000
+#define DEFAULT_EFFECT_SPEED    100         // percent. NVS "lights" effect_speed overrides
+#define MIN_EFFECT_SPEED        10
+#define MAX_EFFECT_SPEED        1000
+#define DEFAULT_EFFECT_DENSITY  100         // percent. NVS "lights" effect_density overrides
+#define MAX_EFFECT_DENSITY      400
+#define DEFAULT_WRITE_WINDOW_MS 10          // HomeKit writes this close together make one command. NVS "lights" write_window_ms overrides
+#define MAX_WRITE_WINDOW_MS     200
+#define MAX_OUTPUTS             8           // one RMT channel per output
+#define DEFAULT_GAMMA           22          // tenths. NVS "lights" gamma overrides
+#define MAX_GAMMA               30
+#define DEFAULT_WHITE_EXTRACT   1           // RGB common to all three is sent on the white LED. NVS "lights" white_extract overrides
 
 
 typedef struct {
@@ -14,14 +32,92 @@ typedef struct {
     bool animate;
     uint32_t animation_id;
     uint8_t custom_id;
+    uint8_t zone;               // which zone the command is for
 } led_strip_t;
 
+// NVS "lights" outputs blob is an array of these. the rings of pixel_layout are
+// wired in order: the first 'rings' go to the first output, and so on
+typedef struct {
+    uint8_t gpio;
+    uint8_t rings;              // the last output takes any rings left over
+} led_output_t;
+
+// NVS "lights" layers blob is an array of these: effects drawn over the light, bottom
+// first, each on its own canvas and composed in one pass
+typedef struct {
+    uint8_t animation_id;
+    uint8_t opacity;            // 255 is opaque
+    uint8_t blend;              // in the order of LAYER_BLEND_NAMES
+} led_layer_t;
+
+#define MAX_LAYERS              3
+#define LAYER_BLEND_NAMES       { "normal", "add", "screen", "max" }
+
+// NVS "lights" zones blob is an array of these: ranges of rings animated on their own, each
+// with its own HomeKit light. without it the whole layout is one zone
+typedef struct {
+    uint8_t first_ring;
+    uint8_t rings;
+} led_zone_t;
+
+#define MAX_ZONES               4
+
+// how long a zone took to render, over the frames since it was last read
+typedef struct {
+    uint32_t frames;
+    uint32_t average_us;
+    uint32_t max_us;
+} led_zone_timing_t;
+
+// NVS "lights" pixel_coords blob is one of these per pixel, in strip order: where each pixel of
+// an irregular install is, 0-255 across it. without it the rings are taken to be concentric
+typedef struct {
+    uint8_t x;
+    uint8_t y;
+} led_pixel_coord_t;
+
+// NVS "lights" calibration blob scales R, G, B and W (in that order) before gamma.
+// 255 is full. without it the white LED runs at 80%
+#define DEFAULT_CALIBRATION     { 255, 255, 255, 204 }
+
+// an effect HomeKit can start, from the registry in animation.cpp. init_accessory() makes an input
+// source of each and the animation task starts them by id, so adding an effect is one entry there
+typedef struct {
+    uint8_t id;                 // input source identifier and animation_id, from 1
+    const char *name;           // default input source name. NVS "homekit" anim<id> overrides
+    void (*start)(float hue, float saturation);
+    uint8_t frame_rate;         // frames per second it needs, up to frame_rate. 0 runs at frame_rate
+    uint8_t state_size;         // bytes it keeps from one frame to the next
+    bool reads_back;            // draws over its last frame, so starts from a black canvas
+} effect_info_t;
+
+// the effects in input source order. get_effect(i) for i below get_effect_count()
+uint8_t get_effect_count();
+const effect_info_t* get_effect(uint8_t index);
+
+// the effect with 'animation_id', NULL if there is none
+const effect_info_t* find_effect(uint32_t animation_id);
+
 // HomeKit         hue 360.0f   saturation 100.0f   brightness   100(int)
 // NeoPixelBus     hue   1.0f    saturation   1.0f  brightness   1.0f
 
+// creates what set_effect_colour() and set_effect_motion() lock. app_main calls it
+// before the web server and HomeKit, which call them, are started
+esp_err_t init_animation();
 esp_err_t start_animation_task();
 void set_strip(led_strip_t led_strip);
-void set_brightness(int brightness);
+void set_brightness(uint8_t zone, int brightness);
+
+// the zones configured in NVS, 1 without a zones config. init_accessory() creates a light per zone
+uint8_t get_zone_count();
+
+// the render time of 'zone' since the last call, which starts over
+void get_zone_timing(uint8_t zone, led_zone_timing_t *timing);
+
+// live parameters of the running effect, from any task. picked up at the next frame,
+// without restarting the effect
+void set_effect_colour(uint8_t zone, float hue, float saturation);
+void set_effect_motion(uint16_t speed, uint16_t density, bool reverse);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,313 @@
+#include <string.h>
+#include <sys/param.h>                  // MAX
+
+#include <homekit/homekit.h>
+#include <homekit/characteristics.h>
+
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "nvs.h"
+#include "animation.h"
+#include "latency_trace.h"
+#include "homekit_lights.h"
+
+#include "esp_log.h"
+static const char *TAG = "main";
+
+// the characteristics of the LIGHTBULB and TELEVISION services of each zone
+static homekit_lights_t s_lights[MAX_ZONES] = { 0 };
+static uint8_t s_zone_count = 0;
+
+// writes within this long of the first one are one transaction, committed as one
+// command. 0 commits every write on its own
+static uint16_t s_write_window_ms = DEFAULT_WRITE_WINDOW_MS;
+static esp_timer_handle_t s_commit_timer = NULL;
+
+// commits the writes, so neither the HomeKit task nor the esp_timer task, which runs the
+// frame timer and the strip's transmits, waits on the locks and notifies of a commit
+static TaskHandle_t s_commit_task = NULL;
+#define COMMIT_TASK_PRIORITY    5
+
+// what each characteristic of a zone was last written with, as its callback passed it.
+// commit() builds the command from these rather than from the characteristics, which
+// the HomeKit task writes without a lock
+static homekit_value_t s_values[MAX_ZONES][LIGHTS_ROLE_COUNT];
+
+// a bit per lights_role_t written to each zone since the last commit
+static uint32_t s_written[MAX_ZONES];
+
+// guards s_values and s_written. the callback runs on the HomeKit task, the commit on
+// s_commit_task
+static SemaphoreHandle_t s_lights_mutex = NULL;
+#define ROLE_BIT(role)      (1u << (role))
+
+// what the last commit for each zone asked for. the lights start off
+static led_strip_t s_committed[MAX_ZONES] = { 0 };
+static int s_last_brightness[MAX_ZONES];
+
+static void commit_written(void);
+static void commit_timer_callback(void *arg) {
+    xTaskNotifyGive(s_commit_task);
+}
+
+static void commit_task(void *arg) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        commit_written();
+    }
+}
+
+
+static homekit_characteristic_t *find_characteristic(homekit_service_t *service, const char *type, const char *name) {
+    homekit_characteristic_t *ch = service ? homekit_service_characteristic_by_type(service, type) : NULL;
+    if (ch == NULL) {
+        ESP_LOGE(TAG, "%s characteristic not found", name);
+    }
+    return ch;
+}
+
+esp_err_t homekit_lights_init(homekit_accessory_t *accessory) {
+    // the services of each zone, in the order init_accessory() added them
+    homekit_service_t *light_services[MAX_ZONES] = { 0 };
+    homekit_service_t *tv_services[MAX_ZONES] = { 0 };
+    uint8_t light_count = 0;
+    uint8_t tv_count = 0;
+    for (homekit_service_t **service = accessory->services; *service != NULL; service++) {
+        if (strcmp((*service)->type, HOMEKIT_SERVICE_LIGHTBULB) == 0 && light_count < MAX_ZONES) {
+            light_services[light_count++] = *service;
+        }
+        else if (strcmp((*service)->type, HOMEKIT_SERVICE_TELEVISION) == 0 && tv_count < MAX_ZONES) {
+            tv_services[tv_count++] = *service;
+        }
+    }
+
+    homekit_lights_t lights[MAX_ZONES];
+    uint8_t zone_count = MAX(1, MAX(light_count, tv_count));
+    for (uint8_t zone = 0; zone < zone_count; zone++) {
+        homekit_service_t *light_service = light_services[zone];
+        homekit_service_t *tv_service    = tv_services[zone];
+
+        lights[zone] = (homekit_lights_t) {
+            .on         = find_characteristic(light_service, HOMEKIT_CHARACTERISTIC_ON, "ON"),
+            .brightness = find_characteristic(light_service, HOMEKIT_CHARACTERISTIC_BRIGHTNESS, "BRIGHTNESS"),
+            .hue        = find_characteristic(light_service, HOMEKIT_CHARACTERISTIC_HUE, "HUE"),
+            .saturation = find_characteristic(light_service, HOMEKIT_CHARACTERISTIC_SATURATION, "SATURATION"),
+            .custom_id  = find_characteristic(light_service, "02B77067-DA5D-493C-829D-F6C5DCFE5C28", "Remote Switch ID"),
+            .active     = find_characteristic(tv_service, HOMEKIT_CHARACTERISTIC_ACTIVE, "ACTIVE"),
+            .active_id  = find_characteristic(tv_service, HOMEKIT_CHARACTERISTIC_ACTIVE_IDENTIFIER, "ACTIVE_IDENTIFIER"),
+        };
+
+        homekit_lights_t *l = &lights[zone];
+        if (!l->on || !l->brightness || !l->hue || !l->saturation || !l->custom_id || !l->active || !l->active_id) {
+            ESP_LOGE(TAG, "zone %d is missing a characteristic", zone);
+            return ESP_ERR_NOT_FOUND;
+        }
+    }
+
+    // Write window is optional
+    nvs_handle config_handle;
+    if (nvs_open("lights", NVS_READONLY, &config_handle) == ESP_OK) {
+        if (nvs_get_u16(config_handle, "write_window_ms", &s_write_window_ms) != ESP_OK) {
+            s_write_window_ms = DEFAULT_WRITE_WINDOW_MS;
+        }
+        nvs_close(config_handle);
+    }
+    if (s_write_window_ms > MAX_WRITE_WINDOW_MS) {
+        s_write_window_ms = MAX_WRITE_WINDOW_MS;
+    }
+
+    if (s_lights_mutex == NULL) {
+        s_lights_mutex = xSemaphoreCreateMutex();
+        if (s_lights_mutex == NULL) {
+            ESP_LOGE(TAG, "unable to create lights mutex");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    if (s_commit_timer == NULL) {
+        const esp_timer_create_args_t commit_timer_args = {
+            .callback = &commit_timer_callback,
+            .name = "lights_commit"
+        };
+        esp_err_t err = esp_timer_create(&commit_timer_args, &s_commit_timer);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "unable to create commit timer err %d", err);
+            return err;
+        }
+    }
+    if (s_commit_task == NULL) {
+        if (xTaskCreate(&commit_task, "lights_commit", 4096, NULL, COMMIT_TASK_PRIORITY, &s_commit_task) != pdPASS) {
+            ESP_LOGE(TAG, "unable to create commit task");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    ESP_LOGI(TAG, "HomeKit write window %d ms. %d zones", s_write_window_ms, zone_count);
+
+    for (uint8_t zone = 0; zone < zone_count; zone++) {
+        homekit_lights_t *l = &lights[zone];
+        s_lights[zone] = *l;
+        s_last_brightness[zone] = 100;
+
+        homekit_value_t *values = s_values[zone];
+        values[LIGHTS_ROLE_ON]          = l->on->value;
+        values[LIGHTS_ROLE_BRIGHTNESS]  = l->brightness->value;
+        values[LIGHTS_ROLE_HUE]         = l->hue->value;
+        values[LIGHTS_ROLE_SATURATION]  = l->saturation->value;
+        values[LIGHTS_ROLE_ACTIVE]      = l->active->value;
+        values[LIGHTS_ROLE_ACTIVE_ID]   = l->active_id->value;
+        values[LIGHTS_ROLE_CUSTOM_ID]   = HOMEKIT_UINT8(0);
+    }
+    s_zone_count = zone_count;
+    return ESP_OK;
+}
+
+
+// turns the writes to a zone into one command, from the state they left once every write
+// of the transaction has arrived, instead of from the order they came in. false if
+// nothing was written
+static bool commit(uint8_t zone) {
+    homekit_characteristic_t *active     = s_lights[zone].active;
+    homekit_characteristic_t *brightness = s_lights[zone].brightness;
+    homekit_characteristic_t *custom_id  = s_lights[zone].custom_id;
+
+    // the values and what was written, taken together. the Remote Switch ID belongs to
+    // this commit; one written after it is kept for the next
+    homekit_value_t values[LIGHTS_ROLE_COUNT];
+    xSemaphoreTake(s_lights_mutex, portMAX_DELAY);
+    uint32_t written = s_written[zone];
+    if (written != 0) {
+        s_written[zone] = 0;
+        memcpy(values, s_values[zone], sizeof(values));
+        s_values[zone][LIGHTS_ROLE_CUSTOM_ID] = HOMEKIT_UINT8(0);
+    }
+    xSemaphoreGive(s_lights_mutex);
+    if (written == 0) {
+        return false;
+    }
+    bool on = values[LIGHTS_ROLE_ON].bool_value;
+    bool animate = values[LIGHTS_ROLE_ACTIVE].bool_value;
+    uint8_t remote_id = values[LIGHTS_ROLE_CUSTOM_ID].int_value;
+
+    // when using Siri, 
+    //    turning ON or OFF only triggers the ON characteristic
+    //    when changing BRIGHTNESS, ON follows BRIGHTNESS
+
+    // when using the Home app, 
+    //    you must use the slider to turn on and off. Both ON followed by BRIGHTNESS characteristics trigger
+    //    when changing BRIGHTNESS, ON precedes BRIGHTNESS
+
+    // when color changes, hue and saturation events are sent. 
+    //   all of these arrive in one transaction, so they make one command
+
+    led_strip_t led_strip = { 0 };
+    led_strip.custom_id = remote_id;
+    led_strip.zone = zone;
+
+    // turn off
+    if (!on) {
+        // when you use the Home app to turn off the light, the BRIGHTNESS slider is pulled to 0%. When you
+        //   subsequently use Siri to turn it back on, the BRIGHTNESS stays at 0%. We need to restore the 
+        //   BRIGHTNESS value it was before being pulled to 0%.
+        if ((written & ROLE_BIT(LIGHTS_ROLE_BRIGHTNESS)) && values[LIGHTS_ROLE_BRIGHTNESS].int_value != s_last_brightness[zone]) {
+            ESP_LOGW(TAG, "restore last_brightness %d to characteristic", s_last_brightness[zone]);
+            // as esp-homekit's own examples do from their tasks, set the value and notify
+            brightness->value.int_value = s_last_brightness[zone];
+            homekit_characteristic_notify(brightness, brightness->value);       // notify/update the Home app
+        }
+    }
+    else {
+        // if a remote button is the cause, then turn off animations and fade as it asks
+        if (animate && remote_id != 0) {
+            animate = false;
+            active->value = HOMEKIT_UINT8(false);
+            homekit_characteristic_notify(active, active->value);
+        }
+
+        led_strip.hue               = values[LIGHTS_ROLE_HUE].float_value/360.0f;
+        led_strip.saturation        = values[LIGHTS_ROLE_SATURATION].float_value/100.0f;
+        led_strip.brightness        = values[LIGHTS_ROLE_BRIGHTNESS].int_value;
+        led_strip.animate           = animate;
+        led_strip.animation_id      = led_strip.animate ? values[LIGHTS_ROLE_ACTIVE_ID].int_value : 0;
+
+        // saved for the above case when turning off light from Home app
+        if (led_strip.brightness > 0) {
+            s_last_brightness[zone] = led_strip.brightness;
+        }
+    }
+
+    bool same_mode = led_strip.animate == s_committed[zone].animate && led_strip.animation_id == s_committed[zone].animation_id;
+    bool same_colour = led_strip.hue == s_committed[zone].hue && led_strip.saturation == s_committed[zone].saturation;
+
+    // e.g. ON written with the value it had, or the writes of our own notify above
+    if (same_mode && same_colour && led_strip.brightness == s_committed[zone].brightness) {
+        ESP_LOGW(TAG, "no change. no action.");
+    }
+    // the running animation follows the brightness on its own
+    else if (same_mode && same_colour && led_strip.animate) {
+        ESP_LOGW(TAG, "zone %d set_brightness animate active", zone);
+        set_brightness(zone, led_strip.brightness);
+    }
+    else {
+        ESP_LOGW(TAG, "zone %d set_strip %s", zone, !on ? "off" : led_strip.animate ? "animate active" : "on");
+        set_strip(led_strip);
+    }
+    s_committed[zone] = led_strip;
+
+    // reset remote custom id back to 0 (local), unless a new one has been written since
+    if (remote_id != 0 && custom_id->value.int_value == remote_id) {
+        custom_id->value = HOMEKIT_UINT8(0);
+    }
+    return true;
+}
+
+// commits everything written so far. it runs on s_commit_task only, so set_strip() has
+// a single caller. a notify in commit() comes back through state_change_on_callback(),
+// and is committed after it
+static void commit_written(void) {
+    bool committed;
+    do {
+        committed = false;
+        for (uint8_t zone = 0; zone < s_zone_count; zone++) {
+            if (commit(zone)) {
+                committed = true;
+            }
+        }
+    } while (committed);
+}
+
+
+void state_change_on_callback(homekit_characteristic_t *_ch, homekit_value_t value, void *context) {
+    lights_role_t role = (lights_role_t)((intptr_t)context & 0xff);
+    uint8_t zone = (intptr_t)context >> 8;
+
+    ESP_LOGI(TAG, "%s", _ch->description);
+
+    // not resolved, or not one of ours
+    if (s_zone_count == 0 || role == LIGHTS_ROLE_NONE || zone >= s_zone_count) {
+        ESP_LOGE(TAG, "%s. no action.", s_zone_count == 0 ? "homekit_lights_init() has not run" : "unknown characteristic");
+        return;
+    }
+
+    xSemaphoreTake(s_lights_mutex, portMAX_DELAY);
+    s_values[zone][role] = value;
+    // a Remote Switch ID comes with the writes it is for, and is committed with them
+    if (role == LIGHTS_ROLE_CUSTOM_ID) {
+        xSemaphoreGive(s_lights_mutex);
+        return;
+    }
+    // the first write to a zone opens a transaction. with one already open for another
+    // zone the timer is running, and commits both
+    uint32_t written = s_written[zone];
+    s_written[zone] |= ROLE_BIT(role);
+    xSemaphoreGive(s_lights_mutex);
+    LATENCY_TRACE_CALLBACK(written == 0);
+
+    if (s_write_window_ms == 0) {
+        xTaskNotifyGive(s_commit_task);
+    }
+    else if (written == 0) {
+        esp_timer_start_once(s_commit_timer, s_write_window_ms * 1000);
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// what each characteristic with state_change_on_callback() is. init_accessory() passes
+// it as the callback context, with the zone of its light, so a write is dispatched
+// without looking at its type
+typedef enum {
+    LIGHTS_ROLE_NONE = 0,
+    LIGHTS_ROLE_ON,
+    LIGHTS_ROLE_BRIGHTNESS,
+    LIGHTS_ROLE_HUE,
+    LIGHTS_ROLE_SATURATION,
+    LIGHTS_ROLE_ACTIVE,
+    LIGHTS_ROLE_ACTIVE_ID,
+    LIGHTS_ROLE_CUSTOM_ID,
+    LIGHTS_ROLE_COUNT
+} lights_role_t;
+
+#define LIGHTS_ROLE_CONTEXT(zone, role)     ((void *)(intptr_t)((zone) << 8 | (role)))
+
+// the characteristics state_change_on_callback() reads for a zone, resolved once from the accessory
+typedef struct {
+    homekit_characteristic_t *on;
+    homekit_characteristic_t *brightness;
+    homekit_characteristic_t *hue;
+    homekit_characteristic_t *saturation;
+    homekit_characteristic_t *custom_id;
+    homekit_characteristic_t *active;
+    homekit_characteristic_t *active_id;
+} homekit_lights_t;
+
+// looks up the characteristics of 'accessory' once. the n-th LIGHTBULB and TELEVISION
+// services are the light of zone n. ESP_ERR_NOT_FOUND if one is missing
+esp_err_t homekit_lights_init(homekit_accessory_t *accessory);
+
+// turns writes to the LIGHTBULB and TELEVISION characteristics into set_strip() commands
+void state_change_on_callback(homekit_characteristic_t *_ch, homekit_value_t value, void *context);
+
+#ifdef __cplusplus
+}
+#endif
@@ -15,6 +15,7 @@
 
 #include "wifi.h"
 #include "httpd.h"
+#include "animation.h"
 #include <homekit/homekit.h>
 
 #include "esp_log.h"
@@ -533,6 +534,111 @@ esp_err_t getconfig_json_handler(httpd_req_t *req)
             ESP_LOGW(TAG, "error nvs_get_u8 data_gpio err %d", err);
         }
 
+        // Frame rate. optional, so report the default if it has not been set
+        uint8_t frame_rate = DEFAULT_FRAME_RATE;
+        nvs_get_u8(config_handle, "frame_rate", &frame_rate);
+        cJSON_AddItemToObject(root, "frame_rate", cJSON_CreateNumber(frame_rate));
+
+        // Keep-alive (ms). optional, 0 is off
+        uint16_t keep_alive_ms = DEFAULT_KEEP_ALIVE_MS;
+        nvs_get_u16(config_handle, "keep_alive_ms", &keep_alive_ms);
+        cJSON_AddItemToObject(root, "keep_alive_ms", cJSON_CreateNumber(keep_alive_ms));
+
+        // Fade (ms) from black to full. optional, 0 jumps to the new colour
+        uint16_t fade_ms = DEFAULT_FADE_MS;
+        nvs_get_u16(config_handle, "fade_ms", &fade_ms);
+        cJSON_AddItemToObject(root, "fade_ms", cJSON_CreateNumber(fade_ms));
+
+        // Crossfade (ms) from one effect to the next. optional, 0 cuts straight over
+        uint16_t crossfade_ms = DEFAULT_CROSSFADE_MS;
+        nvs_get_u16(config_handle, "crossfade_ms", &crossfade_ms);
+        cJSON_AddItemToObject(root, "crossfade_ms", cJSON_CreateNumber(crossfade_ms));
+
+        // HomeKit write window (ms). optional, 0 commits every write on its own
+        uint16_t write_window_ms = DEFAULT_WRITE_WINDOW_MS;
+        nvs_get_u16(config_handle, "write_window_ms", &write_window_ms);
+        cJSON_AddItemToObject(root, "write_window_ms", cJSON_CreateNumber(write_window_ms));
+
+        // Effect speed and density (percent) and direction. optional
+        uint16_t effect_speed = DEFAULT_EFFECT_SPEED;
+        nvs_get_u16(config_handle, "effect_speed", &effect_speed);
+        cJSON_AddItemToObject(root, "effect_speed", cJSON_CreateNumber(effect_speed));
+
+        uint16_t effect_density = DEFAULT_EFFECT_DENSITY;
+        nvs_get_u16(config_handle, "effect_density", &effect_density);
+        cJSON_AddItemToObject(root, "effect_density", cJSON_CreateNumber(effect_density));
+
+        uint8_t effect_reverse = 0;
+        nvs_get_u8(config_handle, "effect_reverse", &effect_reverse);
+        cJSON_AddItemToObject(root, "effect_reverse", cJSON_CreateBool(effect_reverse));
+
+        // Output stage. optional, so report the defaults if they have not been set
+        uint8_t gamma = DEFAULT_GAMMA;
+        nvs_get_u8(config_handle, "gamma", &gamma);
+        cJSON_AddItemToObject(root, "gamma", cJSON_CreateNumber(gamma / 10.0));
+
+        uint8_t calibration[4] = DEFAULT_CALIBRATION;
+        size_t calibration_size = sizeof(calibration);
+        nvs_get_blob(config_handle, "calibration", calibration, &calibration_size);
+        cJSON *calibration_json = cJSON_CreateArray();
+        cJSON_AddItemToObject(root, "calibration", calibration_json);
+        for (int i = 0; i < 4; i++) {
+            cJSON_AddItemToArray(calibration_json, cJSON_CreateNumber(calibration[i]));
+        }
+
+        uint8_t white_extract = DEFAULT_WHITE_EXTRACT;
+        nvs_get_u8(config_handle, "white_extract", &white_extract);
+        cJSON_AddItemToObject(root, "white_extract", cJSON_CreateBool(white_extract));
+
+        // Outputs. optional, without them all rings are on data_gpio
+        led_output_t outputs[MAX_OUTPUTS];
+        size_t outputs_size = sizeof(outputs);
+        if (nvs_get_blob(config_handle, "outputs", outputs, &outputs_size) == ESP_OK) {
+            cJSON *outputs_json = cJSON_CreateArray();
+            cJSON_AddItemToObject(root, "outputs", outputs_json);
+
+            for (int i = 0; i < outputs_size / sizeof(led_output_t); i++) {
+                cJSON *output_json = cJSON_CreateObject();
+                cJSON_AddItemToObject(output_json, "gpio", cJSON_CreateNumber(outputs[i].gpio));
+                cJSON_AddItemToObject(output_json, "rings", cJSON_CreateNumber(outputs[i].rings));
+                cJSON_AddItemToArray(outputs_json, output_json);
+            }
+        }
+
+        // Layers drawn over the light. optional
+        led_layer_t layers[MAX_LAYERS];
+        size_t layers_size = sizeof(layers);
+        if (nvs_get_blob(config_handle, "layers", layers, &layers_size) == ESP_OK) {
+            static const char *blend_names[] = LAYER_BLEND_NAMES;
+            cJSON *layers_json = cJSON_CreateArray();
+            cJSON_AddItemToObject(root, "layers", layers_json);
+
+            for (int i = 0; i < layers_size / sizeof(led_layer_t); i++) {
+                cJSON *layer_json = cJSON_CreateObject();
+                cJSON_AddItemToObject(layer_json, "animation", cJSON_CreateNumber(layers[i].animation_id));
+                cJSON_AddItemToObject(layer_json, "opacity", cJSON_CreateNumber(layers[i].opacity));
+                if (layers[i].blend < sizeof(blend_names) / sizeof(blend_names[0])) {
+                    cJSON_AddItemToObject(layer_json, "blend", cJSON_CreateString(blend_names[layers[i].blend]));
+                }
+                cJSON_AddItemToArray(layers_json, layer_json);
+            }
+        }
+
+        // Zones, each a light of its own. optional, without them the whole layout is one light
+        led_zone_t zones[MAX_ZONES];
+        size_t zones_size = sizeof(zones);
+        if (nvs_get_blob(config_handle, "zones", zones, &zones_size) == ESP_OK) {
+            cJSON *zones_json = cJSON_CreateArray();
+            cJSON_AddItemToObject(root, "zones", zones_json);
+
+            for (int i = 0; i < zones_size / sizeof(led_zone_t); i++) {
+                cJSON *zone_json = cJSON_CreateObject();
+                cJSON_AddItemToObject(zone_json, "first_ring", cJSON_CreateNumber(zones[i].first_ring));
+                cJSON_AddItemToObject(zone_json, "rings", cJSON_CreateNumber(zones[i].rings));
+                cJSON_AddItemToArray(zones_json, zone_json);
+            }
+        }
+
         // Get configured number of rings/strips
         uint8_t num_rings = 0;
         err = nvs_get_u8(config_handle, "num_rings", &num_rings);
@@ -557,6 +663,12 @@ esp_err_t getconfig_json_handler(httpd_req_t *req)
             }
         }
 
+        // Pixel coordinates uploaded to /pixelcoords. optional, only how many there are
+        size_t coords_size = 0;
+        if (nvs_get_blob(config_handle, "pixel_coords", NULL, &coords_size) == ESP_OK) {
+            cJSON_AddItemToObject(root, "pixel_coords", cJSON_CreateNumber(coords_size / sizeof(led_pixel_coord_t)));
+        }
+
         nvs_close(config_handle);
 
         out = cJSON_PrintUnformatted(root);
@@ -629,6 +741,354 @@ esp_err_t setconfig_json_handler(httpd_req_t *req)
             ESP_LOGE(TAG, "error parsing data_gpio json");
         }
 
+        // Frame rate (fps). optional
+        cJSON *frame_rate_json = cJSON_GetObjectItem(root, "frame_rate");
+        if (cJSON_IsNumber(frame_rate_json)) {
+            if (frame_rate_json->valueint >= 1 && frame_rate_json->valueint <= MAX_FRAME_RATE) {
+                err = nvs_set_u8(config_handle, "frame_rate", frame_rate_json->valueint);
+                if (err == ESP_OK) {
+                    ESP_LOGI(TAG, "frame_rate %d", frame_rate_json->valueint);
+                } else {
+                    ESP_LOGW(TAG, "error nvs_set_u8 frame_rate %d err %d", frame_rate_json->valueint, err);
+                }
+            }
+            else {
+                ESP_LOGE(TAG, "frame_rate %d out of range", frame_rate_json->valueint);
+            }
+        }
+
+        // Keep-alive (ms) resends an unchanged strip. optional, 0 is off
+        cJSON *keep_alive_json = cJSON_GetObjectItem(root, "keep_alive_ms");
+        if (cJSON_IsNumber(keep_alive_json)) {
+            if (keep_alive_json->valueint >= 0 && keep_alive_json->valueint <= UINT16_MAX) {
+                err = nvs_set_u16(config_handle, "keep_alive_ms", keep_alive_json->valueint);
+                if (err == ESP_OK) {
+                    ESP_LOGI(TAG, "keep_alive_ms %d", keep_alive_json->valueint);
+                } else {
+                    ESP_LOGW(TAG, "error nvs_set_u16 keep_alive_ms %d err %d", keep_alive_json->valueint, err);
+                }
+            }
+            else {
+                ESP_LOGE(TAG, "keep_alive_ms %d out of range", keep_alive_json->valueint);
+            }
+        }
+
+        // Fade (ms) from black to full; smaller changes take less. optional, 0 jumps to the new colour
+        cJSON *fade_json = cJSON_GetObjectItem(root, "fade_ms");
+        if (cJSON_IsNumber(fade_json)) {
+            if (fade_json->valueint >= 0 && fade_json->valueint <= MAX_FADE_MS) {
+                err = nvs_set_u16(config_handle, "fade_ms", fade_json->valueint);
+                if (err == ESP_OK) {
+                    ESP_LOGI(TAG, "fade_ms %d", fade_json->valueint);
+                } else {
+                    ESP_LOGW(TAG, "error nvs_set_u16 fade_ms %d err %d", fade_json->valueint, err);
+                }
+            }
+            else {
+                ESP_LOGE(TAG, "fade_ms %d out of range", fade_json->valueint);
+            }
+        }
+
+        // Crossfade (ms) from one effect to the next. optional, 0 cuts straight over
+        cJSON *crossfade_json = cJSON_GetObjectItem(root, "crossfade_ms");
+        if (cJSON_IsNumber(crossfade_json)) {
+            if (crossfade_json->valueint >= 0 && crossfade_json->valueint <= MAX_CROSSFADE_MS) {
+                err = nvs_set_u16(config_handle, "crossfade_ms", crossfade_json->valueint);
+                if (err == ESP_OK) {
+                    ESP_LOGI(TAG, "crossfade_ms %d", crossfade_json->valueint);
+                } else {
+                    ESP_LOGW(TAG, "error nvs_set_u16 crossfade_ms %d err %d", crossfade_json->valueint, err);
+                }
+            }
+            else {
+                ESP_LOGE(TAG, "crossfade_ms %d out of range", crossfade_json->valueint);
+            }
+        }
+
+        // HomeKit writes this close together make one command. optional, read at start
+        cJSON *write_window_json = cJSON_GetObjectItem(root, "write_window_ms");
+        if (cJSON_IsNumber(write_window_json)) {
+            if (write_window_json->valueint >= 0 && write_window_json->valueint <= MAX_WRITE_WINDOW_MS) {
+                err = nvs_set_u16(config_handle, "write_window_ms", write_window_json->valueint);
+                if (err == ESP_OK) {
+                    ESP_LOGI(TAG, "write_window_ms %d", write_window_json->valueint);
+                } else {
+                    ESP_LOGW(TAG, "error nvs_set_u16 write_window_ms %d err %d", write_window_json->valueint, err);
+                }
+            }
+            else {
+                ESP_LOGE(TAG, "write_window_ms %d out of range", write_window_json->valueint);
+            }
+        }
+
+        // Effect speed and density (percent) and direction. optional, and applied to the
+        // running effect straight away
+        bool effect_changed = false;
+        cJSON *effect_speed_json = cJSON_GetObjectItem(root, "effect_speed");
+        if (cJSON_IsNumber(effect_speed_json)) {
+            if (effect_speed_json->valueint >= MIN_EFFECT_SPEED && effect_speed_json->valueint <= MAX_EFFECT_SPEED) {
+                err = nvs_set_u16(config_handle, "effect_speed", effect_speed_json->valueint);
+                if (err == ESP_OK) {
+                    ESP_LOGI(TAG, "effect_speed %d", effect_speed_json->valueint);
+                    effect_changed = true;
+                } else {
+                    ESP_LOGW(TAG, "error nvs_set_u16 effect_speed %d err %d", effect_speed_json->valueint, err);
+                }
+            }
+            else {
+                ESP_LOGE(TAG, "effect_speed %d out of range", effect_speed_json->valueint);
+            }
+        }
+
+        cJSON *effect_density_json = cJSON_GetObjectItem(root, "effect_density");
+        if (cJSON_IsNumber(effect_density_json)) {
+            if (effect_density_json->valueint >= 0 && effect_density_json->valueint <= MAX_EFFECT_DENSITY) {
+                err = nvs_set_u16(config_handle, "effect_density", effect_density_json->valueint);
+                if (err == ESP_OK) {
+                    ESP_LOGI(TAG, "effect_density %d", effect_density_json->valueint);
+                    effect_changed = true;
+                } else {
+                    ESP_LOGW(TAG, "error nvs_set_u16 effect_density %d err %d", effect_density_json->valueint, err);
+                }
+            }
+            else {
+                ESP_LOGE(TAG, "effect_density %d out of range", effect_density_json->valueint);
+            }
+        }
+
+        cJSON *effect_reverse_json = cJSON_GetObjectItem(root, "effect_reverse");
+        if (cJSON_IsBool(effect_reverse_json)) {
+            err = nvs_set_u8(config_handle, "effect_reverse", cJSON_IsTrue(effect_reverse_json));
+            if (err == ESP_OK) {
+                ESP_LOGI(TAG, "effect_reverse %d", cJSON_IsTrue(effect_reverse_json));
+                effect_changed = true;
+            } else {
+                ESP_LOGW(TAG, "error nvs_set_u8 effect_reverse err %d", err);
+            }
+        }
+
+        if (effect_changed) {
+            uint16_t effect_speed = DEFAULT_EFFECT_SPEED;
+            uint16_t effect_density = DEFAULT_EFFECT_DENSITY;
+            uint8_t effect_reverse = 0;
+            nvs_get_u16(config_handle, "effect_speed", &effect_speed);
+            nvs_get_u16(config_handle, "effect_density", &effect_density);
+            nvs_get_u8(config_handle, "effect_reverse", &effect_reverse);
+            set_effect_motion(effect_speed, effect_density, effect_reverse != 0);
+        }
+
+        // Gamma, e.g. 2.2. optional, stored in tenths
+        cJSON *gamma_json = cJSON_GetObjectItem(root, "gamma");
+        if (cJSON_IsNumber(gamma_json)) {
+            int gamma = (int)(gamma_json->valuedouble * 10.0 + 0.5);
+            if (gamma >= 10 && gamma <= MAX_GAMMA) {
+                err = nvs_set_u8(config_handle, "gamma", gamma);
+                if (err == ESP_OK) {
+                    ESP_LOGI(TAG, "gamma %d.%d", gamma / 10, gamma % 10);
+                } else {
+                    ESP_LOGW(TAG, "error nvs_set_u8 gamma %d err %d", gamma, err);
+                }
+            }
+            else {
+                ESP_LOGE(TAG, "gamma %.1f out of range", gamma_json->valuedouble);
+            }
+        }
+
+        // Calibration: [R,G,B,W], 255 is full. optional
+        cJSON *calibration_json = cJSON_GetObjectItem(root, "calibration");
+        if (cJSON_IsArray(calibration_json)) {
+            uint8_t calibration[4];
+            bool valid = cJSON_GetArraySize(calibration_json) == 4;
+
+            cJSON *fld;
+            uint8_t i = 0;
+
+            cJSON_ArrayForEach(fld, calibration_json) {
+                if (valid && cJSON_IsNumber(fld) && fld->valueint >= 0 && fld->valueint <= UINT8_MAX) {
+                    calibration[i++] = fld->valueint;
+                }
+                else {
+                    valid = false;
+                }
+            }
+
+            if (valid) {
+                err = nvs_set_blob(config_handle, "calibration", calibration, sizeof(calibration));
+                if (err == ESP_OK) {
+                    ESP_LOGI(TAG, "calibration %d %d %d %d", calibration[0], calibration[1], calibration[2], calibration[3]);
+                } else {
+                    ESP_LOGW(TAG, "error nvs_set_blob calibration err %d", err);
+                }
+            }
+            else {
+                ESP_LOGE(TAG, "error parsing calibration json. expected 4 numbers 0-255");
+            }
+        }
+
+        // White extraction. optional
+        cJSON *white_extract_json = cJSON_GetObjectItem(root, "white_extract");
+        if (cJSON_IsBool(white_extract_json)) {
+            err = nvs_set_u8(config_handle, "white_extract", cJSON_IsTrue(white_extract_json));
+            if (err == ESP_OK) {
+                ESP_LOGI(TAG, "white_extract %d", cJSON_IsTrue(white_extract_json));
+            } else {
+                ESP_LOGW(TAG, "error nvs_set_u8 white_extract err %d", err);
+            }
+        }
+
+        // Outputs: [{"gpio":12,"rings":4},{"gpio":13,"rings":3}]. optional, an empty array
+        // goes back to sending every ring on data_gpio
+        cJSON *outputs_json = cJSON_GetObjectItem(root, "outputs");
+        if (cJSON_IsArray(outputs_json)) {
+            int num_outputs = cJSON_GetArraySize(outputs_json);
+
+            if (num_outputs == 0) {
+                nvs_erase_key(config_handle, "outputs");
+                ESP_LOGI(TAG, "outputs removed. using data_gpio");
+            }
+            else if (num_outputs <= MAX_OUTPUTS) {
+                led_output_t outputs[MAX_OUTPUTS];
+                bool valid = true;
+
+                cJSON *fld;
+                uint8_t i = 0;
+
+                cJSON_ArrayForEach(fld, outputs_json) {
+                    cJSON *gpio_json = cJSON_GetObjectItem(fld, "gpio");
+                    cJSON *rings_json = cJSON_GetObjectItem(fld, "rings");
+                    if (cJSON_IsNumber(gpio_json) && gpio_json->valueint >= 0 && gpio_json->valueint <= 40 &&
+                        cJSON_IsNumber(rings_json) && rings_json->valueint >= 0 && rings_json->valueint <= UINT8_MAX) {
+                        outputs[i].gpio = gpio_json->valueint;
+                        outputs[i].rings = rings_json->valueint;
+                        ESP_LOGI(TAG, "output %d: gpio %d, %d rings", i, outputs[i].gpio, outputs[i].rings);
+                    }
+                    else {
+                        ESP_LOGE(TAG, "error parsing output %d json", i);
+                        valid = false;
+                    }
+                    i++;
+                }
+
+                if (valid) {
+                    size_t size = num_outputs * sizeof(led_output_t);
+                    err = nvs_set_blob(config_handle, "outputs", outputs, size);
+                    if (err != ESP_OK) {
+                        ESP_LOGW(TAG, "error nvs_set_blob outputs size %d err %d", size, err);
+                    }
+                }
+            }
+            else {
+                ESP_LOGE(TAG, "%d outputs. maximum is %d", num_outputs, MAX_OUTPUTS);
+            }
+        }
+
+        // Layers: [{"animation":2,"opacity":255,"blend":"add"}], bottom first. optional, an empty
+        // array removes them. read at start
+        cJSON *layers_json = cJSON_GetObjectItem(root, "layers");
+        if (cJSON_IsArray(layers_json)) {
+            int num_layers = cJSON_GetArraySize(layers_json);
+
+            if (num_layers == 0) {
+                nvs_erase_key(config_handle, "layers");
+                ESP_LOGI(TAG, "layers removed");
+            }
+            else if (num_layers <= MAX_LAYERS) {
+                static const char *blend_names[] = LAYER_BLEND_NAMES;
+                led_layer_t layers[MAX_LAYERS];
+                bool valid = true;
+
+                cJSON *fld;
+                uint8_t i = 0;
+
+                cJSON_ArrayForEach(fld, layers_json) {
+                    cJSON *animation_json = cJSON_GetObjectItem(fld, "animation");
+                    cJSON *opacity_json = cJSON_GetObjectItem(fld, "opacity");
+                    cJSON *blend_json = cJSON_GetObjectItem(fld, "blend");
+
+                    // normal, unless it says otherwise
+                    int blend = 0;
+                    if (cJSON_IsString(blend_json)) {
+                        for (blend = 0; blend < sizeof(blend_names) / sizeof(blend_names[0]); blend++) {
+                            if (strcmp(blend_json->valuestring, blend_names[blend]) == 0) {
+                                break;
+                            }
+                        }
+                    }
+
+                    if (cJSON_IsNumber(animation_json) && find_effect(animation_json->valueint) != NULL &&
+                        cJSON_IsNumber(opacity_json) && opacity_json->valueint >= 0 && opacity_json->valueint <= UINT8_MAX &&
+                        blend < sizeof(blend_names) / sizeof(blend_names[0])) {
+                        layers[i].animation_id = animation_json->valueint;
+                        layers[i].opacity = opacity_json->valueint;
+                        layers[i].blend = blend;
+                        ESP_LOGI(TAG, "layer %d: animation %d, opacity %d, %s", i, layers[i].animation_id, layers[i].opacity, blend_names[blend]);
+                    }
+                    else {
+                        ESP_LOGE(TAG, "error parsing layer %d json", i);
+                        valid = false;
+                    }
+                    i++;
+                }
+
+                if (valid) {
+                    size_t size = num_layers * sizeof(led_layer_t);
+                    err = nvs_set_blob(config_handle, "layers", layers, size);
+                    if (err != ESP_OK) {
+                        ESP_LOGW(TAG, "error nvs_set_blob layers size %d err %d", size, err);
+                    }
+                }
+            }
+            else {
+                ESP_LOGE(TAG, "%d layers. maximum is %d", num_layers, MAX_LAYERS);
+            }
+        }
+
+        // Zones: [{"first_ring":0,"rings":4},{"first_ring":4,"rings":3}], in ring order. optional,
+        // an empty array makes the whole layout one light again. read at start
+        cJSON *zones_json = cJSON_GetObjectItem(root, "zones");
+        if (cJSON_IsArray(zones_json)) {
+            int num_zones = cJSON_GetArraySize(zones_json);
+
+            if (num_zones == 0) {
+                nvs_erase_key(config_handle, "zones");
+                ESP_LOGI(TAG, "zones removed");
+            }
+            else if (num_zones <= MAX_ZONES) {
+                led_zone_t zones[MAX_ZONES];
+                bool valid = true;
+
+                cJSON *fld;
+                uint8_t i = 0;
+
+                cJSON_ArrayForEach(fld, zones_json) {
+                    cJSON *first_ring_json = cJSON_GetObjectItem(fld, "first_ring");
+                    cJSON *rings_json = cJSON_GetObjectItem(fld, "rings");
+                    if (cJSON_IsNumber(first_ring_json) && first_ring_json->valueint >= 0 && first_ring_json->valueint <= UINT8_MAX &&
+                        cJSON_IsNumber(rings_json) && rings_json->valueint >= 1 && rings_json->valueint <= UINT8_MAX) {
+                        zones[i].first_ring = first_ring_json->valueint;
+                        zones[i].rings = rings_json->valueint;
+                        ESP_LOGI(TAG, "zone %d: %d rings from ring %d", i, zones[i].rings, zones[i].first_ring);
+                    }
+                    else {
+                        ESP_LOGE(TAG, "error parsing zone %d json", i);
+                        valid = false;
+                    }
+                    i++;
+                }
+
+                if (valid) {
+                    size_t size = num_zones * sizeof(led_zone_t);
+                    err = nvs_set_blob(config_handle, "zones", zones, size);
+                    if (err != ESP_OK) {
+                        ESP_LOGW(TAG, "error nvs_set_blob zones size %d err %d", size, err);
+                    }
+                }
+            }
+            else {
+                ESP_LOGE(TAG, "%d zones. maximum is %d", num_zones, MAX_ZONES);
+            }
+        }
+
         // 'pixel_layout' is JSON name set in HTML
         cJSON *pixel_layout_json = cJSON_GetObjectItem(root, "pixel_layout");
 
@@ -683,6 +1143,89 @@ esp_err_t setconfig_json_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+/* POST handler for /pixelcoords. Takes an x and a y byte per pixel, in strip order, and saves
+   them to NVS for the next start. An empty body removes them */
+esp_err_t pixelcoords_handler(httpd_req_t *req)
+{
+    esp_err_t err;
+    nvs_handle config_handle;
+    int total_len = req->content_len;
+    int cur_len = 0;
+    int received = 0;
+
+    // the pixels of the layout, which the coordinates must match
+    uint16_t pixel_count = 0;
+    err = nvs_open("lights", NVS_READWRITE, &config_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "nvs_open err %d ", err);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, NULL);
+        return ESP_OK;
+    }
+    uint8_t num_rings = 0;
+    nvs_get_u8(config_handle, "num_rings", &num_rings);
+    if (num_rings > 0) {
+        uint16_t pixel_layout[num_rings];
+        size_t size = num_rings * sizeof(uint16_t);
+        if (nvs_get_blob(config_handle, "pixel_layout", pixel_layout, &size) == ESP_OK) {
+            for (int i = 0; i < num_rings; i++) {
+                pixel_count += pixel_layout[i];
+            }
+        }
+    }
+
+    if (total_len == 0) {
+        nvs_erase_key(config_handle, "pixel_coords");
+        ESP_LOGI(TAG, "pixel coordinates removed");
+    }
+    else if (total_len != (int)(pixel_count * sizeof(led_pixel_coord_t))) {
+        // Client will not receive response if it hasn't finished sending the POST data
+        nvs_close(config_handle);
+        ESP_LOGE(TAG, "pixel coordinates are %d bytes, the layout needs %d", total_len, (int)(pixel_count * sizeof(led_pixel_coord_t)));
+        return ESP_FAIL;
+    }
+    else {
+        char *buf = malloc(total_len);
+        if (buf == NULL) {
+            nvs_close(config_handle);
+            ESP_LOGE(TAG, "unable to receive pixel coordinates. out of memory");
+            return ESP_FAIL;
+        }
+        while (cur_len < total_len) {
+            received = httpd_req_recv(req, buf + cur_len, MIN(total_len - cur_len, SCRATCH_BUFSIZE));
+            if (received <= 0) {
+                if (received == HTTPD_SOCK_ERR_TIMEOUT) {
+                    // Retry if timeout occurred
+                    continue;
+                }
+                ESP_LOGE(TAG, "pixel coordinates reception failed!");
+                free(buf);
+                nvs_close(config_handle);
+                return ESP_FAIL;
+            }
+            cur_len += received;
+        }
+
+        err = nvs_set_blob(config_handle, "pixel_coords", buf, total_len);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "error nvs_set_blob pixel_coords size %d err %d", total_len, err);
+        }
+        else {
+            ESP_LOGI(TAG, "pixel coordinates for %d pixels", pixel_count);
+        }
+        free(buf);
+    }
+
+    err = nvs_commit(config_handle);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "error nvs_commit err %d", err);
+    }
+    nvs_close(config_handle);
+
+    httpd_resp_send(req, NULL, 0);
+
+    return ESP_OK;
+}
+
 
 esp_err_t start_webserver(void)
 {
@@ -694,6 +1237,7 @@ esp_err_t start_webserver(void)
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.stack_size = 6072;
     config.max_open_sockets = 5;
+    config.max_uri_handlers = 9;
     // kick off any old socket connections to allow new connections
     config.lru_purge_enable = true;
 
@@ -770,6 +1314,15 @@ esp_err_t start_webserver(void)
         };
         httpd_register_uri_handler(server, &update_boot_page);
 
+        // Pixel coordinates of an irregular install, x and y bytes per pixel
+        httpd_uri_t pixelcoords_page = {
+            .uri       = "/pixelcoords",
+            .method    = HTTP_POST,
+            .handler   = pixelcoords_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &pixelcoords_page);
+
 
         ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, wifi_event_handler, NULL, &wifi_event_handler_instance));
         ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, ESP_EVENT_ANY_ID, wifi_event_handler, NULL, &ip_event_handler_instance));
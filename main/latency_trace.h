@@ -0,0 +1,60 @@
+#pragma once
+
+/*-------------------------------------------------------------------------
+Latency trace from a HomeKit write to the frame that shows it.
+
+Only built with ANIMATION_LATENCY_TRACE (the host latency bench, see
+host_test/anim_latency.cpp); without it the marks compile to nothing.
+
+Every command set_strip() posts gets the next sequence number, starting
+at 1; latency_trace_counts() tells the last one. Its record holds the time
+of the HomeKit callback that opened the transaction it was committed from
+(see main/homekit_lights.c), of the post, of animation_task
+taking it from the mailbox, of the first render_frame() after it was
+applied, and of the return of that frame's Show(). A command replaced by
+a newer one before a frame rendered it is marked superseded and never
+gets the last two (or three, if it was replaced in the mailbox).
+-------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LATENCY_TRACE_DEPTH     1024        // records kept. older ones are overwritten
+
+typedef enum {
+    LATENCY_CALLBACK,           // state_change_on_callback() opened the transaction
+    LATENCY_ENQUEUE,            // set_strip() posts the command
+    LATENCY_RECEIVE,            // animation_task took it from the mailbox
+    LATENCY_RENDER,             // the first render_frame() after it was applied
+    LATENCY_SHOWN,              // that frame's Show() returned
+    LATENCY_STAGES
+} latency_stage_t;
+
+typedef struct {
+    int64_t us[LATENCY_STAGES];             // esp_timer_get_time(). 0 if not reached
+    bool superseded;
+} latency_record_t;
+
+typedef struct {
+    uint32_t callbacks;
+    uint32_t posted;
+    uint32_t coalesced;                     // replaced in the mailbox before they were taken
+} latency_counts_t;
+
+#ifdef ANIMATION_LATENCY_TRACE
+void latency_trace_callback(bool opens_transaction);
+bool latency_trace_get(uint32_t seq, latency_record_t *record);
+void latency_trace_counts(latency_counts_t *counts);
+
+#define LATENCY_TRACE_CALLBACK(opens_transaction)    latency_trace_callback(opens_transaction)
+#else
+#define LATENCY_TRACE_CALLBACK(opens_transaction)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -31,6 +31,7 @@ ESP_EVENT_DEFINE_BASE(BUTTON_EVENT);            // Convert button events into es
 ESP_EVENT_DEFINE_BASE(HOMEKIT_EVENT);           // Convert esp-homekit events into esp event system      
 
 #include "animation.h"
+#include "homekit_lights.h"
 
 #include "esp_log.h"
 static const char *TAG = "main";
@@ -55,128 +56,6 @@ void status_led_identify(homekit_value_t _value) {
 }
 
 
-void state_change_on_callback(homekit_characteristic_t *_ch, homekit_value_t value, void *context) {
-    // static variables retain value between calls (like global)
-    static bool last_on_state = false;
-    static int last_brightness = 100;
-
-    ESP_LOGI(TAG, "%s", _ch->description);
-
-    homekit_service_t *light_service     = homekit_service_by_type(accessories[0], HOMEKIT_SERVICE_LIGHTBULB);
-    homekit_service_t *tv_service        = homekit_service_by_type(accessories[0], HOMEKIT_SERVICE_TELEVISION);
-
-    homekit_characteristic_t *active     = homekit_service_characteristic_by_type(tv_service, HOMEKIT_CHARACTERISTIC_ACTIVE);
-    homekit_characteristic_t *active_id  = homekit_service_characteristic_by_type(tv_service, HOMEKIT_CHARACTERISTIC_ACTIVE_IDENTIFIER);
-
-    homekit_characteristic_t *brightness = homekit_service_characteristic_by_type(light_service, HOMEKIT_CHARACTERISTIC_BRIGHTNESS);
-    homekit_characteristic_t *hue        = homekit_service_characteristic_by_type(light_service, HOMEKIT_CHARACTERISTIC_HUE);
-    homekit_characteristic_t *sat        = homekit_service_characteristic_by_type(light_service, HOMEKIT_CHARACTERISTIC_SATURATION);
-    homekit_characteristic_t *on         = homekit_service_characteristic_by_type(light_service, HOMEKIT_CHARACTERISTIC_ON);
-    homekit_characteristic_t *custom_id  = homekit_service_characteristic_by_type(light_service, "02B77067-DA5D-493C-829D-F6C5DCFE5C28");
-
-    // when using Siri, 
-    //    turning ON or OFF only triggers the ON characteristic
-    //    when changing BRIGHTNESS, ON follows BRIGHTNESS
-
-    // when using the Home app, 
-    //    you must use the slider to turn on and off. Both ON followed by BRIGHTNESS characteristics trigger
-    //    when changing BRIGHTNESS, ON precedes BRIGHTNESS
-
-    
-    // when color changes, hue and saturation events are sent. 
-    //   we only need the latter one (which is hue)
-    if (strcmp(_ch->type, HOMEKIT_CHARACTERISTIC_SATURATION) == 0) {
-        ESP_LOGW(TAG, "SATURATION characteristic. no action.");
-        return;
-    }
-    // BRIGHTNESS always includes ON (before or after). ignore, unless there is a change of state, allowing the BRIGHTNESS trigger to do the work
-    else if (strcmp(_ch->type, HOMEKIT_CHARACTERISTIC_ON) == 0 && last_on_state == on->value.bool_value) {
-        ESP_LOGW(TAG, "ON bool has not changed. no action.");
-        return;
-    } 
-    else if (strcmp(_ch->type, HOMEKIT_CHARACTERISTIC_ON) == 0) {
-        ESP_LOGW(TAG, "ON bool has changed. update and continue.");
-        last_on_state = on->value.bool_value;
-    }
-
-    led_strip_t led_strip;
-
-    // turn off
-    if (!on->value.bool_value) {
-        led_strip.hue               = 0.0f;
-        led_strip.saturation        = 0.0f;
-        led_strip.brightness        = 0;
-        led_strip.animate           = false;
-        led_strip.custom_id         = custom_id->value.int_value; 
-
-        // turning off in Home app sends ON and BRIGHTNESS
-        // turning off remotely sends only ON
-        if (strcmp(_ch->type, HOMEKIT_CHARACTERISTIC_ON) == 0) {
-            ESP_LOGW(TAG, "set_strip off and save last brightness %d if[#1]", brightness->value.int_value);
-            last_brightness = brightness->value.int_value;                 // saved for the above case when turning off light from Home app
-            set_strip(led_strip);
-        }  
-        else {
-            // when you use the Home app to turn off the light, the BRIGHTNESS slider is pulled to 0%. When you
-            //   subsequently use Siri to turn it back on, the BRIGHTNESS stays at 0%. We need to restore the 
-            //   BRIGHTNESS value it was before being pulled to 0%.
-            if (brightness->value.int_value != last_brightness) {
-                ESP_LOGW(TAG, "restore last_brightness %d to characteristic if[#1]", last_brightness);
-                brightness->value.int_value = last_brightness;
-                homekit_characteristic_notify(brightness, brightness->value);       // notify/update the Home app
-            }
-            else {
-                ESP_LOGW(TAG, "ignore. this is caused by the homekit_characteristic_notify above");
-            }
-            return;
-        }
-    } 
-    // turn on animate
-    else if (active->value.bool_value) {
-        led_strip.hue               = hue->value.float_value/360.0f;
-        led_strip.saturation        = sat->value.float_value/100.0f;
-        led_strip.brightness        = brightness->value.int_value;
-        led_strip.animate           = true;
-        led_strip.animation_id      = active_id->value.int_value;
-
-        // if a remote button is the cause, then turn off animations
-        if (custom_id->value.int_value != 0) {
-            active->value = HOMEKIT_UINT8(false);
-            // this event will fire again; this time turning on the lights normally
-            homekit_characteristic_notify(active, active->value);
-            return;
-        }
-
-        if (strcmp(_ch->type, HOMEKIT_CHARACTERISTIC_BRIGHTNESS) == 0) {
-            ESP_LOGW(TAG, "set_brightness animate active elseif[#2]");
-            set_brightness(brightness->value.int_value); 
-        } 
-        else {
-            ESP_LOGW(TAG, "set_strip animate active elseif[#2]");
-            set_strip(led_strip);
-        }
-             
-    } 
-    // turn light on, modify brightness/hue/saturation or turn off animate
-    else {
-        led_strip.hue               = hue->value.float_value/360.0f;
-        led_strip.saturation        = sat->value.float_value/100.0f;
-        led_strip.brightness        = brightness->value.int_value;
-        led_strip.animate           = false;
-        led_strip.animation_id      = 0;
-        led_strip.custom_id         = custom_id->value.int_value; 
-
-        // sent on both ON, BRIGHTNESS and HUE
-        ESP_LOGW(TAG, "set_strip on elseif[#3]");
-        set_strip(led_strip);
-    }
-
-    // reset remote custom id back to 0 (local).
-    custom_id->value = HOMEKIT_UINT8(0);
-}
-
-
-
 void name_change_callback(homekit_characteristic_t *_ch, homekit_value_t value, void *context) {
     esp_err_t err;
 
@@ -190,11 +69,19 @@ void name_change_callback(homekit_characteristic_t *_ch, homekit_value_t value,
     homekit_characteristic_t *name_c = homekit_service_characteristic_by_type(
             _ch->service, HOMEKIT_CHARACTERISTIC_NAME
         );
-    // Input Source (Animations) have a NAME Characteristic
+    // Input Source (Animations) have a NAME Characteristic, the NVS key of its zone's name
     if (name_c != NULL) {
         err = nvs_set_str(config_handle, name_c->value.string_value, value.string_value);
     } else {
-        err = nvs_set_str(config_handle, "tv_name", value.string_value);
+        // the TELEVISION of each zone has its own name. the context is the zone
+        char tv_key[16];
+        int zone = (intptr_t)context;
+        if (zone == 0) {
+            snprintf(tv_key, sizeof(tv_key), "tv_name");
+        } else {
+            snprintf(tv_key, sizeof(tv_key), "tv_name%d", zone + 1);
+        }
+        err = nvs_set_str(config_handle, tv_key, value.string_value);
     }
 
     if (err != ESP_OK) {
@@ -327,8 +214,12 @@ void init_accessory() {
     char *name_value = malloc(name_len + 1);
     snprintf( name_value, name_len + 1, "esp-%02x%02x%02x", macaddr[3], macaddr[4], macaddr[5] ); 
 
-    // ACCESSORY_INFORMATION, TELEVISION, LIGHTBULB the ANIMATIONS, and NULL
-    homekit_service_t* services[4 + NUM_ANIMATIONS]; 
+    // a light per zone, each with an input source per effect in the registry
+    uint8_t zone_count = get_zone_count();
+    uint8_t effect_count = get_effect_count();
+
+    // ACCESSORY_INFORMATION, for each zone TELEVISION, LIGHTBULB and the ANIMATIONS, and NULL
+    homekit_service_t* services[2 + zone_count * (2 + effect_count)]; 
     homekit_service_t** s = services;
 
     esp_app_desc_t app_desc;
@@ -345,133 +236,163 @@ void init_accessory() {
         NULL
     });
 
-    homekit_service_t* tv_anim_services[NUM_ANIMATIONS+1];
-    homekit_service_t** s_tv = tv_anim_services;
+    // the input sources linked to each zone's TELEVISION
+    homekit_service_t* tv_anim_services[zone_count][effect_count + 1];
 
-    for (int i=0; i < NUM_ANIMATIONS; i++) {
-        int anim_name_len = snprintf(NULL, 0, "anim%d", i + 1);
-        char *anim_name_val = malloc(anim_name_len + 1);
-        snprintf(anim_name_val, anim_name_len + 1, "anim%d", i + 1);
+    for (uint8_t zone = 0; zone < zone_count; zone++) {
+        homekit_service_t** s_tv = tv_anim_services[zone];
 
-        // Use NVS to retrieve names
-        char *conf_name_val;
-        size_t required_size;
-        err = nvs_get_str(config_handle, anim_name_val, NULL, &required_size); //includes zero-terminator
-        if (err == ESP_OK) {
-            conf_name_val = malloc(required_size); 
-            nvs_get_str(config_handle, anim_name_val, conf_name_val, &required_size);
+        for (int i=0; i < effect_count; i++) {
+            const effect_info_t *effect = get_effect(i);
+            // the NAME is the NVS key of the configured name, so each zone names its
+            // inputs on its own. zones after the first are numbered, as tv_name is
+            char anim_key[16];
+            if (zone == 0) {
+                snprintf(anim_key, sizeof(anim_key), "anim%d", effect->id);
+            } else {
+                snprintf(anim_key, sizeof(anim_key), "z%da%d", zone + 1, effect->id);
+            }
+            char *anim_name_val = strdup(anim_key);
+
+            // Use NVS to retrieve names
+            char *conf_name_val;
+            size_t required_size;
+            err = nvs_get_str(config_handle, anim_name_val, NULL, &required_size); //includes zero-terminator
+            if (err == ESP_OK) {
+                conf_name_val = malloc(required_size); 
+                nvs_get_str(config_handle, anim_name_val, conf_name_val, &required_size);
             
-            ESP_LOGI("nvs", "key: %s value: %s", anim_name_val, conf_name_val);
+                ESP_LOGI("nvs", "key: %s value: %s", anim_name_val, conf_name_val);
 
-        } else {
+            } else {
 
-            ESP_LOGW(TAG, "error retrieving %s nvs_get_str err %s", anim_name_val, esp_err_to_name(err));
+                ESP_LOGW(TAG, "error retrieving %s nvs_get_str err %s", anim_name_val, esp_err_to_name(err));
 
-            int conf_name_len = snprintf(NULL, 0, "Animation %d", i + 1);
-            conf_name_val = malloc(conf_name_len + 1);
-            snprintf(conf_name_val, conf_name_len + 1, "Animation %d", i + 1);
-        }
+                conf_name_val = strdup(effect->name);
+            }
 
-        *(s_tv++) = NEW_HOMEKIT_SERVICE(INPUT_SOURCE, .characteristics=(homekit_characteristic_t*[]){
-            NEW_HOMEKIT_CHARACTERISTIC(NAME, anim_name_val),
-            NEW_HOMEKIT_CHARACTERISTIC(IDENTIFIER, i + 1),
-            NEW_HOMEKIT_CHARACTERISTIC(CONFIGURED_NAME, conf_name_val,
-                .callback=HOMEKIT_CHARACTERISTIC_CALLBACK(name_change_callback)
-            ),
-            NEW_HOMEKIT_CHARACTERISTIC(INPUT_SOURCE_TYPE, HOMEKIT_INPUT_SOURCE_TYPE_HDMI),
-            NEW_HOMEKIT_CHARACTERISTIC(IS_CONFIGURED, true),
-            NEW_HOMEKIT_CHARACTERISTIC(CURRENT_VISIBILITY_STATE, HOMEKIT_CURRENT_VISIBILITY_STATE_SHOWN),
-            NULL
-        });
-    }
-    *(s_tv++) = NULL;
+            *(s_tv++) = NEW_HOMEKIT_SERVICE(INPUT_SOURCE, .characteristics=(homekit_characteristic_t*[]){
+                NEW_HOMEKIT_CHARACTERISTIC(NAME, anim_name_val),
+                NEW_HOMEKIT_CHARACTERISTIC(IDENTIFIER, effect->id),
+                NEW_HOMEKIT_CHARACTERISTIC(CONFIGURED_NAME, conf_name_val,
+                    .callback=HOMEKIT_CHARACTERISTIC_CALLBACK(name_change_callback)
+                ),
+                NEW_HOMEKIT_CHARACTERISTIC(INPUT_SOURCE_TYPE, HOMEKIT_INPUT_SOURCE_TYPE_HDMI),
+                NEW_HOMEKIT_CHARACTERISTIC(IS_CONFIGURED, true),
+                NEW_HOMEKIT_CHARACTERISTIC(CURRENT_VISIBILITY_STATE, HOMEKIT_CURRENT_VISIBILITY_STATE_SHOWN),
+                NULL
+            });
+        }
+        *(s_tv++) = NULL;
+
+        // Use NVS to retrieve names. zones after the first are numbered
+        char tv_key[16];
+        char tv_default[16];
+        if (zone == 0) {
+            snprintf(tv_key, sizeof(tv_key), "tv_name");
+            snprintf(tv_default, sizeof(tv_default), "Animations");
+        } else {
+            snprintf(tv_key, sizeof(tv_key), "tv_name%d", zone + 1);
+            snprintf(tv_default, sizeof(tv_default), "Animations %d", zone + 1);
+        }
 
-    // Use NVS to retrieve names
-    char *conf_name_val;
-    size_t required_size;
-    err = nvs_get_str(config_handle, "tv_name", NULL, &required_size); //includes zero-terminator
-    if (err == ESP_OK) {
-        conf_name_val = malloc(required_size); 
-        nvs_get_str(config_handle, "tv_name", conf_name_val, &required_size);
+        char *conf_name_val;
+        size_t required_size;
+        err = nvs_get_str(config_handle, tv_key, NULL, &required_size); //includes zero-terminator
+        if (err == ESP_OK) {
+            conf_name_val = malloc(required_size); 
+            nvs_get_str(config_handle, tv_key, conf_name_val, &required_size);
 
-        ESP_LOGI("nvs", "key: tv_name value: %s", conf_name_val);
+            ESP_LOGI("nvs", "key: %s value: %s", tv_key, conf_name_val);
 
-    } else {
+        } else {
 
-        ESP_LOGW(TAG, "error retrieving tv_name nvs_get_str err %s", esp_err_to_name(err));
+            ESP_LOGW(TAG, "error retrieving %s nvs_get_str err %s", tv_key, esp_err_to_name(err));
 
-        int conf_name_len = snprintf(NULL, 0, "Animations");
-        conf_name_val = malloc(conf_name_len + 1);
-        snprintf(conf_name_val, conf_name_len + 1, "Animations");
-    }
+            conf_name_val = strdup(tv_default);
+        }
     
-    *(s++) = NEW_HOMEKIT_SERVICE(TELEVISION, .characteristics=(homekit_characteristic_t*[]) {
-        NEW_HOMEKIT_CHARACTERISTIC(
-            ACTIVE, false,
-                .callback=HOMEKIT_CHARACTERISTIC_CALLBACK(state_change_on_callback)
-        ),
-        NEW_HOMEKIT_CHARACTERISTIC(
-            ACTIVE_IDENTIFIER, 1,
-                .callback=HOMEKIT_CHARACTERISTIC_CALLBACK(state_change_on_callback)
-        ),
-        NEW_HOMEKIT_CHARACTERISTIC(
-            CONFIGURED_NAME, conf_name_val,
-                .callback=HOMEKIT_CHARACTERISTIC_CALLBACK(name_change_callback)
-        ),
-        NEW_HOMEKIT_CHARACTERISTIC(
-            SLEEP_DISCOVERY_MODE, HOMEKIT_SLEEP_DISCOVERY_MODE_ALWAYS_DISCOVERABLE
-        ),
-        NULL
-        }, .linked = tv_anim_services
-    );
-
-    *(s++) = NEW_HOMEKIT_SERVICE(LIGHTBULB, .primary=true, .characteristics=(homekit_characteristic_t*[]){
-            NEW_HOMEKIT_CHARACTERISTIC(NAME, "LightbulbName"),
+        *(s++) = NEW_HOMEKIT_SERVICE(TELEVISION, .characteristics=(homekit_characteristic_t*[]) {
             NEW_HOMEKIT_CHARACTERISTIC(
-                ON, false,
-                .callback=HOMEKIT_CHARACTERISTIC_CALLBACK(state_change_on_callback)
+                ACTIVE, false,
+                    .callback=HOMEKIT_CHARACTERISTIC_CALLBACK(state_change_on_callback, .context=LIGHTS_ROLE_CONTEXT(zone, LIGHTS_ROLE_ACTIVE))
             ),
             NEW_HOMEKIT_CHARACTERISTIC(
-                BRIGHTNESS, 100,
-                .callback=HOMEKIT_CHARACTERISTIC_CALLBACK(state_change_on_callback)
+                ACTIVE_IDENTIFIER, 1,
+                    .callback=HOMEKIT_CHARACTERISTIC_CALLBACK(state_change_on_callback, .context=LIGHTS_ROLE_CONTEXT(zone, LIGHTS_ROLE_ACTIVE_ID))
             ),
             NEW_HOMEKIT_CHARACTERISTIC(
-                HUE, 0,
-                .callback=HOMEKIT_CHARACTERISTIC_CALLBACK(state_change_on_callback)
+                CONFIGURED_NAME, conf_name_val,
+                    .callback=HOMEKIT_CHARACTERISTIC_CALLBACK(name_change_callback, .context=(void *)(intptr_t)zone)
             ),
             NEW_HOMEKIT_CHARACTERISTIC(
-                SATURATION, 0,
-                .callback=HOMEKIT_CHARACTERISTIC_CALLBACK(state_change_on_callback)
-            ),
-            NEW_HOMEKIT_CHARACTERISTIC(
-                CUSTOM,
-                .type = "02B77067-DA5D-493C-829D-F6C5DCFE5C28",
-                .description = "Remote Switch ID",
-                .format = homekit_format_uint8,
-                .min_value = (float[]) {0},
-                .max_value = (float[]) {6},
-                .min_step = (float[]) {1},
-                .valid_values = {
-                    .count = 7,
-                    .values = (uint8_t[]) { 0, 1, 2, 3, 4, 5, 6 },
-                },
-                .value = HOMEKIT_UINT8_(0),
-                .permissions = homekit_permissions_paired_read
-                             | homekit_permissions_paired_write,
+                SLEEP_DISCOVERY_MODE, HOMEKIT_SLEEP_DISCOVERY_MODE_ALWAYS_DISCOVERABLE
             ),
             NULL
-        });
-
-    for (int i=0; i < NUM_ANIMATIONS; i++) {
-        *(s++) = tv_anim_services[i];
-    }
+            }, .linked = tv_anim_services[zone]
+        );
 
+        char *light_name_val;
+        if (zone == 0) {
+            light_name_val = strdup("LightbulbName");
+        } else {
+            int light_name_len = snprintf(NULL, 0, "Zone %d", zone + 1);
+            light_name_val = malloc(light_name_len + 1);
+            snprintf(light_name_val, light_name_len + 1, "Zone %d", zone + 1);
+        }
 
+        *(s++) = NEW_HOMEKIT_SERVICE(LIGHTBULB, .primary=(zone == 0), .characteristics=(homekit_characteristic_t*[]){
+                NEW_HOMEKIT_CHARACTERISTIC(NAME, light_name_val),
+                NEW_HOMEKIT_CHARACTERISTIC(
+                    ON, false,
+                    .callback=HOMEKIT_CHARACTERISTIC_CALLBACK(state_change_on_callback, .context=LIGHTS_ROLE_CONTEXT(zone, LIGHTS_ROLE_ON))
+                ),
+                NEW_HOMEKIT_CHARACTERISTIC(
+                    BRIGHTNESS, 100,
+                    .callback=HOMEKIT_CHARACTERISTIC_CALLBACK(state_change_on_callback, .context=LIGHTS_ROLE_CONTEXT(zone, LIGHTS_ROLE_BRIGHTNESS))
+                ),
+                NEW_HOMEKIT_CHARACTERISTIC(
+                    HUE, 0,
+                    .callback=HOMEKIT_CHARACTERISTIC_CALLBACK(state_change_on_callback, .context=LIGHTS_ROLE_CONTEXT(zone, LIGHTS_ROLE_HUE))
+                ),
+                NEW_HOMEKIT_CHARACTERISTIC(
+                    SATURATION, 0,
+                    .callback=HOMEKIT_CHARACTERISTIC_CALLBACK(state_change_on_callback, .context=LIGHTS_ROLE_CONTEXT(zone, LIGHTS_ROLE_SATURATION))
+                ),
+                NEW_HOMEKIT_CHARACTERISTIC(
+                    CUSTOM,
+                    .type = "02B77067-DA5D-493C-829D-F6C5DCFE5C28",
+                    .description = "Remote Switch ID",
+                    .format = homekit_format_uint8,
+                    .min_value = (float[]) {0},
+                    .max_value = (float[]) {6},
+                    .min_step = (float[]) {1},
+                    .valid_values = {
+                        .count = 7,
+                        .values = (uint8_t[]) { 0, 1, 2, 3, 4, 5, 6 },
+                    },
+                    .value = HOMEKIT_UINT8_(0),
+                    .permissions = homekit_permissions_paired_read
+                                 | homekit_permissions_paired_write,
+                    .callback=HOMEKIT_CHARACTERISTIC_CALLBACK(state_change_on_callback, .context=LIGHTS_ROLE_CONTEXT(zone, LIGHTS_ROLE_CUSTOM_ID))
+                ),
+                NULL
+            });
+
+        for (int i=0; i < effect_count; i++) {
+            *(s++) = tv_anim_services[zone][i];
+        }
+    }
 
     *(s++) = NULL;
 
     accessories[0] = NEW_HOMEKIT_ACCESSORY(.category=homekit_accessory_category_lightbulb, .services=services);
     accessories[1] = NULL;
+    // resolve the characteristics state_change_on_callback() uses, once
+    err = homekit_lights_init(accessories[0]);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "homekit_lights_init err %s", esp_err_to_name(err));
+    }
 
     nvs_close(config_handle);
 
@@ -532,6 +453,9 @@ void app_main(void)
 
     led_status = led_status_init(2, true);
 
+    // before my_wifi_init() starts the web server
+    ESP_ERROR_CHECK(init_animation());
+
     my_wifi_init();
 
     // 1. button configuration